@@ -0,0 +1,324 @@
+#include "init.hpp"
+#include "bugged.hpp"
+#include <vpp/barrier.hpp>
+#include <vpp/buffer.hpp>
+#include <vpp/bufferOps.hpp>
+#include <vpp/image.hpp>
+#include <vpp/queue.hpp>
+#include <vpp/work.hpp>
+#include <vpp/vk.hpp>
+#include <vector>
+
+// makes sure that the tracker only records the needed barriers
+TEST(tracker) {
+	auto& dev = *globals.device;
+	auto queue = dev.queue(vk::QueueBits::graphics);
+	EXPECT(queue != nullptr, true);
+
+	vk::ImageCreateInfo info;
+	info.imageType = vk::ImageType::e2d;
+	info.format = vk::Format::r8g8b8a8Unorm;
+	info.extent = {32, 32, 1};
+	info.mipLevels = 2;
+	info.arrayLayers = 2;
+	info.samples = vk::SampleCountBits::e1;
+	info.tiling = vk::ImageTiling::optimal;
+	info.usage = vk::ImageUsageBits::transferDst | vk::ImageUsageBits::sampled;
+	vpp::Image image(dev, info);
+
+	vk::BufferCreateInfo bufInfo;
+	bufInfo.size = 1024;
+	bufInfo.usage = vk::BufferUsageBits::transferDst | vk::BufferUsageBits::storageBuffer;
+	vpp::Buffer buffer(dev, bufInfo);
+
+	auto cmdBuffer = dev.commandProvider().get(queue->family());
+	vk::beginCommandBuffer(cmdBuffer, {});
+
+	vpp::AccessTracker tracker;
+	vk::ImageSubresourceRange range {vk::ImageAspectBits::color, 0, 2, 0, 2};
+	vpp::Access write {vk::PipelineStageBits::transfer, vk::AccessBits::transferWrite,
+		vk::ImageLayout::transferDstOptimal};
+	vpp::Access read {vk::PipelineStageBits::fragmentShader, vk::AccessBits::shaderRead,
+		vk::ImageLayout::shaderReadOnlyOptimal};
+
+	// transition from undefined, then write-after-write
+	EXPECT(tracker.access(cmdBuffer, image, range, write), true);
+	EXPECT(tracker.state(image, 1, 1).layout, vk::ImageLayout::transferDstOptimal);
+	EXPECT(tracker.access(cmdBuffer, image, range, write), true);
+
+	// the second read of the same layout needs no barrier
+	EXPECT(tracker.access(cmdBuffer, image, range, read), true);
+	EXPECT(tracker.access(cmdBuffer, image, range, read), false);
+
+	// only the first level is transitioned back
+	EXPECT(tracker.access(cmdBuffer, image, {vk::ImageAspectBits::color, 0, 1, 0, 2}, write),
+		true);
+	EXPECT(tracker.state(image, 1, 0).layout, vk::ImageLayout::shaderReadOnlyOptimal);
+
+	// buffers: first access, read-after-write, read-after-read, disjoint write
+	vpp::Access bufWrite {vk::PipelineStageBits::transfer, vk::AccessBits::transferWrite};
+	vpp::Access bufRead {vk::PipelineStageBits::computeShader, vk::AccessBits::shaderRead};
+	EXPECT(tracker.access(cmdBuffer, buffer, 0, 512, bufWrite), false);
+	EXPECT(tracker.access(cmdBuffer, buffer, 0, 256, bufRead), true);
+	EXPECT(tracker.access(cmdBuffer, buffer, 0, 256, bufRead), false);
+	EXPECT(tracker.access(cmdBuffer, buffer, 512, 512, bufWrite), false);
+	EXPECT(tracker.access(cmdBuffer, buffer, 128, 512, bufWrite), true);
+
+	vk::endCommandBuffer(cmdBuffer);
+	vpp::CommandWork<void>(std::move(cmdBuffer), *queue).finish();
+}
+
+// reads in new stages after a write need their own barrier, even if
+// the write was already made visible to other reads
+TEST(tracker_reads) {
+	auto& dev = *globals.device;
+	auto queue = dev.queue(vk::QueueBits::graphics);
+
+	vk::ImageCreateInfo info;
+	info.imageType = vk::ImageType::e2d;
+	info.format = vk::Format::r8g8b8a8Unorm;
+	info.extent = {32, 32, 1};
+	info.mipLevels = 1;
+	info.arrayLayers = 1;
+	info.samples = vk::SampleCountBits::e1;
+	info.tiling = vk::ImageTiling::optimal;
+	info.usage = vk::ImageUsageBits::transferDst | vk::ImageUsageBits::sampled;
+	vpp::Image image(dev, info);
+
+	vk::BufferCreateInfo bufInfo;
+	bufInfo.size = 1024;
+	bufInfo.usage = vk::BufferUsageBits::transferDst | vk::BufferUsageBits::storageBuffer;
+	vpp::Buffer buffer(dev, bufInfo);
+
+	auto cmdBuffer = dev.commandProvider().get(queue->family());
+	vk::beginCommandBuffer(cmdBuffer, {});
+
+	vpp::AccessTracker tracker;
+	vk::ImageSubresourceRange range {vk::ImageAspectBits::color, 0, 1, 0, 1};
+	vpp::Access write {vk::PipelineStageBits::transfer, vk::AccessBits::transferWrite,
+		vk::ImageLayout::transferDstOptimal};
+	vpp::Access fragmentRead {vk::PipelineStageBits::fragmentShader,
+		vk::AccessBits::shaderRead, vk::ImageLayout::shaderReadOnlyOptimal};
+	vpp::Access computeRead {vk::PipelineStageBits::computeShader,
+		vk::AccessBits::shaderRead, vk::ImageLayout::shaderReadOnlyOptimal};
+
+	EXPECT(tracker.access(cmdBuffer, image, range, write), true);
+	EXPECT(tracker.access(cmdBuffer, image, range, fragmentRead), true);
+	EXPECT(tracker.access(cmdBuffer, image, range, computeRead), true);
+	EXPECT(tracker.access(cmdBuffer, image, range, computeRead), false);
+	EXPECT(tracker.access(cmdBuffer, image, range, fragmentRead), false);
+
+	vpp::Access bufWrite {vk::PipelineStageBits::transfer, vk::AccessBits::transferWrite};
+	vpp::Access bufFragmentRead {vk::PipelineStageBits::fragmentShader,
+		vk::AccessBits::shaderRead};
+	vpp::Access bufComputeRead {vk::PipelineStageBits::computeShader,
+		vk::AccessBits::shaderRead};
+
+	EXPECT(tracker.access(cmdBuffer, buffer, 0, 512, bufWrite), false);
+	EXPECT(tracker.access(cmdBuffer, buffer, 0, 512, bufFragmentRead), true);
+	EXPECT(tracker.access(cmdBuffer, buffer, 0, 512, bufComputeRead), true);
+	EXPECT(tracker.access(cmdBuffer, buffer, 0, 512, bufComputeRead), false);
+
+	// only the first half was already made visible to compute reads
+	EXPECT(tracker.access(cmdBuffer, buffer, 512, 512, bufWrite), false);
+	EXPECT(tracker.access(cmdBuffer, buffer, 512, 512, bufFragmentRead), true);
+	EXPECT(tracker.access(cmdBuffer, buffer, 256, 768, bufComputeRead), true);
+	EXPECT(tracker.access(cmdBuffer, buffer, 0, 1024, bufComputeRead), false);
+
+	vk::endCommandBuffer(cmdBuffer);
+	vpp::CommandWork<void>(std::move(cmdBuffer), *queue).finish();
+}
+
+// the typical access of a layout only uses stages and access types
+// supported by the queue
+TEST(layout_access) {
+	using Stage = vk::PipelineStageBits;
+	using Acc = vk::AccessBits;
+
+	auto all = vpp::layoutAccess(vk::ImageLayout::shaderReadOnlyOptimal);
+	EXPECT(all.stages == (Stage::vertexShader | Stage::fragmentShader |
+		Stage::computeShader), true);
+	EXPECT(all.access == (Acc::shaderRead | Acc::inputAttachmentRead), true);
+
+	// input attachments can only be read in fragment shaders
+	auto compute = vpp::layoutAccess(vk::ImageLayout::shaderReadOnlyOptimal,
+		vk::QueueBits::compute);
+	EXPECT(compute.stages == Stage::computeShader, true);
+	EXPECT(compute.access == Acc::shaderRead, true);
+
+	// no supported stage left, allCommands allows every access type
+	auto transfer = vpp::layoutAccess(vk::ImageLayout::colorAttachmentOptimal,
+		vk::QueueBits::transfer);
+	EXPECT(transfer.stages == Stage::allCommands, true);
+	EXPECT(transfer.access == (Acc::colorAttachmentRead | Acc::colorAttachmentWrite), true);
+
+	auto dst = vpp::layoutAccess(vk::ImageLayout::transferDstOptimal, vk::QueueBits::compute);
+	EXPECT(dst.stages == Stage::transfer, true);
+	EXPECT(dst.access == Acc::transferWrite, true);
+}
+
+namespace {
+
+// exposes the pending image barriers
+struct TestBatch : public vpp::BarrierBatch {
+	using vpp::BarrierBatch::BarrierBatch;
+	const std::vector<vk::ImageMemoryBarrier>& images() const { return image_; }
+};
+
+vk::ImageMemoryBarrier toTransferDst(vk::Image image, unsigned int level,
+	unsigned int levels, unsigned int layer, unsigned int layers)
+{
+	vk::ImageMemoryBarrier barrier;
+	barrier.image = image;
+	barrier.oldLayout = vk::ImageLayout::undefined;
+	barrier.newLayout = vk::ImageLayout::transferDstOptimal;
+	barrier.dstAccessMask = vk::AccessBits::transferWrite;
+	barrier.srcQueueFamilyIndex = vk::queueFamilyIgnored;
+	barrier.dstQueueFamilyIndex = vk::queueFamilyIgnored;
+	barrier.subresourceRange = {vk::ImageAspectBits::color, level, levels, layer, layers};
+	return barrier;
+}
+
+} // anonymous namespace
+
+// merges barriers for adjacent and overlapping ranges, pending barriers
+// are recorded by flush, record and the destructor
+TEST(barrier_batch) {
+	using Stage = vk::PipelineStageBits;
+	auto& dev = *globals.device;
+	auto queue = dev.queue(vk::QueueBits::graphics);
+
+	vk::ImageCreateInfo info;
+	info.imageType = vk::ImageType::e2d;
+	info.format = vk::Format::r8g8b8a8Unorm;
+	info.extent = {16, 16, 1};
+	info.mipLevels = 4;
+	info.arrayLayers = 4;
+	info.samples = vk::SampleCountBits::e1;
+	info.tiling = vk::ImageTiling::optimal;
+	info.usage = vk::ImageUsageBits::transferDst | vk::ImageUsageBits::transferSrc;
+	vpp::Image image(dev, info);
+
+	info.mipLevels = 1;
+	info.arrayLayers = 1;
+	vpp::Image cleared(dev, info);
+
+	auto cmdBuffer = dev.commandProvider().get(queue->family());
+	vk::beginCommandBuffer(cmdBuffer, {});
+
+	{
+		TestBatch batch(cmdBuffer);
+		EXPECT(batch.empty(), true);
+
+		// adjacent, then overlapping layers on the same levels
+		batch.barrier(Stage::topOfPipe, Stage::transfer, toTransferDst(image, 0, 2, 0, 1));
+		batch.barrier(Stage::topOfPipe, Stage::transfer, toTransferDst(image, 0, 2, 1, 1));
+		batch.barrier(Stage::topOfPipe, Stage::transfer, toTransferDst(image, 0, 2, 1, 3));
+		EXPECT(batch.images().size(), 1u);
+		auto range = batch.images()[0].subresourceRange;
+		EXPECT(range.baseArrayLayer, 0u);
+		EXPECT(range.layerCount, 4u);
+		EXPECT(range.levelCount, 2u);
+
+		// already covered, then overlapping levels on the same layers
+		batch.barrier(Stage::topOfPipe, Stage::transfer, toTransferDst(image, 1, 1, 2, 1));
+		EXPECT(batch.images().size(), 1u);
+		batch.barrier(Stage::topOfPipe, Stage::transfer, toTransferDst(image, 1, 3, 0, 4));
+		EXPECT(batch.images().size(), 1u);
+		range = batch.images()[0].subresourceRange;
+		EXPECT(range.baseMipLevel, 0u);
+		EXPECT(range.levelCount, 4u);
+		EXPECT(range.layerCount, 4u);
+
+		// other images are never merged
+		auto imageBarrier = toTransferDst(image, 0, 4, 0, 4);
+		imageBarrier.image = cleared;
+		batch.barrier(Stage::topOfPipe, Stage::transfer, imageBarrier);
+		EXPECT(batch.images().size(), 2u);
+		EXPECT(batch.empty(), false);
+
+		batch.flush();
+		EXPECT(batch.empty(), true);
+		EXPECT(batch.images().size(), 0u);
+
+		// record flushes before returning the command buffer
+		vk::MemoryBarrier memBarrier;
+		memBarrier.srcAccessMask = vk::AccessBits::transferWrite;
+		memBarrier.dstAccessMask = vk::AccessBits::transferWrite;
+		batch.barrier(Stage::transfer, Stage::transfer, memBarrier);
+		EXPECT(batch.empty(), false);
+		vk::ClearColorValue black {};
+		vk::cmdClearColorImage(batch.record(), cleared, vk::ImageLayout::transferDstOptimal,
+			black, {{vk::ImageAspectBits::color, 0, 1, 0, 1}});
+		EXPECT(batch.empty(), true);
+
+		// only recorded by the destructor
+		batch.barrier(Stage::transfer, Stage::transfer, memBarrier);
+		EXPECT(batch.empty(), false);
+	}
+
+	// needs the barrier recorded by the destructor to be ordered after the first clear
+	vk::ClearColorValue red {};
+	red.float32 = {1.f, 0.f, 0.f, 1.f};
+	vk::cmdClearColorImage(cmdBuffer, cleared, vk::ImageLayout::transferDstOptimal,
+		red, {{vk::ImageAspectBits::color, 0, 1, 0, 1}});
+	vk::endCommandBuffer(cmdBuffer);
+	vpp::CommandWork<void>(std::move(cmdBuffer), *queue).finish();
+
+	auto layout = vk::ImageLayout::transferDstOptimal;
+	auto work = vpp::retrieve(cleared, layout, info.format, info.extent,
+		{vk::ImageAspectBits::color, 0, 0});
+	auto data = work->data();
+	EXPECT(data.size(), 16u * 16u * 4u);
+	EXPECT(unsigned(data[0]), 255u);
+	EXPECT(unsigned(data[1]), 0u);
+}
+
+// fills a buffer, records independent work and copies the buffer after
+// waiting for a split barrier
+TEST(split_barrier) {
+	auto& dev = *globals.device;
+	auto queue = dev.queue(vk::QueueBits::graphics);
+
+	vk::BufferCreateInfo info;
+	info.size = 1024;
+	info.usage = vk::BufferUsageBits::transferDst | vk::BufferUsageBits::transferSrc;
+	vpp::Buffer src(dev, info);
+	vpp::Buffer other(dev, info);
+	vpp::Buffer dst(dev, info);
+	src.assureMemory();
+	other.assureMemory();
+	dst.assureMemory();
+
+	vpp::EventPool pool(dev);
+	{
+		vpp::SplitBarrier barrier(pool);
+		auto cmdBuffer = dev.commandProvider().get(queue->family());
+		vk::beginCommandBuffer(cmdBuffer, {});
+		vk::cmdFillBuffer(cmdBuffer, src, 0, 1024, 0x01020304u);
+		barrier.signal(cmdBuffer, vk::PipelineStageBits::transfer);
+
+		// does not depend on the fill
+		vk::cmdFillBuffer(cmdBuffer, other, 0, 1024, 0u);
+
+		vk::MemoryBarrier memBarrier;
+		memBarrier.srcAccessMask = vk::AccessBits::transferWrite;
+		memBarrier.dstAccessMask = vk::AccessBits::transferRead;
+		barrier.wait(cmdBuffer, vk::PipelineStageBits::transfer, {memBarrier});
+		vk::cmdCopyBuffer(cmdBuffer, src, dst, {{0, 0, 1024}});
+		vk::endCommandBuffer(cmdBuffer);
+
+		vpp::CommandWork<void>(std::move(cmdBuffer), *queue).finish();
+		EXPECT(pool.size(), 0u);
+	}
+
+	// the event was reset and returned to the pool
+	EXPECT(pool.size(), 1u);
+	auto event = pool.get();
+	EXPECT(vk::getEventStatus(dev, event) == vk::Result::eventReset, true);
+
+	auto data = vpp::retrieve(dst, 0, 16)->data();
+	EXPECT(data.size(), 16u);
+	EXPECT(data[0], 0x04u);
+	EXPECT(data[3], 0x01u);
+}
@@ -0,0 +1,116 @@
+// Benchmarks print the timings of alternative ways to do the same thing
+// and check nothing, therefore they are not run as tests.
+// Only built with the Benchmark option.
+
+#include "init.hpp"
+#include "bugged.hpp"
+#include <vpp/barrier.hpp>
+#include <vpp/buffer.hpp>
+#include <vpp/bufferOps.hpp>
+#include <vpp/image.hpp>
+#include <vpp/queue.hpp>
+#include <vpp/vk.hpp>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+vpp::Buffer createBuffer(vk::DeviceSize size, bool hostWrite)
+{
+	auto& dev = *globals.device;
+
+	vk::BufferCreateInfo info;
+	info.size = size;
+	info.usage = vk::BufferUsageBits::transferDst | vk::BufferUsageBits::transferSrc |
+		vk::BufferUsageBits::storageBuffer;
+
+	if(hostWrite) return {dev, info, vpp::MemoryUsage::hostWrite};
+	return {dev, info, dev.memoryTypeBits(vk::MemoryPropertyBits::deviceLocal)};
+}
+
+} // anonymous namespace
+
+// compares writing a buffer directly with uploading it using a staging buffer
+TEST(direct_write_bench) {
+	constexpr auto size = 4 * 1024 * 1024;
+	constexpr auto iterations = 32u;
+
+	std::vector<std::uint8_t> data(size, 0xCC);
+	auto bench = [&](bool hostWrite) {
+		auto buffer = createBuffer(size, hostWrite);
+		buffer.assureMemory();
+		vpp::write(buffer, data)->finish(); // warm up
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for(auto i = 0u; i < iterations; ++i) vpp::write(buffer, data)->finish();
+		auto duration = std::chrono::high_resolution_clock::now() - start;
+
+		using MS = std::chrono::duration<double, std::milli>;
+		auto ms = std::chrono::duration_cast<MS>(duration).count() / iterations;
+		std::cout << (buffer.mappable() ? "direct" : "staged") << " write of "
+			<< size / 1024 << "KB: " << ms << "ms\n";
+	};
+
+	bench(false);
+	bench(true);
+}
+
+// compares the recording cost of transitioning 64 images with one
+// pipeline barrier each and with one batched pipeline barrier
+TEST(barrier_bench) {
+	auto& dev = *globals.device;
+	auto queue = dev.queue(vk::QueueBits::graphics);
+	constexpr auto imageCount = 64u;
+	constexpr auto iterations = 256u;
+
+	vk::ImageCreateInfo info;
+	info.imageType = vk::ImageType::e2d;
+	info.format = vk::Format::r8g8b8a8Unorm;
+	info.extent = {16, 16, 1};
+	info.mipLevels = 1;
+	info.arrayLayers = 1;
+	info.samples = vk::SampleCountBits::e1;
+	info.tiling = vk::ImageTiling::optimal;
+	info.usage = vk::ImageUsageBits::transferDst | vk::ImageUsageBits::sampled;
+
+	std::vector<vpp::Image> images;
+	for(auto i = 0u; i < imageCount; ++i) {
+		images.emplace_back(dev, info);
+		images.back().assureMemory();
+	}
+
+	auto cmdBuffer = dev.commandProvider().get(queue->family(),
+		vk::CommandPoolCreateBits::resetCommandBuffer);
+	auto range = vk::ImageSubresourceRange {vk::ImageAspectBits::color, 0, 1, 0, 1};
+
+	auto bench = [&](bool batched) {
+		auto start = std::chrono::high_resolution_clock::now();
+		for(auto it = 0u; it < iterations; ++it) {
+			vk::beginCommandBuffer(cmdBuffer, {});
+			vpp::BarrierBatch batch(cmdBuffer);
+			for(auto& image : images) {
+				if(batched) {
+					vpp::changeLayoutCommand(batch, image, vk::ImageLayout::undefined,
+						vk::ImageLayout::transferDstOptimal, range);
+				} else {
+					vpp::changeLayoutCommand(cmdBuffer, image, vk::ImageLayout::undefined,
+						vk::ImageLayout::transferDstOptimal, range);
+				}
+			}
+
+			batch.flush();
+			EXPECT(batch.empty(), true);
+			vk::endCommandBuffer(cmdBuffer);
+		}
+
+		auto duration = std::chrono::high_resolution_clock::now() - start;
+		using US = std::chrono::duration<double, std::micro>;
+		auto us = std::chrono::duration_cast<US>(duration).count() / iterations;
+		std::cout << (batched ? "batched" : "single") << " transition of "
+			<< imageCount << " images: " << us << "us\n";
+	};
+
+	bench(false);
+	bench(true);
+}
@@ -2,8 +2,19 @@
 #include "init.hpp"
 #include <vpp/buffer.hpp>
 #include <vpp/bufferOps.hpp>
+#include <vpp/packed.hpp>
+#include <vpp/shadowBuffer.hpp>
+#include <vpp/compressedUpload.hpp>
+#include <vpp/readbackRing.hpp>
+#include <vpp/streamDownload.hpp>
+#include <vpp/util/file.hpp>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
 #include <vector>
 #include <cstdint>
+#include <cstring>
+#include <limits>
 
 // some custom dummy shader types
 struct Vec2f : public std::array<float, 2> {};
@@ -27,6 +38,12 @@ struct SomePOD {
 	Vec3f vec;
 };
 
+struct Vertex {
+	Vec3f pos;
+	Vec2f uv;
+	float weight;
+};
+
 // specialize vulkan handling of our dummy types
 namespace vpp {
 
@@ -50,6 +67,11 @@ template<> struct VulkanType<SomePOD> : VulkanTypeStruct<> {
 	static constexpr auto members = std::make_tuple(&SomePOD::value, &SomePOD::vec);
 };
 
+template<> struct VulkanType<Vertex> : VulkanTypeStruct<> {
+	static constexpr auto members = std::make_tuple(&Vertex::pos, &Vertex::uv,
+		&Vertex::weight);
+};
+
 }
 
 template <int i> struct D;
@@ -187,3 +209,326 @@ TEST(write_read) {
 	EXPECT(r567, (Vec3f{5.f, 6.f, 7.f}));
 	EXPECT(r8, 8);
 }
+
+TEST(interleave) {
+	vk::BufferCreateInfo bufInfo;
+	bufInfo.size = 4096;
+	bufInfo.usage = vk::BufferUsageBits::storageBuffer;
+	auto bits = globals.device->memoryTypeBits(vk::MemoryPropertyBits::hostVisible);
+	vpp::Buffer buf(*globals.device, bufInfo, bits);
+
+	constexpr auto count = 100u;
+	std::vector<Vec3f> pos(count);
+	std::vector<Vec2f> uv(count);
+	std::vector<float> weight(count);
+	for(auto i = 0u; i < count; ++i) {
+		pos[i] = {{float(i), 2.f * i, 3.f * i}};
+		uv[i] = {{-float(i), 0.5f * i}};
+		weight[i] = 1.f / (i + 1);
+	}
+
+	// pos at 0, uv at 16, weight at 24; struct align 16
+	auto soa = vpp::interleave<Vertex>(pos, uv, weight);
+	EXPECT(vpp::neededBufferSize430(soa), count * 32u);
+	EXPECT(vpp::neededBufferSize430(soa), vpp::neededBufferSize430(std::vector<Vertex>(count)));
+
+	vpp::fill430(buf, 42.f, soa)->finish();
+
+	// read it as array of structures
+	float first;
+	std::vector<Vertex> aos(count);
+	vpp::read430(buf, first, aos)->finish();
+
+	EXPECT(first, 42.f);
+	for(auto i = 0u; i < count; ++i) {
+		EXPECT(aos[i].pos, pos[i]);
+		EXPECT(aos[i].uv, uv[i]);
+		EXPECT(aos[i].weight, weight[i]);
+	}
+
+	// deinterleave it again
+	std::vector<Vec3f> rpos(count);
+	std::vector<Vec2f> ruv(count);
+	std::vector<float> rweight(count);
+	auto rsoa = vpp::interleave<Vertex>(rpos, ruv, rweight);
+	vpp::read430(buf, first, rsoa)->finish();
+
+	EXPECT(rpos == pos, true);
+	EXPECT(ruv == uv, true);
+	EXPECT(rweight == weight, true);
+}
+
+TEST(packed) {
+	vk::BufferCreateInfo bufInfo;
+	bufInfo.size = 256;
+	bufInfo.usage = vk::BufferUsageBits::vertexBuffer;
+	auto bits = globals.device->memoryTypeBits(vk::MemoryPropertyBits::hostVisible);
+	vpp::Buffer buf(*globals.device, bufInfo, bits);
+
+	static_assert(vpp::neededBufferSize430<vpp::Half<3>>() == 6);
+	static_assert(vpp::neededBufferSize430<vpp::Half<3>, vpp::Snorm8<2>>() == 6 + 2);
+	static_assert(vpp::neededBufferSize430<vpp::Unorm16<1>, vpp::A2B10G10R10>() == 4 + 4);
+
+	vpp::Half<3> half {{1.f, -0.5f, 1024.f}};
+	vpp::Snorm8<2> snorm {{1.f, -1.f}};
+	vpp::Unorm8<4> unorm {{0.f, 1.f, 2.f, -1.f}};
+	vpp::A2B10G10R10 packed {{1.f, 0.f, 1.f, 1.f}};
+	vpp::fill430(buf, half, snorm, unorm, packed)->finish();
+
+	{
+		auto map = buf.memoryMap();
+		auto ptr = map.ptr();
+
+		EXPECT(*reinterpret_cast<std::uint16_t*>(ptr), 0x3C00u);
+		EXPECT(*reinterpret_cast<std::uint16_t*>(ptr + 2), 0xB800u);
+		EXPECT(*reinterpret_cast<std::uint16_t*>(ptr + 4), 0x6400u);
+		EXPECT(*reinterpret_cast<std::int8_t*>(ptr + 6), 127);
+		EXPECT(*reinterpret_cast<std::int8_t*>(ptr + 7), -127);
+		EXPECT(*reinterpret_cast<std::uint32_t*>(ptr + 8), 0x00FFFF00u);
+		EXPECT(*reinterpret_cast<std::uint32_t*>(ptr + 12), 0xC00003FFu | (0x3FFu << 20));
+	}
+
+	vpp::Half<3> rhalf;
+	vpp::Snorm8<2> rsnorm;
+	vpp::Unorm8<4> runorm;
+	vpp::A2B10G10R10 rpacked;
+	vpp::read430(buf, rhalf, rsnorm, runorm, rpacked)->finish();
+
+	EXPECT(rhalf, half);
+	EXPECT(rsnorm, snorm);
+	EXPECT(runorm, (vpp::Unorm8<4>{{0.f, 1.f, 1.f, 0.f}}));
+	EXPECT(rpacked, packed);
+}
+
+// pack and unpack use F16C if supported, floatToHalf and halfToFloat never do.
+// Both must give the same results, also for the remainder of the 8-wide loop.
+TEST(packed_half) {
+	std::vector<float> values;
+	for(auto i = 0u; i < 1024 + 13; ++i) {
+		values.push_back((i % 2 ? -1.f : 1.f) * (i * i) / 37.f);
+	}
+
+	values.insert(values.end(), {0.f, -0.f, 65504.f, 65520.f, 1e-7f, 6e-5f,
+		std::numeric_limits<float>::infinity()});
+
+	std::vector<std::uint16_t> halfs(values.size());
+	vpp::pack(vpp::PackedFormat::sfloat16, values.data(), halfs.data(), values.size());
+
+	auto packEqual = true;
+	for(auto i = 0u; i < values.size(); ++i) {
+		packEqual &= halfs[i] == vpp::floatToHalf(values[i]);
+	}
+
+	EXPECT(packEqual, true);
+
+	std::vector<std::uint16_t> all(0x10000);
+	for(auto i = 0u; i < all.size(); ++i) all[i] = i;
+
+	// compares bits since nan != nan
+	std::vector<float> floats(all.size());
+	vpp::unpack(vpp::PackedFormat::sfloat16, all.data(), floats.data(), floats.size() - 3);
+	auto unpackEqual = true;
+	for(auto i = 0u; i < all.size() - 3; ++i) {
+		auto single = vpp::halfToFloat(all[i]);
+		unpackEqual &= std::memcmp(&single, &floats[i], sizeof(float)) == 0;
+	}
+
+	EXPECT(unpackEqual, true);
+}
+
+TEST(inline_update) {
+	static_assert(vpp::detail::pushConstantsCapacity<128, float, Vec3f>() == 4 + 12 + 12);
+	static_assert(vpp::detail::pushConstantsCapacity<128, vpp::Half<3>>() == 8);
+	static_assert(vpp::detail::pushConstantsCapacity<128, std::vector<float>>() == 128);
+
+	vpp::InlineBufferUpdate<32> update;
+	update.add(1.f, Vec3f{2.f, 3.f, 4.f}, 5);
+
+	auto data = update.data();
+	EXPECT(data.size(), 32u);
+	EXPECT(*reinterpret_cast<const float*>(&data[0]), 1.f);
+	EXPECT(*reinterpret_cast<const std::uint32_t*>(&data[4]), 0u);
+	EXPECT(*reinterpret_cast<const Vec3f*>(&data[16]), (Vec3f{2.f, 3.f, 4.f}));
+	EXPECT(*reinterpret_cast<const int*>(&data[28]), 5);
+
+	auto thrown = false;
+	try {
+		update.add(6.f);
+	} catch(const std::out_of_range&) {
+		thrown = true;
+	}
+
+	EXPECT(thrown, true);
+
+	// aligning must not move the offset past the capacity either
+	vpp::InlineBufferUpdate<20> small;
+	small.add(1.f);
+	small.align(16);
+	small.add(2.f);
+	EXPECT(small.data().size(), 20u);
+	ERROR(small.align(16), std::out_of_range);
+	EXPECT(small.data().size(), 20u);
+
+	// the size fits but not at the given offset. Throws before recording
+	ERROR(vpp::cmdPushConstants(vk::CommandBuffer {}, vk::PipelineLayout {},
+		vk::ShaderStageBits::vertex, 120, 1.f, 2.f, 3.f), std::out_of_range);
+}
+
+namespace {
+
+// creates a transfer buffer on device local or (possibly mappable) host visible memory
+vpp::Buffer transferBuffer(vk::DeviceSize size, bool hostVisible)
+{
+	auto& dev = *globals.device;
+
+	vk::BufferCreateInfo info;
+	info.size = size;
+	info.usage = vk::BufferUsageBits::transferDst | vk::BufferUsageBits::transferSrc;
+
+	auto bits = hostVisible ?
+		vk::MemoryPropertyBits::hostVisible :
+		vk::MemoryPropertyBits::deviceLocal;
+	return {dev, info, dev.memoryTypeBits(bits)};
+}
+
+} // anonymous namespace
+
+// uploads explicitly written and detected changes of a shadow copy,
+// staged and (if mappable) directly written
+TEST(shadow_buffer) {
+	constexpr auto size = 4 * 256 + 100;
+	for(auto hostVisible : {false, true}) {
+		auto buffer = transferBuffer(size, hostVisible);
+		std::vector<std::uint8_t> zeros(size, 0);
+		vpp::write(buffer, zeros)->finish();
+
+		vpp::ShadowBuffer shadow(buffer, size, 256);
+		std::vector<std::uint8_t> data(300, 0x42);
+		shadow.write(200, data);
+		EXPECT(shadow.dirtyPages(), 2u);
+
+		// only detected by comparison, in the last partial page
+		shadow.data()[size - 1] = 0x17;
+		shadow.upload()->finish();
+		EXPECT(shadow.dirtyPages(), 0u);
+
+		auto work = vpp::retrieve(buffer);
+		auto retrieved = work->data();
+		EXPECT(retrieved.size(), std::size_t(size));
+		EXPECT(std::equal(retrieved.begin(), retrieved.end(), shadow.data().begin()), true);
+		EXPECT(unsigned(retrieved[200]), 0x42u);
+		EXPECT(unsigned(retrieved[size - 1]), 0x17u);
+	}
+
+	// an empty shadow copy has no pages to mark or upload
+	auto buffer = transferBuffer(16, false);
+	vpp::ShadowBuffer empty(buffer, 0, 256);
+	empty.markDirty(0, 16);
+	EXPECT(empty.dirtyPages(), 0u);
+	empty.upload()->finish();
+}
+
+// uploads blocks of a trivial run-length "compression" at an offset,
+// with a failing decompressor the exception is rethrown
+TEST(upload_compressed) {
+	// every compressed block is a single byte that fills the whole block
+	auto decompressor = [](nytl::Span<const std::uint8_t> src, nytl::Span<std::uint8_t> dst) {
+		if(src[0] == 0xFF) throw std::runtime_error("invalid block");
+		std::fill(dst.begin(), dst.end(), src[0]);
+	};
+
+	const std::uint8_t values[] = {0x01, 0x02, 0x03, 0x04, 0x05, 0xFF};
+	const std::size_t sizes[] = {1000, 4096, 17, 3000, 1, 64};
+	std::vector<vpp::CompressedBlock> blocks;
+	auto total = std::size_t {};
+	for(auto i = 0u; i < 5; ++i) {
+		blocks.push_back({{&values[i], 1u}, sizes[i]});
+		total += sizes[i];
+	}
+
+	// empty blocks are skipped, even the invalid one
+	blocks.insert(blocks.begin() + 2, vpp::CompressedBlock {{&values[5], 1u}, 0u});
+
+	constexpr auto offset = 256u;
+	for(auto hostVisible : {false, true}) {
+		auto buffer = transferBuffer(offset + total, hostVisible);
+		vpp::uploadCompressed(buffer, offset, blocks, decompressor, 3)->finish();
+
+		auto work = vpp::retrieve(buffer, offset, total);
+		auto retrieved = work->data();
+		auto equal = retrieved.size() == total;
+		auto pos = 0u;
+		for(auto i = 0u; i < 5 && equal; ++i) {
+			for(auto j = 0u; j < sizes[i]; ++j) equal &= retrieved[pos++] == values[i];
+		}
+
+		EXPECT(equal, true);
+	}
+
+	blocks.push_back({{&values[5], 1u}, sizes[5]});
+	auto buffer = transferBuffer(offset + total + sizes[5], false);
+	ERROR(vpp::uploadCompressed(buffer, offset, blocks, decompressor, 2), std::runtime_error);
+}
+
+// reads buffer ranges over more frames than the ring has
+TEST(readback_ring) {
+	auto& dev = *globals.device;
+	auto buffer = transferBuffer(1024, false);
+	std::vector<std::uint8_t> data(1024);
+	for(auto i = 0u; i < data.size(); ++i) data[i] = i % 251;
+	vpp::write(buffer, data)->finish();
+
+	vpp::ReadbackRing ring(dev, 256, 2);
+	std::vector<std::vector<std::uint8_t>> results(3);
+	for(auto f = 0u; f < results.size(); ++f) {
+		auto& result = results[f];
+		auto callback = [&result](nytl::Span<const std::uint8_t> read) {
+			result.assign(read.begin(), read.end());
+		};
+
+		EXPECT(ring.read(buffer, f * 128, 200, callback), true);
+		EXPECT(ring.read(buffer, 0, 100, callback), false); // not enough space left
+
+		// the ring only has two frames, so the previous one is completed
+		// before the next frame can be used
+		ring.submit();
+		if(f > 0) EXPECT(results[f - 1].size(), 200u);
+	}
+
+	ring.wait();
+	EXPECT(ring.poll(), 0u);
+	for(auto f = 0u; f < results.size(); ++f) {
+		auto& result = results[f];
+		EXPECT(result.size(), 200u);
+		EXPECT(std::equal(result.begin(), result.end(), data.begin() + f * 128), true);
+	}
+
+	// a single frame could never be in flight while the next one is recorded
+	ERROR(vpp::ReadbackRing(dev, 256, 1), std::logic_error);
+}
+
+// streams a buffer range in chunks (with a partial last one) into a file
+TEST(retrieve_to_file) {
+	constexpr auto path = "stream_test.bin";
+	for(auto hostVisible : {false, true}) {
+		auto buffer = transferBuffer(8192, hostVisible);
+		std::vector<std::uint8_t> data(8192);
+		for(auto i = 0u; i < data.size(); ++i) data[i] = (i * 13) % 253;
+		vpp::write(buffer, data)->finish();
+
+		vpp::retrieveToFile(buffer, path, 100, 5000, 1024, 2);
+		auto file = vpp::readFile(path);
+		EXPECT(file.size(), 5000u);
+		EXPECT(std::equal(file.begin(), file.end(), data.begin() + 100), true);
+
+		// the whole rest of the buffer by default
+		vpp::retrieveToFile(buffer, path, 4096);
+		file = vpp::readFile(path);
+		EXPECT(file.size(), 4096u);
+		EXPECT(std::equal(file.begin(), file.end(), data.begin() + 4096), true);
+
+		ERROR(vpp::retrieveToFile(buffer, path, 0, 1024, 0), std::logic_error);
+	}
+
+	std::remove(path);
+}
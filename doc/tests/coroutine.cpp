@@ -0,0 +1,72 @@
+#include "init.hpp"
+#include "bugged.hpp"
+#include <vpp/buffer.hpp>
+#include <vpp/bufferOps.hpp>
+#include <vpp/completion.hpp>
+#include <vpp/work.hpp>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#ifdef VPP_COROUTINES
+
+namespace {
+
+// minimal coroutine type that starts eagerly and is never awaited
+struct Task {
+	struct promise_type {
+		Task get_return_object() { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+Task roundtrip(const vpp::Buffer& buffer, const std::vector<std::uint8_t>& data,
+		std::vector<std::uint8_t>& result, std::thread::id& thread,
+		std::atomic<bool>& done) {
+	co_await vpp::write(buffer, data);
+	auto retrieved = co_await vpp::retrieve(buffer);
+	result = std::move(retrieved);
+	thread = std::this_thread::get_id();
+	done = true;
+}
+
+} // anonymous namespace
+
+// the coroutine is resumed (and the work finished) on the thread that awaited it
+TEST(co_await_work) {
+	auto& dev = *globals.device;
+
+	vk::BufferCreateInfo info;
+	info.size = 1024;
+	info.usage = vk::BufferUsageBits::transferDst | vk::BufferUsageBits::transferSrc;
+	vpp::Buffer buffer(dev, info, dev.memoryTypeBits(vk::MemoryPropertyBits::deviceLocal));
+
+	std::vector<std::uint8_t> data(1024, 0x33);
+	std::vector<std::uint8_t> retrieved;
+	std::thread::id thread;
+	std::atomic<bool> done {false};
+	roundtrip(buffer, data, retrieved, thread, done);
+
+	auto& executor = vpp::Executor::current();
+	while(!done) {
+		executor.wait(std::chrono::milliseconds(10));
+	}
+
+	EXPECT(thread == std::this_thread::get_id(), true);
+	EXPECT(retrieved.size(), data.size());
+	EXPECT(retrieved[0], 0x33u);
+}
+
+#else
+
+TEST(co_await_work) {
+	std::cout << "coroutines not supported, skipping\n";
+}
+
+#endif // VPP_COROUTINES
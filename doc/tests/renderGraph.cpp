@@ -0,0 +1,141 @@
+#include "init.hpp"
+#include "bugged.hpp"
+#include <vpp/renderGraph.hpp>
+#include <vpp/image.hpp>
+#include <vpp/queue.hpp>
+#include <vpp/work.hpp>
+#include <vpp/vk.hpp>
+
+// chain of passes whose intermediate images can alias each other
+TEST(render_graph) {
+	auto& dev = *globals.device;
+	auto queue = dev.queue(vk::QueueBits::graphics);
+	EXPECT(queue != nullptr, true);
+
+	auto format = vk::Format::r8g8b8a8Unorm;
+	vk::Extent2D extent {64, 64};
+
+	vk::ImageCreateInfo info;
+	info.imageType = vk::ImageType::e2d;
+	info.format = format;
+	info.extent = {extent.width, extent.height, 1};
+	info.mipLevels = 1;
+	info.arrayLayers = 1;
+	info.samples = vk::SampleCountBits::e1;
+	info.tiling = vk::ImageTiling::optimal;
+	info.usage = vk::ImageUsageBits::colorAttachment | vk::ImageUsageBits::transferSrc;
+	vpp::Image output(dev, info);
+
+	vk::ImageViewCreateInfo viewInfo;
+	viewInfo.image = output;
+	viewInfo.viewType = vk::ImageViewType::e2d;
+	viewInfo.format = format;
+	viewInfo.subresourceRange = {vk::ImageAspectBits::color, 0, 1, 0, 1};
+	vpp::ImageView outputView(dev, viewInfo);
+
+	vpp::RenderGraph graph(dev);
+	auto a = graph.addImage({format, extent});
+	auto b = graph.addImage({format, extent});
+	auto c = graph.addImage({format, extent});
+	auto unused = graph.addImage({format, extent});
+	auto out = graph.addExternal(format, extent, {},
+		{vk::PipelineStageBits::transfer, vk::AccessBits::transferRead,
+		vk::ImageLayout::transferSrcOptimal});
+
+	auto recorded = 0u;
+	auto record = [&](vk::CommandBuffer) { ++recorded; };
+	auto gfx = vk::QueueBits::graphics;
+
+	auto p0 = graph.addPass("a", gfx, record);
+	graph.color(p0, a, vk::ClearValue {});
+
+	auto p1 = graph.addPass("b", gfx, record);
+	graph.sampled(p1, a);
+	graph.color(p1, b);
+
+	auto p2 = graph.addPass("c", gfx, record);
+	graph.sampled(p2, b);
+	graph.color(p2, c);
+
+	auto p3 = graph.addPass("out", gfx, record);
+	graph.sampled(p3, c);
+	graph.color(p3, out, vk::ClearValue {});
+
+	// its result is never read
+	auto culled = graph.addPass("culled", gfx, record);
+	graph.sampled(culled, c);
+	graph.color(culled, unused);
+
+	graph.compile(queue->properties().queueFlags);
+	EXPECT(graph.culled(p0), false);
+	EXPECT(graph.culled(p3), false);
+	EXPECT(graph.culled(culled), true);
+	EXPECT(graph.renderPass(p1) != vk::RenderPass {}, true);
+	EXPECT(graph.renderPass(culled) == vk::RenderPass {}, true);
+	EXPECT(graph.image(unused) == vk::Image {}, true);
+
+	// a and c can share memory, b can not overlap with either of them
+	auto size = vk::getImageMemoryRequirements(dev, graph.image(a)).size;
+	EXPECT(graph.memorySize() < 3 * size, true);
+
+	graph.bind(out, output, outputView);
+	auto cmdBuffer = dev.commandProvider().get(queue->family());
+	vk::beginCommandBuffer(cmdBuffer, {});
+	graph.record(cmdBuffer);
+	vk::endCommandBuffer(cmdBuffer);
+	EXPECT(recorded, 4u);
+
+	vpp::CommandWork<void>(std::move(cmdBuffer), *queue).finish();
+}
+
+// external images are transitioned as a whole unless a range is given
+TEST(render_graph_range) {
+	auto& dev = *globals.device;
+	auto queue = dev.queue(vk::QueueBits::graphics);
+	EXPECT(queue != nullptr, true);
+
+	auto format = vk::Format::r8g8b8a8Unorm;
+	vk::Extent2D extent {64, 64};
+
+	vk::ImageCreateInfo info;
+	info.imageType = vk::ImageType::e2d;
+	info.format = format;
+	info.extent = {extent.width, extent.height, 1};
+	info.mipLevels = 2;
+	info.arrayLayers = 1;
+	info.samples = vk::SampleCountBits::e1;
+	info.tiling = vk::ImageTiling::optimal;
+	info.usage = vk::ImageUsageBits::transferDst | vk::ImageUsageBits::transferSrc;
+	vpp::Image image(dev, info);
+
+	vk::ImageViewCreateInfo viewInfo;
+	viewInfo.image = image;
+	viewInfo.viewType = vk::ImageViewType::e2d;
+	viewInfo.format = format;
+	viewInfo.subresourceRange = {vk::ImageAspectBits::color, 0, 2, 0, 1};
+	vpp::ImageView view(dev, viewInfo);
+
+	vpp::RenderGraph graph(dev);
+	auto all = graph.addExternal(format, extent, {},
+		{vk::PipelineStageBits::transfer, vk::AccessBits::transferRead,
+		vk::ImageLayout::transferSrcOptimal});
+
+	// both levels must have been transitioned for the clear
+	auto pass = graph.addPass("clear", vk::QueueBits::transfer,
+		[&](vk::CommandBuffer cb) {
+			vk::ClearColorValue black {};
+			vk::cmdClearColorImage(cb, image, vk::ImageLayout::transferDstOptimal,
+				black, {{vk::ImageAspectBits::color, 0, 2, 0, 1}});
+		});
+	graph.access(pass, all, {vk::PipelineStageBits::transfer,
+		vk::AccessBits::transferWrite, vk::ImageLayout::transferDstOptimal});
+
+	graph.compile(queue->properties().queueFlags);
+	graph.bind(all, image, view);
+
+	auto cmdBuffer = dev.commandProvider().get(queue->family());
+	vk::beginCommandBuffer(cmdBuffer, {});
+	graph.record(cmdBuffer);
+	vk::endCommandBuffer(cmdBuffer);
+	vpp::CommandWork<void>(std::move(cmdBuffer), *queue).finish();
+}
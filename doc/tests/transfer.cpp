@@ -0,0 +1,410 @@
+#include "init.hpp"
+#include "bugged.hpp"
+#include <vpp/buffer.hpp>
+#include <vpp/bufferOps.hpp>
+#include <vpp/image.hpp>
+#include <vpp/mipmaps.hpp>
+#include <vpp/ktx.hpp>
+#include <vpp/pixelConvert.hpp>
+#include <vpp/queue.hpp>
+#include <vpp/util/file.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace {
+
+vpp::Buffer createBuffer(vk::DeviceSize size, bool hostWrite)
+{
+	auto& dev = *globals.device;
+
+	vk::BufferCreateInfo info;
+	info.size = size;
+	info.usage = vk::BufferUsageBits::transferDst | vk::BufferUsageBits::transferSrc |
+		vk::BufferUsageBits::storageBuffer;
+
+	if(hostWrite) return {dev, info, vpp::MemoryUsage::hostWrite};
+	return {dev, info, dev.memoryTypeBits(vk::MemoryPropertyBits::deviceLocal)};
+}
+
+} // anonymous namespace
+
+TEST(direct_write) {
+	auto& dev = *globals.device;
+	auto buffer = createBuffer(1024, true);
+	buffer.assureMemory();
+
+	// the allocation uses one of the memory types preferred for host writes
+	auto reqs = vk::getBufferMemoryRequirements(dev, buffer);
+	auto preferred = dev.memoryTypeBits(vpp::MemoryUsage::hostWrite, reqs.memoryTypeBits);
+	auto type = buffer.memoryEntry().memory()->type();
+	EXPECT((preferred & (1u << type)) != 0, true);
+
+	// memory for host reads is always host visible and therefore mappable
+	vk::BufferCreateInfo info;
+	info.size = 1024;
+	info.usage = vk::BufferUsageBits::transferDst;
+	vpp::Buffer readBuffer(dev, info, vpp::MemoryUsage::hostRead);
+	readBuffer.assureMemory();
+	auto readType = readBuffer.memoryEntry().memory()->type();
+	auto readFlags = dev.memoryProperties().memoryTypes[readType].propertyFlags;
+	EXPECT((readFlags & vk::MemoryPropertyBits::hostVisible) != 0, true);
+	EXPECT(readBuffer.mappable(), true);
+
+	std::vector<std::uint8_t> data(1024);
+	for(auto i = 0u; i < data.size(); ++i) data[i] = i % 251;
+	vpp::write(buffer, data)->finish();
+
+	auto work = vpp::retrieve(buffer, 16, 256);
+	auto retrieved = work->data();
+	EXPECT(retrieved.size(), 256u);
+	EXPECT(std::equal(retrieved.begin(), retrieved.end(), data.begin() + 16), true);
+}
+
+// uploads in flight at the same time use different ranges of the staging buffers
+TEST(shared_staging) {
+	auto a = createBuffer(1024, false);
+	auto b = createBuffer(1024, false);
+
+	std::vector<std::uint8_t> dataA(1024, 0x11);
+	std::vector<std::uint8_t> dataB(1024, 0x22);
+	auto workA = vpp::write(a, dataA);
+	auto workB = vpp::write(b, dataB);
+	workA->finish();
+	workB->finish();
+
+	auto retrieveA = vpp::retrieve(a);
+	auto retrieveB = vpp::retrieve(b);
+	auto retrievedA = retrieveA->data();
+	auto retrievedB = retrieveB->data();
+	EXPECT(std::equal(retrievedA.begin(), retrievedA.end(), dataA.begin()), true);
+	EXPECT(std::equal(retrievedB.begin(), retrievedB.end(), dataB.begin()), true);
+}
+
+// uploads from and downloads into host memory imported as buffer
+TEST(import_host) {
+	auto phdev = globals.device->vkPhysicalDevice();
+	auto exts = vk::enumerateDeviceExtensionProperties(phdev, nullptr);
+	auto supported = std::any_of(exts.begin(), exts.end(), [](auto& ext) {
+		return std::strcmp(ext.extensionName.data(), "VK_EXT_external_memory_host") == 0;
+	});
+
+	if(!supported) {
+		std::cout << "VK_EXT_external_memory_host not supported, skipping\n";
+		return;
+	}
+
+	constexpr const char* extensions[] = {
+		"VK_KHR_external_memory",
+		"VK_EXT_external_memory_host"
+	};
+
+	vpp::Device dev(globals.instance, phdev, extensions);
+
+	// page aligned host memory (the usual minImportedHostPointerAlignment)
+	constexpr auto size = 64 * 1024;
+	constexpr auto alignment = 4096;
+	auto storage = std::make_unique<std::uint8_t[]>(size + alignment);
+	auto addr = reinterpret_cast<std::uintptr_t>(storage.get());
+	auto host = storage.get() + (alignment - addr % alignment) % alignment;
+	for(auto i = 0u; i < size; ++i) host[i] = i % 253;
+
+	vpp::DeviceMemory memory(dev, {host, size});
+
+	vk::BufferCreateInfo info;
+	info.size = size;
+	info.usage = vk::BufferUsageBits::transferSrc | vk::BufferUsageBits::transferDst;
+	vpp::Buffer imported(memory, info);
+	vpp::Buffer buffer(dev, info, dev.memoryTypeBits(vk::MemoryPropertyBits::deviceLocal));
+
+	vpp::write(buffer, imported)->finish();
+	std::fill(host, host + size, 0);
+	vpp::retrieve(buffer, imported)->finish();
+
+	auto equal = true;
+	for(auto i = 0u; i < size; ++i) equal &= (host[i] == i % 253);
+	EXPECT(equal, true);
+}
+
+// uploads and downloads all mip levels and layers of an image at once
+TEST(image_mips) {
+	auto& dev = *globals.device;
+	constexpr auto levels = 4u;
+	constexpr auto layers = 2u;
+
+	vk::ImageCreateInfo info;
+	info.imageType = vk::ImageType::e2d;
+	info.format = vk::Format::r8g8b8a8Unorm;
+	info.extent = {64, 32, 1};
+	info.mipLevels = levels;
+	info.arrayLayers = layers;
+	info.samples = vk::SampleCountBits::e1;
+	info.tiling = vk::ImageTiling::optimal;
+	info.usage = vk::ImageUsageBits::transferDst | vk::ImageUsageBits::transferSrc;
+	vpp::Image image(dev, info);
+
+	auto regions = vpp::mipRegions(info.format, info.extent,
+		vk::ImageAspectBits::color, levels, layers);
+	EXPECT(regions.size(), levels);
+	EXPECT(regions.back().imageExtent.width, 8u);
+
+	auto size = regions.back().bufferOffset + 8 * 4 * 4 * layers;
+	std::vector<std::uint8_t> data(size);
+	for(auto i = 0u; i < data.size(); ++i) data[i] = i % 241;
+
+	auto layout = vk::ImageLayout::undefined;
+	vpp::fill(image, data, info.format, layout, regions)->finish();
+	EXPECT(layout, vk::ImageLayout::transferDstOptimal);
+
+	auto retrieved = vpp::retrieve(image, layout, info.format, regions)->data();
+	EXPECT(retrieved.size(), data.size());
+	EXPECT(std::equal(retrieved.begin(), retrieved.end(), data.begin()), true);
+}
+
+// generates the mip levels of a filled image on the device
+TEST(generate_mips) {
+	auto& dev = *globals.device;
+	constexpr auto levels = 5u;
+
+	vk::ImageCreateInfo info;
+	info.imageType = vk::ImageType::e2d;
+	info.format = vk::Format::r8g8b8a8Unorm;
+	info.extent = {16, 16, 1};
+	info.mipLevels = levels;
+	info.arrayLayers = 1;
+	info.samples = vk::SampleCountBits::e1;
+	info.tiling = vk::ImageTiling::optimal;
+	info.usage = vk::ImageUsageBits::transferDst | vk::ImageUsageBits::transferSrc |
+		vk::ImageUsageBits::sampled | vk::ImageUsageBits::storage;
+	vpp::Image image(dev, info);
+
+	if(vpp::mipmapMethod(dev, info.format) == vpp::MipmapMethod::none) {
+		std::cout << "mipmap generation not supported, skipping\n";
+		return;
+	}
+
+	// uniformly colored, every level must have the same color
+	std::vector<std::uint8_t> data(16 * 16 * 4, 200);
+	auto layout = vk::ImageLayout::undefined;
+	vpp::fill(image, *data.data(), info.format, layout, info.extent,
+		{vk::ImageAspectBits::color, 0, 0})->finish();
+
+	vpp::generateMipmaps(image, info.format, info.extent, layout, levels)->finish();
+	EXPECT(layout, vk::ImageLayout::shaderReadOnlyOptimal);
+
+	auto texel = vpp::retrieve(image, layout, info.format, {1, 1, 1},
+		{vk::ImageAspectBits::color, levels - 1, 0})->data();
+	EXPECT(texel.size(), 4u);
+	EXPECT(unsigned(texel[0]), 200u);
+}
+
+// writes a small bc1 KTX2 file with two levels and uploads it
+TEST(ktx2) {
+	EXPECT(vpp::dataSize(vk::Format::bc1RgbaUnormBlock, {10, 6, 1}), 3u * 2u * 8u);
+	EXPECT(vpp::blockExtent(vk::Format::astc5x5UnormBlock, {11, 5, 1}).width, 3u);
+
+	auto put = [](std::vector<std::uint8_t>& buf, auto value) {
+		auto ptr = reinterpret_cast<const std::uint8_t*>(&value);
+		buf.insert(buf.end(), ptr, ptr + sizeof(value));
+	};
+
+	std::vector<std::uint8_t> file = {
+		0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+	};
+
+	// format, typeSize, width, height, depth, layers, faces, levels, supercompression
+	for(std::uint32_t v : {133u, 1u, 8u, 8u, 0u, 0u, 1u, 2u, 0u}) put(file, v);
+	for(std::uint32_t v : {0u, 0u, 0u, 0u}) put(file, v);
+	for(std::uint64_t v : {0u, 0u}) put(file, v);
+
+	// level index, smallest level stored first
+	auto dataStart = std::uint64_t(file.size() + 2 * 3 * 8);
+	for(std::uint64_t v : {dataStart + 8, std::uint64_t(32u), std::uint64_t(32u)}) put(file, v);
+	for(std::uint64_t v : {dataStart, std::uint64_t(8u), std::uint64_t(8u)}) put(file, v);
+	file.resize(file.size() + 8 + 32, 0x55);
+
+	vpp::writeFile("ktx2_test.ktx2", file);
+	auto info = vpp::readKtx2Info("ktx2_test.ktx2");
+	EXPECT(info.format, vk::Format::bc1RgbaUnormBlock);
+	EXPECT(info.levels, 2u);
+	EXPECT(info.layers, 1u);
+	EXPECT(info.levelData[1].size, 8u);
+
+	auto& dev = *globals.device;
+	auto props = vk::getPhysicalDeviceFormatProperties(dev.vkPhysicalDevice(), info.format);
+	if(!(props.optimalTilingFeatures & vk::FormatFeatureBits::sampledImage)) {
+		std::cout << "bc1 not supported, skipping upload\n";
+		std::remove("ktx2_test.ktx2");
+		return;
+	}
+
+	auto imgInfo = info.imageInfo();
+	imgInfo.usage |= vk::ImageUsageBits::transferSrc;
+	vpp::Image image(dev, imgInfo);
+
+	auto layout = vk::ImageLayout::undefined;
+	vpp::fillKtx2(image, "ktx2_test.ktx2", layout)->finish();
+	std::remove("ktx2_test.ktx2");
+
+	auto regions = vpp::mipRegions(info.format, info.extent, vk::ImageAspectBits::color, 2);
+	auto data = vpp::retrieve(image, layout, info.format, regions)->data();
+	EXPECT(data.size(), 40u);
+	EXPECT(std::all_of(data.begin(), data.end(), [](auto v) { return v == 0x55; }), true);
+}
+
+// fills an rgba image from rgb data and retrieves it as bgr data
+TEST(convert) {
+	std::uint8_t srgb[4] = {0, 128, 255, 128};
+	std::uint8_t linear[4];
+	vpp::convertPixels(vk::Format::r8g8b8a8Srgb, srgb, vk::Format::r8g8b8a8Unorm, linear, 1);
+	EXPECT(unsigned(linear[1]), 55u);
+	EXPECT(unsigned(linear[3]), 128u); // alpha is linear
+
+	auto& dev = *globals.device;
+	vk::ImageCreateInfo info;
+	info.imageType = vk::ImageType::e2d;
+	info.format = vk::Format::r8g8b8a8Unorm;
+	info.extent = {33, 7, 1};
+	info.mipLevels = 1;
+	info.arrayLayers = 1;
+	info.samples = vk::SampleCountBits::e1;
+	info.tiling = vk::ImageTiling::optimal;
+	info.usage = vk::ImageUsageBits::transferDst | vk::ImageUsageBits::transferSrc;
+	vpp::Image image(dev, info);
+
+	std::vector<std::uint8_t> rgb(33 * 7 * 3);
+	for(auto i = 0u; i < rgb.size(); ++i) rgb[i] = i % 239;
+
+	auto layout = vk::ImageLayout::undefined;
+	vpp::fill(image, *rgb.data(), info.format, layout, info.extent,
+		{vk::ImageAspectBits::color, 0, 0}, {}, true, vk::Format::r8g8b8Unorm)->finish();
+
+	auto work = vpp::retrieve(image, layout, info.format, info.extent,
+		{vk::ImageAspectBits::color, 0, 0}, {}, true, vk::Format::b8g8r8Unorm);
+	auto bgr = work->data();
+	EXPECT(bgr.size(), rgb.size());
+
+	auto equal = true;
+	for(auto i = 0u; i < rgb.size(); i += 3)
+		equal &= bgr[i] == rgb[i + 2] && bgr[i + 1] == rgb[i + 1] && bgr[i + 2] == rgb[i];
+	EXPECT(equal, true);
+}
+
+// the shuffled conversion of many pixels must match converting them one by one,
+// which never uses the SSSE3 path
+TEST(convert_shuffle) {
+	std::vector<std::uint8_t> src(37 * 4);
+	for(auto i = 0u; i < src.size(); ++i) src[i] = (i * 7) % 251;
+
+	const std::pair<vk::Format, vk::Format> pairs[] = {
+		{vk::Format::r8g8b8Unorm, vk::Format::b8g8r8a8Unorm},
+		{vk::Format::r8g8b8a8Unorm, vk::Format::b8g8r8Unorm},
+		{vk::Format::r8Unorm, vk::Format::r8g8b8a8Unorm},
+		{vk::Format::b8g8r8a8Srgb, vk::Format::r8g8b8a8Srgb},
+	};
+
+	for(auto [srcFormat, dstFormat] : pairs) {
+		auto srcSize = vpp::formatSize(srcFormat);
+		auto dstSize = vpp::formatSize(dstFormat);
+		auto count = src.size() / 4;
+
+		std::vector<std::uint8_t> batched(count * dstSize);
+		std::vector<std::uint8_t> single(count * dstSize);
+		vpp::convertPixels(srcFormat, src.data(), dstFormat, batched.data(), count);
+		for(auto i = 0u; i < count; ++i) {
+			vpp::convertPixels(srcFormat, src.data() + i * srcSize, dstFormat,
+				single.data() + i * dstSize, 1);
+		}
+
+		EXPECT(batched == single, true);
+	}
+
+	// unsupported but equal formats are copied
+	std::uint8_t blocks[16];
+	vpp::convertPixels(vk::Format::bc1RgbUnormBlock, src.data(),
+		vk::Format::bc1RgbUnormBlock, blocks, 2);
+	EXPECT(std::memcmp(blocks, src.data(), 16), 0);
+}
+
+// fills and retrieves an image with host transfer usage directly on the host
+TEST(host_image_copy) {
+	auto phdev = globals.device->vkPhysicalDevice();
+	auto exts = vk::enumerateDeviceExtensionProperties(phdev, nullptr);
+	auto supported = std::any_of(exts.begin(), exts.end(), [](auto& ext) {
+		return std::strcmp(ext.extensionName.data(), "VK_EXT_host_image_copy") == 0;
+	});
+
+	if(!supported) {
+		std::cout << "VK_EXT_host_image_copy not supported, skipping\n";
+		return;
+	}
+
+	// VkPhysicalDeviceHostImageCopyFeaturesEXT
+	struct HostImageCopyFeatures {
+		vk::StructureType sType {static_cast<vk::StructureType>(1000270000)};
+		void* pNext {};
+		vk::Bool32 hostImageCopy {true};
+	} features;
+
+	constexpr const char* extensions[] = {
+		"VK_KHR_copy_commands2",
+		"VK_KHR_format_feature_flags2",
+		"VK_EXT_host_image_copy"
+	};
+
+	auto family = globals.device->queue(vk::QueueBits::transfer)->family();
+	float priority = 0.f;
+	vk::DeviceQueueCreateInfo queueInfo({}, family, 1, &priority);
+	vk::DeviceCreateInfo devInfo;
+	devInfo.pNext = &features;
+	devInfo.queueCreateInfoCount = 1;
+	devInfo.pQueueCreateInfos = &queueInfo;
+	devInfo.enabledExtensionCount = sizeof(extensions) / sizeof(extensions[0]);
+	devInfo.ppEnabledExtensionNames = extensions;
+
+	constexpr auto hostTransfer = static_cast<vk::ImageUsageBits>(0x00400000u);
+	vk::ImageCreateInfo info;
+	info.imageType = vk::ImageType::e2d;
+	info.format = vk::Format::r8g8b8a8Unorm;
+	info.extent = {16, 16, 1};
+	info.mipLevels = 1;
+	info.arrayLayers = 1;
+	info.samples = vk::SampleCountBits::e1;
+	info.tiling = vk::ImageTiling::optimal;
+	info.usage = vk::ImageUsageBits::transferDst | vk::ImageUsageBits::transferSrc |
+		hostTransfer;
+
+	// the extension might need instance features (vulkan 1.1) the tests don't
+	// enable and not every format has to support host copies
+	std::unique_ptr<vpp::Device> dev;
+	try {
+		dev = std::make_unique<vpp::Device>(globals.instance, phdev, devInfo);
+		vk::getPhysicalDeviceImageFormatProperties(phdev, info.format, info.imageType,
+			info.tiling, info.usage, {});
+	} catch(const std::exception& err) {
+		std::cout << "host image copies not usable (" << err.what() << "), skipping\n";
+		return;
+	}
+
+	vpp::Image image(*dev, info);
+	EXPECT(image.hostTransfer(), true);
+
+	std::vector<std::uint8_t> data(16 * 16 * 4);
+	for(auto i = 0u; i < data.size(); ++i) data[i] = i % 241;
+
+	// the layout is transitioned to general by the host
+	auto layout = vk::ImageLayout::undefined;
+	vpp::fill(image, *data.data(), info.format, layout, info.extent,
+		{vk::ImageAspectBits::color, 0, 0})->finish();
+	EXPECT(layout, vk::ImageLayout::general);
+
+	auto work = vpp::retrieve(image, layout, info.format, info.extent,
+		{vk::ImageAspectBits::color, 0, 0});
+	auto retrieved = work->data();
+	EXPECT(retrieved.size(), data.size());
+	EXPECT(std::equal(retrieved.begin(), retrieved.end(), data.begin()), true);
+}
@@ -0,0 +1,361 @@
+#include "init.hpp"
+#include "bugged.hpp"
+#include <vpp/submit.hpp>
+#include <vpp/work.hpp>
+#include <vpp/buffer.hpp>
+#include <vpp/bufferOps.hpp>
+#include <vpp/queue.hpp>
+#include <vpp/commandBuffer.hpp>
+#include <vpp/completion.hpp>
+#include <vpp/vk.hpp>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// submissions to a queue get increasing values, completion of a
+// submission implies completion of all previous ones
+TEST(execution_state) {
+	auto& dev = *globals.device;
+	auto& submitter = dev.submitManager();
+	auto queue = dev.queue(vk::QueueBits::graphics);
+
+	auto record = [&]{
+		auto cmdBuffer = dev.commandProvider().get(queue->family());
+		vk::beginCommandBuffer(cmdBuffer, {});
+		vk::endCommandBuffer(cmdBuffer);
+		return cmdBuffer;
+	};
+
+	auto cb1 = record();
+	auto cb2 = record();
+
+	vpp::CommandExecutionState state1, state2;
+	submitter.add(*queue, {cb1}, &state1);
+	EXPECT(state1.submitted(), false);
+	submitter.submit(*queue);
+	EXPECT(state1.submitted(), true);
+
+	submitter.add(*queue, {cb2}, &state2);
+
+	// moving a state that is not yet submitted
+	auto moved = std::move(state2);
+	EXPECT(state2.valid(), false);
+	EXPECT(moved.wait(), true);
+	EXPECT(moved.value() > state1.value(), true);
+	EXPECT(state1.completed(), true);
+	EXPECT(submitter.completed(*queue, false) >= moved.value(), true);
+	EXPECT(bool(submitter.semaphore(*queue)), submitter.timelineSemaphores());
+}
+
+// submitting a work submits the work it depends on
+TEST(dependency) {
+	auto& dev = *globals.device;
+	auto queue = dev.queue(vk::QueueBits::graphics);
+
+	vk::BufferCreateInfo info;
+	info.size = 256;
+	info.usage = vk::BufferUsageBits::transferDst | vk::BufferUsageBits::transferSrc;
+	vpp::Buffer src(dev, info);
+	vpp::Buffer dst(dev, info);
+	src.assureMemory();
+	dst.assureMemory();
+
+	auto fillCb = dev.commandProvider().get(queue->family());
+	vk::beginCommandBuffer(fillCb, {});
+	vk::cmdFillBuffer(fillCb, src, 0, 256, 0x42424242u);
+	vk::endCommandBuffer(fillCb);
+
+	// the barrier makes the copy wait for the fill in submission order
+	auto copyCb = dev.commandProvider().get(queue->family());
+	vk::beginCommandBuffer(copyCb, {});
+	vk::MemoryBarrier barrier;
+	barrier.srcAccessMask = vk::AccessBits::transferWrite;
+	barrier.dstAccessMask = vk::AccessBits::transferRead;
+	vk::cmdPipelineBarrier(copyCb, vk::PipelineStageBits::transfer,
+		vk::PipelineStageBits::transfer, {}, {barrier}, {}, {});
+	vk::cmdCopyBuffer(copyCb, src, dst, {{0, 0, 256}});
+	vk::endCommandBuffer(copyCb);
+
+	// added in reverse order, the dependency reorders them
+	vpp::CommandWork<void> copy(std::move(copyCb), *queue);
+	vpp::CommandWork<void> fill(std::move(fillCb), *queue);
+	copy.dependsOn(fill, vk::PipelineStageBits::transfer);
+
+	copy.submit();
+	EXPECT(fill.submitted(), true);
+	copy.finish();
+
+	auto data = vpp::retrieve(dst, 0, 4)->data();
+	EXPECT(data.size(), 4u);
+	EXPECT(data[0], 0x42u);
+}
+
+// reordering for a dependency keeps the submissions depending on the state after it
+TEST(same_queue_reorder) {
+	auto& dev = *globals.device;
+	auto& submitter = dev.submitManager();
+	auto queue = dev.queue(vk::QueueBits::graphics);
+
+	auto record = [&]{
+		auto cmdBuffer = dev.commandProvider().get(queue->family());
+		vk::beginCommandBuffer(cmdBuffer, {});
+		vk::endCommandBuffer(cmdBuffer);
+		return cmdBuffer;
+	};
+
+	auto cbA = record();
+	auto cbX = record();
+	auto cbD = record();
+
+	vpp::CommandExecutionState a, x, d;
+	submitter.add(*queue, {cbA}, &a);
+	submitter.add(*queue, {cbX}, &x);
+	submitter.add(*queue, {cbD}, &d);
+	x.dependsOn(a);
+	a.dependsOn(d);
+
+	// must be ordered d, a, x
+	a.submit();
+	EXPECT(d.submitted(), true);
+	EXPECT(x.submitted(), false);
+
+	// dependencies between pending submissions must not form a cycle
+	auto cbY = record();
+	vpp::CommandExecutionState y;
+	submitter.add(*queue, {cbY}, &y);
+	y.dependsOn(x);
+	ERROR(x.dependsOn(y), std::logic_error);
+
+	EXPECT(y.wait(), true);
+	EXPECT(x.completed(), true);
+}
+
+// continuations are called once the work was executed
+TEST(completion) {
+	auto& dev = *globals.device;
+	auto queue = dev.queue(vk::QueueBits::graphics);
+	auto& service = dev.completionService();
+
+	std::vector<std::unique_ptr<vpp::CommandWork<void>>> works;
+	std::atomic<unsigned int> called {0u};
+	for(auto i = 0u; i < 8; ++i) {
+		auto cmdBuffer = dev.commandProvider().get(queue->family());
+		vk::beginCommandBuffer(cmdBuffer, {});
+		vk::endCommandBuffer(cmdBuffer);
+		works.push_back(std::make_unique<vpp::CommandWork<void>>(std::move(cmdBuffer), *queue));
+		service.then(*works.back(), [&]{ ++called; });
+	}
+
+	service.wait();
+	EXPECT(service.pending(), 0u);
+	EXPECT(called.load(), 8u);
+	for(auto& work : works) {
+		EXPECT(work->executed(), true);
+	}
+}
+
+// waits for all work at once and finishes completed work out of order
+TEST(work_manager) {
+	auto& dev = *globals.device;
+	auto queue = dev.queue(vk::QueueBits::graphics);
+
+	vpp::WorkManager manager;
+	for(auto i = 0u; i < 8; ++i) {
+		auto cmdBuffer = dev.commandProvider().get(queue->family());
+		vk::beginCommandBuffer(cmdBuffer, {});
+		vk::endCommandBuffer(cmdBuffer);
+		manager.add(std::make_unique<vpp::CommandWork<void>>(std::move(cmdBuffer), *queue));
+	}
+
+	// empty entries are never added
+	std::vector<std::unique_ptr<vpp::WorkBase>> works;
+	works.push_back(nullptr);
+	works.push_back(std::make_unique<vpp::FinishedWork<void>>());
+	works.push_back(nullptr);
+	manager.add(std::move(works));
+	EXPECT(manager.size(), 9u);
+
+	EXPECT(manager.wait(false), true);
+	EXPECT(manager.wait(true), true);
+	EXPECT(manager.poll(), 9u);
+	EXPECT(manager.size(), 0u);
+}
+
+// submissions added from multiple threads are submitted by the submission thread
+TEST(submission_thread) {
+	auto& dev = *globals.device;
+	auto& submitter = dev.submitManager();
+	auto queue = dev.queue(vk::QueueBits::graphics);
+
+	std::vector<vpp::CommandBuffer> cmdBuffers;
+	for(auto i = 0u; i < 8; ++i) {
+		cmdBuffers.push_back(dev.commandProvider().get(queue->family()));
+		vk::beginCommandBuffer(cmdBuffers.back(), {});
+		vk::endCommandBuffer(cmdBuffers.back());
+	}
+
+	submitter.startThread();
+	EXPECT(submitter.threaded(), true);
+
+	std::vector<vpp::CommandExecutionState> states(cmdBuffers.size());
+	std::vector<std::thread> threads;
+	for(auto i = 0u; i < cmdBuffers.size(); ++i) {
+		threads.emplace_back([&, i]{
+			submitter.add(*queue, {cmdBuffers[i].vkHandle()}, &states[i]);
+		});
+	}
+
+	for(auto& thread : threads) {
+		thread.join();
+	}
+
+	for(auto& state : states) {
+		while(!state.submitted()) {
+			std::this_thread::yield();
+		}
+	}
+
+	submitter.stopThread();
+	EXPECT(submitter.threaded(), false);
+
+	std::vector<vpp::CommandExecutionState*> pointers;
+	for(auto& state : states) {
+		pointers.push_back(&state);
+	}
+
+	EXPECT(submitter.wait(pointers), true);
+}
+
+// pending submissions are submitted automatically once the policy is met
+TEST(flush_policy) {
+	auto& dev = *globals.device;
+	auto& submitter = dev.submitManager();
+	auto queue = dev.queue(vk::QueueBits::graphics);
+
+	std::vector<vpp::CommandBuffer> cmdBuffers;
+	for(auto i = 0u; i < 5; ++i) {
+		cmdBuffers.push_back(dev.commandProvider().get(queue->family()));
+		vk::beginCommandBuffer(cmdBuffers.back(), {});
+		vk::endCommandBuffer(cmdBuffers.back());
+	}
+
+	auto previous = submitter.flushPolicy(*queue);
+	vpp::SubmitManager::FlushPolicy policy;
+	policy.commandBuffers = 2;
+	submitter.flushPolicy(*queue, policy);
+	EXPECT(submitter.flushPolicy(*queue).commandBuffers, 2u);
+
+	vpp::CommandExecutionState states[5];
+	submitter.add(*queue, {cmdBuffers[0].vkHandle()}, &states[0]);
+	EXPECT(states[0].submitted(), false);
+	submitter.add(*queue, {cmdBuffers[1].vkHandle()}, &states[1]);
+	EXPECT(states[0].submitted(), true);
+	EXPECT(states[1].submitted(), true);
+
+	// explicit frame boundary
+	submitter.add(*queue, {cmdBuffers[2].vkHandle()}, &states[2]);
+	EXPECT(states[2].submitted(), false);
+	submitter.endFrame();
+	EXPECT(states[2].submitted(), true);
+
+	// age, checked when adding without submission thread
+	policy.commandBuffers = 0;
+	policy.age = std::chrono::microseconds(100);
+	submitter.flushPolicy(*queue, policy);
+	submitter.add(*queue, {cmdBuffers[3].vkHandle()}, &states[3]);
+	std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	submitter.add(*queue, {cmdBuffers[4].vkHandle()}, &states[4]);
+	EXPECT(states[3].submitted(), true);
+	EXPECT(states[4].submitted(), true);
+
+	submitter.flushPolicy(*queue, previous);
+	for(auto& state : states) {
+		EXPECT(state.wait(), true);
+	}
+}
+
+// pending states can be moved while the submission thread submits them
+TEST(move_threaded) {
+	auto& dev = *globals.device;
+	auto& submitter = dev.submitManager();
+	auto queue = dev.queue(vk::QueueBits::graphics);
+
+	auto cmdBuffer = dev.commandProvider().get(queue->family());
+	vk::beginCommandBuffer(cmdBuffer, {});
+	vk::endCommandBuffer(cmdBuffer);
+
+	submitter.startThread(std::chrono::microseconds(1));
+	for(auto i = 0u; i < 64; ++i) {
+		vpp::CommandExecutionState state;
+		submitter.add(*queue, {cmdBuffer.vkHandle()}, &state);
+
+		auto moved = std::move(state);
+		vpp::CommandExecutionState assigned;
+		assigned = std::move(moved);
+		EXPECT(state.valid(), false);
+		EXPECT(moved.valid(), false);
+		EXPECT(assigned.wait(), true);
+		EXPECT(assigned.value() != 0u, true);
+	}
+
+	submitter.stopThread();
+}
+
+// dependencies between two queues in both directions, a -> b -> a
+TEST(cross_queue_dependency) {
+	auto phdev = globals.device->vkPhysicalDevice();
+	auto families = vk::getPhysicalDeviceQueueFamilyProperties(phdev);
+	auto family = -1;
+	for(auto i = 0u; i < families.size(); ++i) {
+		if(families[i].queueCount >= 2) {
+			family = i;
+			break;
+		}
+	}
+
+	if(family == -1) {
+		std::cout << "no queue family with two queues, skipping\n";
+		return;
+	}
+
+	float priorities[2] = {0.f, 0.f};
+	vk::DeviceQueueCreateInfo queueInfo({}, family, 2, priorities);
+	vk::DeviceCreateInfo devInfo;
+	devInfo.queueCreateInfoCount = 1;
+	devInfo.pQueueCreateInfos = &queueInfo;
+	vpp::Device dev(globals.instance, phdev, devInfo);
+
+	auto queues = dev.queues();
+	EXPECT(queues.size(), 2u);
+	auto& a = *queues[0];
+	auto& b = *queues[1];
+
+	auto record = [&]{
+		auto cmdBuffer = dev.commandProvider().get(family);
+		vk::beginCommandBuffer(cmdBuffer, {});
+		vk::endCommandBuffer(cmdBuffer);
+		return cmdBuffer;
+	};
+
+	vpp::CommandWork<void> a1(record(), a);
+	vpp::CommandWork<void> a2(record(), a);
+	vpp::CommandWork<void> b1(record(), b);
+	b1.dependsOn(a1);
+	a2.dependsOn(b1);
+
+	// must only submit a1 before b1, not the whole lane of a
+	a2.submit();
+	EXPECT(a1.submitted(), true);
+	EXPECT(b1.submitted(), true);
+	EXPECT(a2.submitted(), true);
+	EXPECT(a1.commandState()->value() < a2.commandState()->value(), true);
+
+	a2.finish();
+	EXPECT(a1.executed(), true);
+	EXPECT(b1.executed(), true);
+	a1.finish();
+	b1.finish();
+}
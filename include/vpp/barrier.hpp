@@ -0,0 +1,303 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <vpp/fwd.hpp>
+#include <vpp/resource.hpp> // vpp::Resource
+#include <vpp/sync.hpp> // vpp::Event
+#include <vpp/vulkan/enums.hpp> // vk::PipelineStageFlags, vk::AccessFlags
+#include <vpp/vulkan/structs.hpp> // vk::ImageSubresourceRange
+#include <vpp/util/span.hpp> // nytl::Span
+
+#include <optional> // std::optional
+#include <vector> // std::vector
+
+namespace vpp {
+
+/// Describes how a resource is accessed on the device: in which pipeline stages,
+/// with which memory access types and (only relevant for images) in which layout.
+struct Access {
+	vk::PipelineStageFlags stages {};
+	vk::AccessFlags access {};
+	vk::ImageLayout layout {vk::ImageLayout::undefined};
+};
+
+/// All queue capabilities, i.e. no pipeline stage is filtered out.
+constexpr auto allQueueBits = vk::QueueBits::graphics | vk::QueueBits::compute |
+	vk::QueueBits::transfer;
+
+/// All access types that write memory.
+constexpr auto writeAccessBits = vk::AccessBits::shaderWrite |
+	vk::AccessBits::colorAttachmentWrite | vk::AccessBits::depthStencilAttachmentWrite |
+	vk::AccessBits::transferWrite | vk::AccessBits::hostWrite |
+	vk::AccessBits::memoryWrite | vk::AccessBits::commandProcessWriteNVX;
+
+/// Returns whether the given access flags contain any write access.
+inline bool writes(vk::AccessFlags access) { return (access & writeAccessBits) != 0; }
+
+/// Removes the stages not supported by a queue family with the given capabilities.
+/// Returns allCommands if no stage would be left but some were given.
+vk::PipelineStageFlags supportedStages(vk::PipelineStageFlags, vk::QueueFlags);
+
+/// Returns the stages and access types of the typical usage of an image in the
+/// given layout, e.g. {transfer, transferWrite} for transferDstOptimal.
+/// Meant for transitions for which nothing more exact is known.
+/// The stages are restricted to the ones supported by the given queue capabilities
+/// and the access types to the ones the remaining stages can perform.
+Access layoutAccess(vk::ImageLayout, vk::QueueFlags = allQueueBits);
+
+/// The tracked state of an image subresource, used to derive the barriers
+/// needed before following accesses.
+struct AccessState {
+	Access access; // merged accesses since the last write
+	vk::PipelineStageFlags writeStages {}; // of the last write or transition
+	vk::AccessFlags writeAccess {}; // of the last write
+};
+
+/// Returns the state of a resource that was last accessed as described.
+inline AccessState accessState(const Access& access)
+{
+	return {access, writes(access.access) ? access.stages : vk::PipelineStageFlags {},
+		access.access & writeAccessBits};
+}
+
+/// A barrier derived by accessBarrier. If memory is false, an execution
+/// dependency between the stages is enough and the remaining members are unused.
+struct AccessBarrier {
+	vk::PipelineStageFlags srcStages {};
+	vk::PipelineStageFlags dstStages {};
+	vk::AccessFlags srcAccess {};
+	vk::AccessFlags dstAccess {};
+	vk::ImageLayout oldLayout {vk::ImageLayout::undefined};
+	vk::ImageLayout newLayout {vk::ImageLayout::undefined};
+	bool memory {};
+};
+
+/// Returns the barrier needed before an image subresource in the given state
+/// can be accessed as described, if any, and updates the state.
+/// Reads in the same layout only need a barrier when the last write was not
+/// made visible to their stages or access types yet, write-after-read
+/// hazards only need an execution dependency.
+/// The layout of the given access must not be undefined or preinitialized.
+std::optional<AccessBarrier> accessBarrier(AccessState&, const Access&);
+
+/// Accumulates pipeline barriers and records them as one vkCmdPipelineBarrier.
+/// The stage masks of all added barriers are merged, image barriers for adjacent
+/// or overlapping subresources of the same image with the same layouts and access
+/// masks are combined into one. Pending barriers are recorded by flush, record (which should
+/// be used to retrieve the command buffer for every following command) or
+/// the destructor, so they must not be outlived by the recording state of
+/// the command buffer.
+/// Since the merged stage masks are applied to all barriers, only barriers
+/// that are needed at the same point of the command buffer should be batched.
+class BarrierBatch {
+public:
+	BarrierBatch() = default;
+	BarrierBatch(vk::CommandBuffer);
+	~BarrierBatch();
+
+	BarrierBatch(BarrierBatch&& rhs) noexcept { swap(*this, rhs); }
+	BarrierBatch& operator=(BarrierBatch rhs) noexcept { swap(*this, rhs); return *this; }
+
+	/// Adds a barrier to the batch.
+	void barrier(vk::PipelineStageFlags src, vk::PipelineStageFlags dst,
+		const vk::ImageMemoryBarrier&);
+	void barrier(vk::PipelineStageFlags src, vk::PipelineStageFlags dst,
+		const vk::BufferMemoryBarrier&);
+	void barrier(vk::PipelineStageFlags src, vk::PipelineStageFlags dst,
+		const vk::MemoryBarrier&);
+
+	/// Adds an execution dependency without memory barrier to the batch.
+	void barrier(vk::PipelineStageFlags src, vk::PipelineStageFlags dst);
+
+	/// Adds a barrier derived by accessBarrier for the given image subresources.
+	void barrier(const AccessBarrier&, vk::Image, const vk::ImageSubresourceRange&);
+
+	/// Records all pending barriers. Has no effect if there are none.
+	void flush();
+
+	/// Records all pending barriers and returns the command buffer.
+	/// Meant to be used for recording the next command, e.g.
+	/// `vk::cmdDispatch(batch.record(), 1, 1, 1);`
+	vk::CommandBuffer record() { flush(); return cmdBuffer_; }
+
+	/// Returns whether no barrier is pending.
+	bool empty() const { return !srcStages_; }
+
+	vk::CommandBuffer commandBuffer() const { return cmdBuffer_; }
+	vk::PipelineStageFlags srcStages() const { return srcStages_; }
+	vk::PipelineStageFlags dstStages() const { return dstStages_; }
+
+	friend void swap(BarrierBatch& a, BarrierBatch& b) noexcept;
+
+protected:
+	bool merge(vk::ImageMemoryBarrier& a, const vk::ImageMemoryBarrier& b);
+
+protected:
+	vk::CommandBuffer cmdBuffer_ {};
+	vk::PipelineStageFlags srcStages_ {};
+	vk::PipelineStageFlags dstStages_ {};
+	std::vector<vk::MemoryBarrier> memory_;
+	std::vector<vk::BufferMemoryBarrier> buffer_;
+	std::vector<vk::ImageMemoryBarrier> image_;
+};
+
+/// Pool of reusable events for split barriers.
+/// The pool is not synchronized in any way.
+class EventPool : public Resource {
+public:
+	EventPool() = default;
+	EventPool(const Device& dev) : Resource(dev) {}
+
+	EventPool(EventPool&& rhs) noexcept { swap(*this, rhs); }
+	EventPool& operator=(EventPool rhs) noexcept { swap(*this, rhs); return *this; }
+
+	/// Returns an unsignaled event. Creates a new one if the pool is empty.
+	Event get();
+
+	/// Returns the given event to the pool. It must be unsignaled, i.e. not
+	/// signaled at all or reset by commands that completed execution.
+	void recycle(Event);
+
+	/// Returns the number of available events.
+	std::size_t size() const { return events_.size(); }
+
+	friend void swap(EventPool& a, EventPool& b) noexcept;
+
+protected:
+	std::vector<Event> events_;
+};
+
+/// A pipeline barrier split into two halves: signal is recorded directly after
+/// the producing commands, wait directly before the consuming commands.
+/// Commands recorded in between can execute while the producing commands
+/// are still running instead of being serialized by a full pipeline barrier.
+/// Both halves must be recorded into command buffers of the same queue and
+/// wait must be executed after signal. wait resets the event again so that
+/// the commands can be executed multiple times, e.g. in a prerecorded command buffer.
+/// The SplitBarrier must not be destroyed while the commands are pending
+/// since the event is returned to the pool on destruction.
+class SplitBarrier {
+public:
+	SplitBarrier() = default;
+
+	/// Takes an event from the given pool that is returned on destruction.
+	SplitBarrier(EventPool&);
+	~SplitBarrier();
+
+	SplitBarrier(SplitBarrier&& rhs) noexcept { swap(*this, rhs); }
+	SplitBarrier& operator=(SplitBarrier rhs) noexcept { swap(*this, rhs); return *this; }
+
+	/// Records the signal of the event into the given command buffer (vkCmdSetEvent).
+	/// The event is signaled once all previous commands completed the given stages.
+	void signal(vk::CommandBuffer, vk::PipelineStageFlags srcStages);
+
+	/// Records the wait for the event into the given command buffer (vkCmdWaitEvents).
+	/// The given stages of the following commands will wait for the
+	/// event and the given memory barriers, whose source scope are the stages
+	/// given to signal. Afterwards records the reset of the event.
+	/// Must only be called after signal.
+	void wait(vk::CommandBuffer, vk::PipelineStageFlags dstStages,
+		nytl::Span<const vk::MemoryBarrier> = {},
+		nytl::Span<const vk::BufferMemoryBarrier> = {},
+		nytl::Span<const vk::ImageMemoryBarrier> = {});
+
+	const Event& event() const { return event_; }
+	vk::PipelineStageFlags srcStages() const { return srcStages_; }
+
+	friend void swap(SplitBarrier& a, SplitBarrier& b) noexcept;
+
+protected:
+	EventPool* pool_ {};
+	Event event_;
+	vk::PipelineStageFlags srcStages_ {};
+};
+
+/// Tracks the layout and last access of image subresources and buffer ranges
+/// in one command buffer (or in multiple command buffers executed in the
+/// recorded order) and records only the barriers really needed between them.
+/// Reads of the same data in the same layout only need a barrier if they
+/// happen in stages or with access types the last write (or layout transition)
+/// was not yet made visible to, write-after-read hazards only need
+/// an execution dependency and layout
+/// transitions are only done when the tracked layout differs.
+/// Image state is tracked per mip level and array layer, the aspects of
+/// a range are treated as one. Resources that were not tracked before are
+/// treated as unused with undefined layout, i.e. their contents are discarded on
+/// the first layout transition. Use set if this is not the case.
+/// Only buffer ranges explicitly accessed or set are tracked.
+/// The tracker does not handle queue family ownership transfers.
+class AccessTracker {
+public:
+	AccessTracker() = default;
+
+	/// Sets the known state of the given image subresources without recording
+	/// anything, e.g. the state an image has before the command buffer is executed.
+	void set(vk::Image, const vk::ImageSubresourceRange&, const Access&);
+
+	/// Sets the known state of the given buffer range without recording anything.
+	void set(vk::Buffer, vk::DeviceSize offset, vk::DeviceSize size, const Access&);
+
+	/// Adds the barrier needed before the given image subresources can be
+	/// accessed as described, if any, to the given batch and updates the tracked state.
+	/// The layout of the given access must not be undefined or preinitialized.
+	/// Returns whether a barrier was added.
+	bool access(BarrierBatch&, vk::Image, const vk::ImageSubresourceRange&,
+		const Access&);
+
+	/// Adds the barrier needed before the given buffer range can be
+	/// accessed as described, if any, to the given batch and updates the tracked state.
+	/// Returns whether a barrier was added.
+	bool access(BarrierBatch&, vk::Buffer, vk::DeviceSize offset,
+		vk::DeviceSize size, const Access&);
+
+	/// Like the overloads above but records the barrier directly.
+	bool access(vk::CommandBuffer, vk::Image, const vk::ImageSubresourceRange&,
+		const Access&);
+	bool access(vk::CommandBuffer, vk::Buffer, vk::DeviceSize offset,
+		vk::DeviceSize size, const Access&);
+
+	/// Returns the tracked state of the given image subresource.
+	Access state(vk::Image, unsigned int level, unsigned int layer) const;
+
+	/// Stops tracking the given resource, e.g. when it is destroyed.
+	void forget(vk::Image);
+	void forget(vk::Buffer);
+
+	/// Stops tracking all resources.
+	void clear();
+
+protected:
+	using State = AccessState;
+
+	struct ImageState {
+		vk::Image image {};
+		unsigned int levels {};
+		unsigned int layers {};
+		std::vector<State> subresources; // level-major
+	};
+
+	struct BufferRange {
+		vk::DeviceSize offset;
+		vk::DeviceSize end;
+		State state;
+	};
+
+	struct BufferState {
+		vk::Buffer buffer {};
+		std::vector<BufferRange> ranges; // sorted, not overlapping
+	};
+
+	ImageState& image(vk::Image, const vk::ImageSubresourceRange&);
+	BufferState& buffer(vk::Buffer);
+	void replace(BufferState&, vk::DeviceSize offset, vk::DeviceSize end, const State&);
+	void merge(BufferState&, vk::DeviceSize offset, vk::DeviceSize end, const Access&);
+
+protected:
+	std::vector<ImageState> images_;
+	std::vector<BufferState> buffers_;
+};
+
+} // namespace vpp
@@ -313,8 +313,208 @@ struct BufferApplier<VT, ShaderType::none> {
 	}
 };
 
+/// Layout of one member of an interleaved structure on the buffer.
+struct InterleaveMember {
+	unsigned int offset; // offset of the member in the structure
+	unsigned int size; // size of one member value (host and buffer)
+};
+
+/// Interleaves the given tightly packed member arrays into count structures
+/// with the given stride at dst. Padding bytes between members are zeroed.
+/// The members must be sorted by offset. Implemented in bufferOps.cpp.
+void interleave(uint8_t* dst, std::size_t stride, std::size_t count,
+	nytl::Span<const InterleaveMember> members, nytl::Span<const uint8_t* const> src);
+
+/// Reverse operation of interleave. Writes the members of count structures
+/// with the given stride at src into the given tightly packed member arrays.
+void deinterleave(const uint8_t* src, std::size_t stride, std::size_t count,
+	nytl::Span<const InterleaveMember> members, nytl::Span<uint8_t* const> dst);
+
+/// Custom VulkanType implementation for Interleaved.
+/// Computes the layout of the structure once and then forwards the interleaving
+/// of all structures to the implementation in bufferOps.cpp which writes directly into
+/// the range returned by BufferUpdate::operateRange (or reads from
+/// BufferReader::operateRange).
+template<typename T, typename... M>
+struct InterleavedImpl {
+	using VT = VulkanType<T>;
+	using Obj = Interleaved<T, M...>;
+	using Members = std::array<InterleaveMember, sizeof...(M)>;
+
+	static_assert(VT::type == ShaderType::structure, "Interleaved requires a structure type");
+	static_assert(VT::align, "Interleaved requires an aligned structure type");
+	static_assert(sizeof...(M) == std::tuple_size<decltype(VT::members)>::value,
+		"Interleaved requires one span per structure member");
+
+	template<std::size_t... I>
+	static constexpr bool validMembers(std::index_sequence<I...>)
+	{
+		return (std::is_same<std::remove_cv_t<M>,
+			typename decltype(memPtr(std::get<I>(VT::members)))::type>::value && ...);
+	}
+
+	static_assert(validMembers(std::index_sequence_for<M...>{}),
+		"Interleaved span types must match the structure member types");
+	static_assert(((VulkanType<M>::type == ShaderType::scalar ||
+		VulkanType<M>::type == ShaderType::vec) && ...),
+		"Interleaved only supports scalar and vector members");
+	static_assert(((sizeof(M) == neededBufferSize<M>(BufferLayout::std430)) && ...),
+		"Interleaved members must have the same host and buffer size");
+
+	/// Computes the offsets of all members in the structure and returns the stride
+	/// of the structures in an array.
+	static std::size_t layout(bool std140, Members& members)
+	{
+		auto offset = 0u;
+		auto i = 0u;
+		for(auto [a, size] : {std::pair<unsigned int, unsigned int>{
+				bufferAlign<VulkanType<M>, M>(std140),
+				neededBufferSize<M>(BufferLayout::std430)}...}) {
+			offset = vpp::align(offset, a);
+			members[i++] = {offset, size};
+			offset += size;
+		}
+
+		return vpp::align(offset, align<T>(std140));
+	}
+
+	template<typename O>
+	static void call(O& op, const Obj& obj)
+	{
+		Members members;
+		auto stride = layout(op.std140(), members);
+		auto count = std::get<0>(obj.members).size();
+		auto src = std::apply([](auto&... spans) {
+			return std::array<const uint8_t*, sizeof...(M)>{{
+				reinterpret_cast<const uint8_t*>(spans.data())...}};
+		}, obj.members);
+
+		auto sa = align<T>(op.std140());
+		op.align(sa);
+		if(count) interleave(op.operateRange(count * stride), stride, count, members, src);
+		op.nextOffsetAlign(sa);
+	}
+
+	static void call(BufferReader& op, const Obj& obj)
+	{
+		static_assert(!(std::is_const<M>::value || ...),
+			"Interleaved must reference non-const containers to be read");
+
+		Members members;
+		auto stride = layout(op.std140(), members);
+		auto count = std::get<0>(obj.members).size();
+		auto dst = std::apply([](auto&... spans) {
+			return std::array<uint8_t*, sizeof...(M)>{{
+				reinterpret_cast<uint8_t*>(spans.data())...}};
+		}, obj.members);
+
+		auto sa = align<T>(op.std140());
+		op.align(sa);
+		if(count) deinterleave(op.operateRange(count * stride), stride, count, members, dst);
+		op.nextOffsetAlign(sa);
+	}
+
+	static void call(BufferSizer& op, const Obj& obj)
+	{
+		Members members;
+		auto stride = layout(op.std140(), members);
+		auto sa = align<T>(op.std140());
+		op.align(sa);
+		op.operate(nullptr, std::get<0>(obj.members).size() * stride);
+		op.nextOffsetAlign(sa);
+	}
+
+	template<typename>
+	static constexpr unsigned int align(bool std140)
+	{
+		return MembersOp<VT>::align(std140);
+	}
+};
+
+/// Expression that checks if all given types have a static size on a buffer.
+template<typename... T>
+constexpr bool staticSized = (nytl::validExpression<HasSizeFunction,
+	BufferApplier<VulkanType<T>>, BufferSizer> && ...);
+
+/// Returns the capacity needed to push the given types as push constants.
+/// Always a multiple of 4 since the push constant size must be.
+template<std::size_t MaxSize, typename... T>
+constexpr std::size_t pushConstantsCapacity()
+{
+	static_assert(MaxSize % 4 == 0, "The push constant size must be a multiple of 4");
+	if constexpr(staticSized<T...>) {
+		constexpr auto size = vpp::align(neededBufferSize<T...>(BufferLayout::std430), 4u);
+		static_assert(size <= MaxSize, "Push constant data exceeds the maximum size");
+		return size;
+	} else {
+		return MaxSize;
+	}
+}
+
+/// Records the cmdPushConstants command. Implemented in bufferOps.cpp.
+void cmdPushConstants(vk::CommandBuffer, vk::PipelineLayout, vk::ShaderStageFlags,
+	std::uint32_t offset, nytl::Span<const uint8_t> data);
+
 } //namespace detail
 
+template<std::size_t C>
+uint8_t* InlineBufferUpdate<C>::operateRange(std::size_t size)
+{
+	auto start = std::max(this->offset_, this->nextOffset_);
+	if(start + size > C) throw std::out_of_range("vpp::InlineBufferUpdate: capacity exceeded");
+
+	this->offset_ = start + size;
+	return data_.data() + start;
+}
+
+template<std::size_t C>
+void InlineBufferUpdate<C>::operate(const void* ptr, std::size_t size)
+{
+	std::memcpy(operateRange(size), ptr, size);
+}
+
+template<std::size_t C>
+void InlineBufferUpdate<C>::align(std::size_t align, bool)
+{
+	auto aligned = vpp::align(this->offset_, align);
+	if(aligned > C) throw std::out_of_range("vpp::InlineBufferUpdate: capacity exceeded");
+	this->offset_ = aligned;
+}
+
+template<std::size_t MaxSize, typename... T>
+void cmdPushConstants(vk::CommandBuffer cmdBuf, vk::PipelineLayout layout,
+	vk::ShaderStageFlags stages, std::uint32_t offset, const T&... objs)
+{
+	InlineBufferUpdate<detail::pushConstantsCapacity<MaxSize, T...>()> update;
+	update.add(objs...);
+
+	// the capacity only bounds the size, the range starts at offset
+	if(offset + vpp::align(update.data().size(), 4u) > MaxSize) {
+		throw std::out_of_range("vpp::cmdPushConstants: offset + size exceeds MaxSize");
+	}
+
+	detail::cmdPushConstants(cmdBuf, layout, stages, offset, update.data());
+}
+
+template<typename T, typename... M>
+struct VulkanType<Interleaved<T, M...>> {
+	static constexpr auto type = ShaderType::custom;
+	using impl = detail::InterleavedImpl<T, M...>;
+};
+
+template<typename T, typename... C>
+auto interleave(C&... containers)
+	-> Interleaved<T, std::remove_reference_t<decltype(*containers.data())>...>
+{
+	auto sizes = {std::size_t(containers.size())...};
+	for(auto size : sizes)
+		if(size != *sizes.begin())
+			throw std::logic_error("vpp::interleave: containers have different sizes");
+
+	return {std::make_tuple(nytl::Span<std::remove_reference_t<decltype(*containers.data())>>(
+		containers.data(), containers.size())...)};
+}
+
 template<typename B> template<typename T>
 void BufferOperator<B>::addSingle(T&& obj)
 {
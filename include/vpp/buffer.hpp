@@ -18,8 +18,21 @@ class Buffer : public MemoryResource<vk::Buffer> {
 public:
 	Buffer() = default;
 	Buffer(const Device&, const vk::BufferCreateInfo&, unsigned int memoryTypesBits = ~0u);
+
+	/// Prefers the memory types for the given usage, see Device::memoryTypeBits.
+	/// With MemoryUsage::hostWrite the buffer will be mappable on unified memory
+	/// or resizable bar devices and therefore directly written by BufferUpdate.
+	Buffer(const Device&, const vk::BufferCreateInfo&, MemoryUsage usage);
 	Buffer(const Device&, vk::Buffer, vk::BufferUsageFlags, unsigned int memoryTypeBits = ~0u);
 	Buffer(vk::Buffer buffer, MemoryEntry&& entry);
+
+	/// Creates the buffer on host memory imported with VK_EXT_external_memory_host,
+	/// see the matching DeviceMemory constructor. Allocates the buffer on the given
+	/// memory which must remain valid for the lifetime of the buffer.
+	/// With the transferSrc or transferDst usage bits, such a buffer can be
+	/// used to upload or download data without copying it into a staging buffer,
+	/// see write(Buffer, Buffer) and retrieve(Buffer, Buffer).
+	Buffer(DeviceMemory& importedMemory, const vk::BufferCreateInfo&);
 	~Buffer();
 
 	Buffer(Buffer&& rhs) noexcept { swap(*this, rhs); }
@@ -12,6 +12,12 @@
 #include <vpp/util/allocation.hpp>
 #include <vpp/util/tmp.hpp>
 
+#include <tuple> // std::tuple
+#include <array> // std::array
+#include <cstring> // std::memcpy
+#include <stdexcept> // std::out_of_range
+#include <algorithm> // std::max
+
 namespace vpp {
 
 /// Vulkan shader data types.
@@ -106,6 +112,13 @@ public:
 	/// Undefined behaviour if ptr does not point to at least size bytes.
 	void operate(const void* ptr, size_t size);
 
+	/// Returns a pointer to the memory for the next size bytes of the buffer and
+	/// advances the offset as if operate was called with size bytes.
+	/// Allows to write data directly into the mapped or staging memory instead of
+	/// copying it from a temporary. All returned bytes must be written before the
+	/// next operation on this BufferUpdate.
+	uint8_t* operateRange(size_t size);
+
 	/// Offsets the current position on the buffer by size bytes. If update is true, it will
 	/// override the bytes with zero, otherwise they will not be changed.
 	void offset(size_t size, bool update = true);
@@ -143,6 +156,7 @@ protected:
 	std::vector<uint8_t> data_; // for direct copying
 	std::vector<vk::BufferCopy> copies_; // for copy (direct/transfer)
 	size_t internalOffset_ {}; // offset for internal data
+	size_t rangeOffset_ {}; // offset of the transfer range in its buffer (transfer)
 
 	bool direct_ {};
 };
@@ -196,6 +210,10 @@ public:
 
 	void operate(void* ptr, std::size_t size);
 
+	/// Returns a pointer to the next size bytes of the data to read and advances
+	/// the offset as if operate was called with size bytes.
+	const uint8_t* operateRange(std::size_t size);
+
 	void offset(std::size_t size) { align(0); offset_ += size; }
 	void align(size_t algn) { offset_ = vpp::align(offset_, algn); }
 
@@ -212,6 +230,92 @@ protected:
 	nytl::Span<const uint8_t> data_;
 };
 
+/// The minimum value of vk::PhysicalDeviceLimits::maxPushConstantsSize guaranteed
+/// by the vulkan specification, i.e. the push constant size that can be
+/// checked at compile time.
+constexpr auto guaranteedPushConstantsSize = 128u;
+
+/// BufferOperator that writes the data into a fixed-capacity storage on the stack instead
+/// of into a buffer. Can be used for data that is recorded inline into a command buffer
+/// like push constants or small cmdUpdateBuffer updates without any allocation.
+/// Bytes skipped due to alignment are always zero.
+/// \tparam Capacity The maximum size of the written data in bytes.
+/// \sa cmdPushConstants
+template<std::size_t Capacity>
+class InlineBufferUpdate : public BufferOperator<InlineBufferUpdate<Capacity>> {
+public:
+	InlineBufferUpdate(BufferLayout layout = BufferLayout::std430)
+		: BufferOperator<InlineBufferUpdate>(layout) {}
+
+	/// Writes size bytes from ptr into the storage.
+	/// \exception std::out_of_range if the capacity would be exceeded
+	void operate(const void* ptr, std::size_t size);
+
+	/// Returns the storage for the next size bytes. See BufferUpdate::operateRange.
+	/// \exception std::out_of_range if the capacity would be exceeded
+	uint8_t* operateRange(std::size_t size);
+
+	void offset(std::size_t size, bool = true) { operateRange(size); }
+
+	/// Aligns the current offset.
+	/// \exception std::out_of_range if the aligned offset exceeds the capacity
+	void align(std::size_t align, bool = true);
+
+	/// Returns the data written so far.
+	nytl::Span<const uint8_t> data() const { return {data_.data(), this->offset_}; }
+
+	using BufferOperator<InlineBufferUpdate>::offset;
+
+protected:
+	std::array<uint8_t, Capacity> data_ {};
+};
+
+/// Records a cmdPushConstants command that pushes the given objects in the std430
+/// layout. The objects are written like with BufferUpdate, i.e. they must have a
+/// VulkanType specialization, but directly into storage on the stack.
+/// If all given types have a static size (see neededBufferSize), the needed size
+/// is computed at compile time and checked against MaxSize. Otherwise MaxSize bytes of
+/// stack storage are used and exceeding it throws std::out_of_range.
+/// Throws std::out_of_range as well if offset plus the size of the data exceeds MaxSize.
+/// \tparam MaxSize The maximum size of the push constant data. Can be raised above the
+/// guaranteed size if the devices maxPushConstantsSize was checked.
+/// \param offset The offset in the push constant range, must be a multiple of 4.
+template<std::size_t MaxSize = guaranteedPushConstantsSize, typename... T>
+void cmdPushConstants(vk::CommandBuffer, vk::PipelineLayout, vk::ShaderStageFlags,
+	std::uint32_t offset, const T&... objs);
+
+/// Structure-of-arrays view for an array of structures of type T.
+/// Operating on it has the same effect as operating on an array of T objects, i.e.
+/// the member arrays are interleaved into an array of structures on the buffer (and
+/// deinterleaved again when read by a BufferReader) but the values are copied
+/// directly between the member arrays and the mapped or staging memory, without ever
+/// building the array of structures on the host.
+/// The i-th span holds the values of the i-th member in VulkanType<T>::members, all
+/// spans have the same size. Only supported for aligned structures whose members are
+/// scalars or vectors with the same host and buffer representation, which is usually
+/// the case for vertex or instance data.
+/// \sa interleave
+template<typename T, typename... M>
+struct Interleaved {
+	std::tuple<nytl::Span<M>...> members;
+};
+
+/// Creates an Interleaved view for the given member containers.
+/// The containers are only referenced and must remain valid as long as
+/// the returned object is used. To read into them, they must not be const.
+/// \code
+/// std::vector<Vec3f> positions;
+/// std::vector<Vec2f> uvs;
+/// vpp::fill430(buffer, vpp::interleave<Vertex>(positions, uvs));
+///
+/// auto soa = vpp::interleave<Vertex>(positions, uvs);
+/// vpp::read430(buffer, soa)->finish();
+/// \endcode
+/// \exception std::logic_error if the containers have different sizes
+template<typename T, typename... C>
+auto interleave(C&... containers)
+	-> Interleaved<T, std::remove_reference_t<decltype(*containers.data())>...>;
+
 /// Fills the buffer with the given data.
 /// Does this either by memory mapping the buffer or by copying it via command buffer.
 /// Expects that buffer was created fillable, so either the buffer is memory mappable or
@@ -246,6 +350,15 @@ WorkPtr fill(const Buffer& buf, BufferLayout align, const T&... args)
 /// \sa fill
 WorkPtr write(const Buffer& buf, nytl::Span<const uint8_t> data);
 
+/// Copies the given range of src into dst using a transfer command.
+/// Meant for uploading data from a buffer on imported host memory (or any
+/// other host visible buffer the data was already written to) without
+/// copying it into a staging buffer first.
+/// \param size The size of the range to copy. If size is vk::wholeSize (default) the range
+/// from srcOffset until the end of src will be copied.
+WorkPtr write(const Buffer& dst, const Buffer& src, vk::DeviceSize dstOffset = 0,
+	vk::DeviceSize srcOffset = 0, vk::DeviceSize size = vk::wholeSize);
+
 /// Utilty shortcut for filling the buffer with data using the std140 layout.
 /// \sa fill
 /// \sa BufferUpdate
@@ -265,6 +378,15 @@ template<typename... T> WorkPtr fill430(const Buffer& buf, const T&... args)
 DataWorkPtr retrieve(const Buffer& buf, vk::DeviceSize offset = 0,
 	vk::DeviceSize size = vk::wholeSize);
 
+/// Retrieves the given range of src into dst using a transfer command.
+/// Meant for downloading data directly into a buffer on imported host memory
+/// without a staging buffer. The data is available in dst when the returned
+/// work has finished.
+/// \param size The size of the range to copy. If size is vk::wholeSize (default) the range
+/// from srcOffset until the end of src will be copied.
+WorkPtr retrieve(const Buffer& src, const Buffer& dst, vk::DeviceSize srcOffset = 0,
+	vk::DeviceSize dstOffset = 0, vk::DeviceSize size = vk::wholeSize);
+
 /// Reads the data stored in the given buffer aligned into the given objects.
 /// Note that the given objects MUST remain valid until the work finishes.
 /// You can basically pass all argument types that you can pass to the fill command.
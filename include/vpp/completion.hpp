@@ -0,0 +1,199 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <vpp/fwd.hpp>
+#include <vpp/resource.hpp> // vpp::Resource
+#include <vpp/work.hpp> // vpp::WorkBase
+#include <vpp/queue.hpp> // vpp::Queue
+#include <vpp/device.hpp> // vpp::Device
+#include <vpp/util/nonCopyable.hpp> // nytl::NonMovable
+
+#include <chrono> // std::chrono::nanoseconds
+#include <condition_variable> // std::condition_variable
+#include <deque> // std::deque
+#include <functional> // std::function
+#include <memory> // std::unique_ptr
+#include <mutex> // std::mutex
+#include <thread> // std::thread
+#include <type_traits> // std::remove_const_t
+#include <vector> // std::vector
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+	#include <coroutine> // std::coroutine_handle
+	#define VPP_COROUTINES
+#endif
+
+namespace vpp {
+
+/// Waits on a dedicated thread for the completion of work and calls registered
+/// continuations on a pool of worker threads, so that consumers of work
+/// neither have to poll nor block a thread per outstanding work.
+/// All submitted work is waited for at once with SubmitManager::wait (i.e.
+/// one vkWaitForFences or vkWaitSemaphoresKHR call), work that is not
+/// a command submission (see WorkBase::commandState) is polled.
+/// Every Device has one, see Device::completionService.
+/// All functions are threadsafe.
+class CompletionService : public Resource, public nytl::NonMovable {
+public:
+	using Continuation = std::function<void()>;
+
+public:
+	/// \param threads The number of threads to call the continuations on.
+	/// If it is 0, they are called on the completion thread, they should
+	/// then not block or do expensive work.
+	/// \param latency The maximum time the completion thread waits before considering
+	/// newly registered work.
+	CompletionService(const Device&, unsigned int threads = 1,
+		std::chrono::nanoseconds latency = std::chrono::milliseconds(1));
+
+	/// Waits until all registered work was executed and all continuations were called.
+	~CompletionService();
+
+	/// Submits the given work if needed and calls the given continuation
+	/// once it was executed. Before that, the work's state is updated to executed.
+	/// The work must not be destroyed or used in any other way until the
+	/// continuation was called.
+	/// \exception std::logic_error if the work's command state is not valid,
+	/// i.e. it could never be executed. The work is not finished since it might own
+	/// resources that must be freed on the thread that created them (such as
+	/// command buffers), finishing it is cheap after it was executed.
+	void then(WorkBase& work, Continuation);
+
+	/// Blocks until all registered work was executed and all continuations were called.
+	void wait();
+
+	/// Returns the number of work objects whose continuations were not yet called.
+	std::size_t pending() const;
+
+protected:
+	struct Entry {
+		WorkBase* work;
+		Continuation continuation;
+	};
+
+	void complete(); // completion thread
+	void run(); // worker threads
+	void call(Continuation&);
+
+protected:
+	std::chrono::nanoseconds latency_;
+	bool stop_ {};
+
+	mutable std::mutex mutex_;
+	std::condition_variable cv_; // new entries or stop
+	std::condition_variable idleCv_; // outstanding_ reached zero
+	std::vector<Entry> entries_;
+	std::size_t outstanding_ {}; // entries and continuations not yet called
+	std::thread thread_;
+
+	std::condition_variable taskCv_; // new tasks or stop
+	std::deque<Continuation> tasks_;
+	std::vector<std::thread> workers_;
+};
+
+/// Queue of functions that are called on the thread running it.
+/// Used to resume coroutines awaiting work on the thread that created the
+/// work, see WorkAwaiter. Every thread has one, see current. The thread must
+/// not exit while functions might still be posted to its executor.
+/// All functions are threadsafe.
+class Executor : public nytl::NonMovable {
+public:
+	using Task = std::function<void()>;
+
+	/// Returns the executor of the calling thread.
+	static Executor& current();
+
+public:
+	/// Queues the given function, it is called by the next run or wait.
+	void post(Task);
+
+	/// Calls all queued functions on the calling thread.
+	/// Should only be called on the thread the executor belongs to.
+	/// Returns the number of called functions.
+	std::size_t run();
+
+	/// Waits until a function was queued or the given timeout elapsed,
+	/// then calls all queued functions like run.
+	std::size_t wait(std::chrono::nanoseconds timeout);
+
+protected:
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::deque<Task> tasks_;
+};
+
+#ifdef VPP_COROUTINES
+
+namespace detail {
+
+// the result of awaited work, owned since the work is destroyed on resumption
+template<typename R> struct AwaitResult {
+	using type = R;
+	static type get(Work<R>& work) { return work.data(); }
+};
+
+template<typename T> struct AwaitResult<nytl::Span<T>> {
+	using type = std::vector<std::remove_const_t<T>>;
+	static type get(Work<nytl::Span<T>>& work) {
+		auto data = work.data();
+		return {data.begin(), data.end()};
+	}
+};
+
+template<> struct AwaitResult<void> {
+	using type = void;
+	static void get(Work<void>&) {}
+};
+
+} // namespace detail
+
+/// Awaitable for a work object. Suspends the awaiting coroutine until the work
+/// was executed, without blocking a thread. The coroutine is then resumed on
+/// the thread that awaited the work (by its Executor, see Executor::current),
+/// which must therefore run its executor. Since the work is usually created
+/// directly before awaiting it, it is finished on the thread that created it
+/// (as needed for resources like command buffers) before the coroutine is resumed.
+/// Awaiting returns the data of the work, spans of data are copied into a vector.
+template<typename R>
+class WorkAwaiter {
+public:
+	using Result = typename detail::AwaitResult<R>::type;
+
+public:
+	WorkAwaiter(std::unique_ptr<Work<R>> work) : work_(std::move(work)) {}
+
+	bool await_ready() { return !work_->commandState() || work_->executed(); }
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		auto& dev = work_->commandState()->queue()->device();
+		auto& executor = Executor::current();
+		dev.completionService().then(*work_, [&executor, handle]{
+			executor.post([handle]{ handle.resume(); });
+		});
+	}
+
+	Result await_resume()
+	{
+		auto work = std::move(work_);
+		work->finish();
+		return detail::AwaitResult<R>::get(*work);
+	}
+
+protected:
+	std::unique_ptr<Work<R>> work_;
+};
+
+/// Allows to directly await the work returned by functions like fill or retrieve, e.g.
+/// `auto data = co_await vpp::retrieve(buffer);` in a coroutine.
+template<typename R>
+WorkAwaiter<R> operator co_await(std::unique_ptr<Work<R>>&& work)
+{
+	return {std::move(work)};
+}
+
+#endif // VPP_COROUTINES
+
+} // namespace vpp
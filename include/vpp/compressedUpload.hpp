@@ -0,0 +1,50 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <vpp/fwd.hpp>
+#include <vpp/work.hpp> // vpp::WorkPtr
+#include <vpp/util/span.hpp> // nytl::Span
+
+#include <functional> // std::function
+
+namespace vpp {
+
+/// One independently compressed block of a compressed payload.
+struct CompressedBlock {
+	nytl::Span<const uint8_t> data; // the compressed data
+	std::size_t size; // the size of the decompressed data
+};
+
+/// Decompresses the given compressed block into the given destination memory.
+/// Must write exactly dst.size() bytes and throw an exception on failure.
+/// Will be called from multiple threads at the same time.
+/// Usually wraps a call to e.g. LZ4_decompress_safe or ZSTD_decompressDCtx, vpp
+/// itself does not depend on any compression library.
+using Decompressor = std::function<void(nytl::Span<const uint8_t> src, nytl::Span<uint8_t> dst)>;
+
+/// Uploads a compressed payload to the given buffer.
+/// The blocks are decompressed on a pool of worker threads directly into mapped
+/// staging memory and the copy for every decompressed block is submitted as soon as
+/// the block is ready (blocks finished at the same time share one submission).
+/// So decompression overlaps with the transfer and no intermediate buffer for the
+/// whole decompressed data is needed.
+/// Blocks until all blocks were decompressed and their copies submitted.
+/// If the buffer is mappable, the blocks are directly decompressed into it.
+/// \param buffer The buffer to upload to. Must be mappable or have the
+/// transferDst usage bit set.
+/// \param offset The offset in the buffer to upload to. The decompressed blocks
+/// are uploaded contiguously in the given order. Blocks with a decompressed
+/// size of 0 are skipped, the decompressor is not called for them.
+/// \param threads The number of worker threads to use. If 0, uses the number of
+/// hardware threads. Never more threads than blocks are used.
+/// \return A work that will be finished once all copies are finished.
+/// \exception Rethrows any exception thrown by the decompressor. Copies
+/// of blocks that were already submitted are finished before.
+WorkPtr uploadCompressed(const Buffer& buffer, vk::DeviceSize offset,
+	nytl::Span<const CompressedBlock> blocks, const Decompressor& decompressor,
+	unsigned int threads = 0);
+
+} // namespace vpp
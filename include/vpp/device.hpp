@@ -141,6 +141,14 @@ public:
 	unsigned int memoryTypeBits(vk::MemoryPropertyFlags mflags,
 		unsigned int typeBits = ~0u) const;
 
+	/// Returns the memory types of typeBits that are preferred for the given usage.
+	/// For MemoryUsage::hostWrite these are the memory types that are deviceLocal
+	/// and hostVisible (as on unified memory architectures or with resizable bar) so
+	/// that resources can be written directly without staging buffer and copy.
+	/// For MemoryUsage::hostRead the hostVisible (preferably hostCached) ones.
+	/// If there are no such memory types, returns typeBits.
+	unsigned int memoryTypeBits(MemoryUsage usage, unsigned int typeBits = ~0u) const;
+
 	/// Returns a CommandBufferProvider that can be used to easily allocate command buffers.
 	/// The returned CommandProvider will be specific for the calling thread.
 	/// \sa CommandProvider
@@ -154,6 +162,19 @@ public:
 	/// \sa TransferManager
 	TransferManager& transferManager() const;
 
+	/// Returns whether the device was created with the VK_KHR_timeline_semaphore
+	/// extension and its timelineSemaphore feature enabled. The SubmitManager
+	/// then tracks submissions with timeline semaphores.
+	/// The constructors taking extensions enable the feature when the extension is given,
+	/// for devices created from a vk::DeviceCreateInfo it has to be chained to it.
+	/// Always false for devices created elsewhere.
+	bool timelineSemaphores() const { return timelineSemaphores_; }
+
+	/// Returns the completion service for this device.
+	/// It is created on first use, with one thread for continuations.
+	/// \sa CompletionService
+	CompletionService& completionService() const;
+
 	/// Returns a deviceMemory allocator for this device and the calling thread.
 	/// \sa DeviceMemoryAllocator
 	DeviceMemoryAllocator& deviceAllocator() const;
@@ -188,6 +209,7 @@ protected:
 	vk::Instance instance_ {};
 	vk::PhysicalDevice physicalDevice_ {};
 	vk::Device device_ {};
+	bool timelineSemaphores_ {};
 
 	/// Device uses the pimpl idion since it holds internally many (partly thread-speciic) object
 	/// that would pull a lot of huge headers or simply more an implementation detail.
@@ -28,6 +28,8 @@ using std::size_t;
 class Resource;
 class WorkBase;
 
+enum class MemoryUsage;
+
 class Buffer;
 class Image;
 class Surface;
@@ -60,11 +62,14 @@ class MemoryEntry;
 class ViewableImage;
 class RenderPassInstance;
 class CommandExecutionState;
+class BarrierBatch;
+class AccessTracker;
 
 class CommandProvider;
 class DeviceMemoryProvider;
 class HostMemoryProvider;
 class SubmitManager;
+class CompletionService;
 class WorkManager;
 class TransferManager;
 
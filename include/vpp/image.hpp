@@ -7,11 +7,16 @@
 #include <vpp/fwd.hpp>
 #include <vpp/memoryResource.hpp> // vpp::MemoryResource
 #include <vpp/work.hpp> // vpp::WorkPtr
+#include <vpp/barrier.hpp> // vpp::BarrierBatch
 #include <vpp/vulkan/structs.hpp> // vk::ImageCreateInfo
+#include <vpp/util/span.hpp> // nytl::Span
+
+#include <vector> // std::vector
+#include <deque> // std::deque
+#include <mutex> // std::mutex
+#include <utility> // std::pair
 
 // TODO: fill/retrieve:
-//  - allow compressed formats. Some way to allow filling a compressed image with
-//	  uncompressed data? doing the compressing on the gpu?
 // - parameter for preseving the layout, i.e. changing its back to the
 //   original value if it has to be chagned
 
@@ -24,12 +29,37 @@ class Image : public MemoryResource<vk::Image> {
 public:
 	Image() = default;
 	Image(const Device&, const vk::ImageCreateInfo&, unsigned int memoryTypeBits = ~0u);
+
+	/// Prefers the memory types for the given usage, see Device::memoryTypeBits.
+	/// Only linear images can be filled or retrieved by mapping their memory.
+	Image(const Device&, const vk::ImageCreateInfo&, MemoryUsage usage);
+
 	Image(const Device&, vk::Image, vk::ImageTiling, unsigned int memoryTypeBits = ~0u);
 	Image(vk::Image, MemoryEntry&&);
 	~Image();
 
 	Image(Image&& rhs) noexcept { swap(*this, rhs); }
 	auto& operator=(Image rhs) noexcept { swap(*this, rhs); return *this; }
+
+	/// Returns whether the image was created with the host transfer usage bit of
+	/// VK_EXT_host_image_copy. Such images are filled and retrieved directly by
+	/// the host if their layout allows it, see fill and retrieve.
+	/// Always false for images not created from an ImageCreateInfo.
+	bool hostTransfer() const { return hostTransfer_; }
+
+	/// Returns the layout of the given subresource of this (linear) image.
+	/// Queried only once per subresource, the result is cached.
+	/// Synchronized, can be called from multiple threads at once. The returned
+	/// reference remains valid as long as the image is not destroyed or moved.
+	const vk::SubresourceLayout& subresourceLayout(const vk::ImageSubresource&) const;
+
+	friend void swap(Image& a, Image& b) noexcept;
+
+protected:
+	bool hostTransfer_ {};
+	// deque so returned references stay valid when other threads add layouts
+	mutable std::deque<std::pair<vk::ImageSubresource, vk::SubresourceLayout>> layouts_;
+	mutable std::mutex layoutsMutex_; // guards layouts_, not swapped
 };
 
 /// Returns the size of the given format in bits.
@@ -50,20 +80,38 @@ unsigned int formatSize(vk::Format);
 /// \sa formatSize, formatSizeBits
 vk::Extent2D blockSize(vk::Format);
 
+/// Returns the number of blocks needed for the given extent, i.e. the extent
+/// divided by the blockSize of the format (rounded up). The depth is at least 1.
+/// For non-compressed formats this is simply the extent.
+vk::Extent3D blockExtent(vk::Format, const vk::Extent3D&);
+
+/// Returns the size in bytes of tightly packed data of the given format for
+/// the given extent. Block-aware, i.e. works for compressed formats as well.
+/// \sa blockExtent, formatSize
+vk::DeviceSize dataSize(vk::Format, const vk::Extent3D&);
+
 /// Fills the given image with data.
-/// There are two different methods for filling an image: memoryMap and transfer.
+/// There are three different methods for filling an image: host copy, memoryMap and transfer.
+/// Host copy (VK_EXT_host_image_copy) is used if the image was created with its host
+/// transfer usage bit (see Image::hostTransfer) and the layout is general,
+/// preinitialized or undefined. The data is then copied on the calling thread
+/// and the image transitioned to the general layout. Then the image must not be
+/// in use by the device.
 /// MemoryMap is used if the image is mappable and the allowMap param is true, otherwise
 /// the transfer method is used (which is usually less efficient).
 /// Some of the parameters are only needed for one of the two methods.
-/// \param image The image to fill. Must have a non-compressed
-/// format. Must not be multisampled and either be created on host visible memory or with the
+/// \param image The image to fill.
+/// Must not be multisampled and either be created on host visible memory or with the
 /// transferDst usage bit set. If it was not created as sparse image, must be
 /// fully bound to memory. Otherwise only the accessed parts must be bound.
 /// \param data Tightly packed data.
 /// The data must be in row-major order and large enough for the given extent.
-/// The size of data will be expected to be extent.w * extent.h * extent.d * formatSize(format).
+/// The size of data will be expected to be dataSize(format, extent). For compressed
+/// formats, the data consists of rows of blocks.
 /// \param format The images format. Only important for the size, so if the images format
 /// is r8g8b8a8*, passing any other format with the same size (like e.g. a8b8g8r8*) is fine.
+/// Compressed formats are supported, then offset must be a multiple of the block size
+/// and extent either as well or reach the edge of the subresource.
 /// \param layout The layout of the image when this work will be submitted.
 /// Only needed if the image is filled per transfer. If the layout is not transferDstOptimal
 /// or the general and the transfer method is used, it will be cahgned to
@@ -81,6 +129,11 @@ vk::Extent2D blockSize(vk::Format);
 /// Note that if this is true the image must have been created with the transferDst
 /// usage bit set.
 /// If this is true and the image is mappable it must have linear tiling.
+/// \param dataFormat The format of the given data, if it differs from the image
+/// format. The data is then converted while it is written into the staging or
+/// image memory, see convertPixels. Both formats must be convertible, see
+/// pixelConvertible. The data is expected to have the same number of texels.
+/// If undefined (default), the data has the image format.
 WorkPtr fill(const Image& image,
 	const uint8_t& data,
 	vk::Format format,
@@ -88,13 +141,49 @@ WorkPtr fill(const Image& image,
 	const vk::Extent3D& extent,
 	const vk::ImageSubresource& subres,
 	const vk::Offset3D& offset = {},
-	bool allowMap = true);
+	bool allowMap = true,
+	vk::Format dataFormat = vk::Format::undefined);
+
+/// Fills multiple regions of the given image (e.g. all mip levels and layers)
+/// at once. Uses a single staging allocation and copy command for the transfer method.
+/// \param data The data for all regions. Each region reads its tightly packed data
+/// at its bufferOffset, bufferRowLength and bufferImageHeight are ignored.
+/// If dataFormat differs from format, the offsets are still given for data
+/// in the image format, i.e. the data of a region is expected at
+/// bufferOffset / formatSize(format) * formatSize(dataFormat).
+/// See mipRegions for creating the regions of a whole mip chain.
+/// For the other parameters, see the overload above.
+WorkPtr fill(const Image& image,
+	nytl::Span<const uint8_t> data,
+	vk::Format format,
+	vk::ImageLayout& layout,
+	nytl::Span<const vk::BufferImageCopy> regions,
+	bool allowMap = true,
+	vk::Format dataFormat = vk::Format::undefined);
+
+/// Fills the given image region with the data of the given buffer using a transfer
+/// command. Meant for uploading data from a buffer on imported host memory
+/// without copying it into a staging buffer first.
+/// The image must have the transferDst usage bit, the buffer the transferSrc bit.
+/// \param srcOffset The offset of the tightly packed data in the buffer.
+/// \param layout The layout of the image when the work will be submitted.
+/// Changed to transferDstOptimal if it is not transferDstOptimal or general,
+/// see the fill overload above.
+WorkPtr fill(const Image& image,
+	const Buffer& src,
+	vk::DeviceSize srcOffset,
+	vk::ImageLayout& layout,
+	const vk::Extent3D& extent,
+	const vk::ImageSubresource& subres,
+	const vk::Offset3D& offset = {});
 
 /// Retrieves the data from the given image.
 /// The image must be either allocated on host visible memory or must have the transferSrc bit set
 /// as usage and must not be multisampled.
-/// \param image The image to retrieve the data from. Must have a non-compressed
-/// format. Must not be multisampled and either be created on host visible memory or with the
+/// Like fill, copies directly on the calling thread if the image has the host transfer
+/// usage bit and its layout is general or preinitialized.
+/// \param image The image to retrieve the data from.
+/// Must not be multisampled and either be created on host visible memory or with the
 /// transferDst usage bit set. If it was not created as sparse image, must be
 /// fully bound to memory. Otherwise only the accessed parts must be bound.
 /// \param layout The current ImageLayout of the image.
@@ -104,22 +193,63 @@ WorkPtr fill(const Image& image,
 /// \param allowMap If set to false, the image fill always be filled using a transfer command
 /// rather than mapping its memory if possible. Needed e.g. if the image has an optimal tiling.
 /// If this is set to false, the image must have been created with the transferDstSrc bit.
+/// \param dataFormat The format in which the data should be returned, if it differs
+/// from the image format. The texels are converted directly from the download
+/// or image memory, see convertPixels and the fill overload above.
 DataWorkPtr retrieve(const Image& image,
 	vk::ImageLayout& layout,
 	vk::Format format,
 	const vk::Extent3D& extent,
 	const vk::ImageSubresource& subres,
 	const vk::Offset3D& offset = {},
-	bool allowMap = true);
+	bool allowMap = true,
+	vk::Format dataFormat = vk::Format::undefined);
+
+/// Retrieves multiple regions of the given image (e.g. all mip levels and layers)
+/// at once. The returned data holds the tightly packed data of each region at its
+/// bufferOffset. See the multi-region fill overload.
+DataWorkPtr retrieve(const Image& image,
+	vk::ImageLayout& layout,
+	vk::Format format,
+	nytl::Span<const vk::BufferImageCopy> regions,
+	bool allowMap = true,
+	vk::Format dataFormat = vk::Format::undefined);
+
+/// Returns the tightly packed regions for the given mip levels and layers of an image
+/// with the given format and extent, one region per level (covering all layers).
+/// The data of the levels follows each other, starting with baseLevel.
+/// Can be passed to the multi-region fill and retrieve overloads.
+std::vector<vk::BufferImageCopy> mipRegions(vk::Format format,
+	const vk::Extent3D& extent,
+	vk::ImageAspectFlags aspect,
+	unsigned int levels,
+	unsigned int layers = 1,
+	unsigned int baseLevel = 0,
+	unsigned int baseLayer = 0);
 
 /// Records the command for changing the layout of the given image into the
 /// given CommandBuffer.
 /// The given CommandBuffer must be in recording state
+/// The stages and access masks of the barrier are derived from the typical
+/// usage of the layouts (see layoutAccess), restricted to the stages supported
+/// by the given capabilities of the command buffers queue family.
+/// Use an AccessTracker if more is known about the previous and next accesses.
 void changeLayoutCommand(vk::CommandBuffer,
 	vk::Image,
 	vk::ImageLayout oldLayout,
 	vk::ImageLayout newLayout,
-	const vk::ImageSubresourceRange&);
+	const vk::ImageSubresourceRange&,
+	vk::QueueFlags queueFlags = allQueueBits);
+
+/// Adds the barrier for changing the layout of the given image to the given batch.
+/// Allows to transition many images with one pipeline barrier.
+/// \sa changeLayoutCommand
+void changeLayoutCommand(BarrierBatch&,
+	vk::Image,
+	vk::ImageLayout oldLayout,
+	vk::ImageLayout newLayout,
+	const vk::ImageSubresourceRange&,
+	vk::QueueFlags queueFlags = allQueueBits);
 
 /// Changes the layout of a given image and returns the associated work ptr.
 WorkPtr changeLayout(const Device&,
@@ -0,0 +1,57 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <vpp/fwd.hpp>
+#include <vpp/work.hpp> // vpp::WorkPtr
+#include <vpp/util/stringParam.hpp> // nytl::StringParam
+#include <vpp/vulkan/structs.hpp> // vk::ImageCreateInfo
+
+#include <cstdint> // std::uint64_t
+#include <vector> // std::vector
+
+namespace vpp {
+
+/// Information about a KTX2 texture file.
+/// Only files without supercompression (i.e. the image data is stored as-is,
+/// e.g. in a compressed BC, ETC2 or ASTC format) are supported.
+struct Ktx2Info {
+	/// The range of one mip level in the file.
+	struct Level {
+		std::uint64_t offset;
+		std::uint64_t size;
+	};
+
+	vk::Format format {};
+	vk::ImageType type {};
+	vk::Extent3D extent {}; // extent of the first level, all dimensions at least 1
+	unsigned int levels {};
+	unsigned int layers {}; // array layers of the image, cube faces count as layers
+	bool cube {};
+	std::vector<Level> levelData; // the data of each level in the file
+
+	/// Returns a create info for an optimal tiling image that can hold the texture
+	/// and can be filled with fillKtx2. The usage contains sampled and transferDst.
+	vk::ImageCreateInfo imageInfo() const;
+};
+
+/// Reads the header and level index of the given KTX2 file.
+/// \exception std::runtime_error if the file cannot be read, is no valid KTX2
+/// file or uses an unsupported feature (supercompression, undefined format).
+Ktx2Info readKtx2Info(nytl::StringParam path);
+
+/// Fills all mip levels and layers of the given image with the texture data of the
+/// given KTX2 file. The payload of every level is streamed directly from the file
+/// into one staging range and uploaded with one copy command, so compressed
+/// textures are never decompressed or copied on the host.
+/// \param image The image to fill. Must have been created with a format, extent,
+/// levels and layers compatible to the file (see Ktx2Info::imageInfo) and the
+/// transferDst usage bit.
+/// \param layout The layout of the image when the work is submitted. If it is not
+/// transferDstOptimal or general, will be changed to transferDstOptimal.
+/// \exception std::runtime_error see readKtx2Info
+WorkPtr fillKtx2(const Image& image, nytl::StringParam path, vk::ImageLayout& layout);
+
+} // namespace vpp
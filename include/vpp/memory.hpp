@@ -8,6 +8,7 @@
 #include <vpp/resource.hpp> // vpp::ResourceHandle
 #include <vpp/memoryMap.hpp> // vpp::MemoryMap
 #include <vpp/util/allocation.hpp> // vpp::Allocation
+#include <vpp/util/span.hpp> // nytl::Span
 #include <vector> // std::vector
 
 namespace vpp {
@@ -21,6 +22,14 @@ enum class AllocationType {
 	sparseAlias = 8
 };
 
+/// Hints how the memory of a resource will be accessed.
+/// Used to prefer fitting memory types, see Device::memoryTypeBits.
+enum class MemoryUsage {
+	none, // no preference
+	hostWrite, // written by the host, read by the device. Prefers deviceLocal, hostVisible
+	hostRead // written by the device, read by the host. Prefers hostVisible, hostCached
+};
+
 /// DeviceMemory class that keeps track of its allocated and freed areas.
 /// Makes it easy to reuse memory as well as bind multiple memoryRequestors to one allocation.
 /// Note that there are additional rules for allocating device memory on vulkan (like e.g. needed
@@ -38,6 +47,17 @@ public:
 	DeviceMemory(const Device&, const vk::MemoryAllocateInfo&);
 	DeviceMemory(const Device&, uint32_t size, uint32_t typeIndex);
 	DeviceMemory(const Device&, uint32_t size, vk::MemoryPropertyFlags);
+
+	/// Imports the given host allocation using VK_EXT_external_memory_host.
+	/// The extension must have been enabled for the device. The address and size
+	/// must be aligned to minImportedHostPointerAlignment (usually the page size)
+	/// and the host memory must remain valid for the lifetime of this object.
+	/// Prefers hostVisible memory types of the given memoryTypeBits.
+	/// Resources on imported memory must be created with an external memory
+	/// create info, see the matching Buffer constructor.
+	/// \exception std::runtime_error if the memory cannot be imported.
+	DeviceMemory(const Device&, nytl::Span<uint8_t> hostMemory,
+		unsigned int memoryTypeBits = ~0u);
 	~DeviceMemory();
 
 	/// DeviceMemory is NonMovable since all memory resources will keep references to
@@ -93,6 +93,12 @@ public:
 	/// vkInvalidateMappedMemoryRanges. Can be checked with coherent().
 	void reload() const;
 
+	/// Like flush/reload but only for the given range relative to the start of this view.
+	/// The range is extended to nonCoherentAtomSize alignment as required by vulkan.
+	/// Useful if only a small part of a large mapped range was accessed.
+	void flush(const Allocation& range) const;
+	void reload(const Allocation& range) const;
+
 	/// Returns whether the view is valid.
 	bool valid() const noexcept { return memoryMap_; }
 
@@ -113,6 +119,7 @@ public:
 protected:
 	friend class DeviceMemory;
 	MemoryMapView(MemoryMap& map, const Allocation& range);
+	vk::MappedMemoryRange alignedRange(const Allocation& range) const;
 
 protected:
 	MemoryMap* memoryMap_ {};
@@ -0,0 +1,91 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <vpp/fwd.hpp>
+#include <vpp/work.hpp> // vpp::WorkPtr
+#include <vpp/image.hpp> // vpp::ImageView, vpp::Sampler
+#include <vpp/descriptor.hpp> // vpp::DescriptorSetLayout, vpp::DescriptorPool
+#include <vpp/pipeline.hpp> // vpp::PipelineLayout, vpp::Pipeline
+#include <vpp/shader.hpp> // vpp::ShaderModule
+
+#include <vector> // std::vector
+
+namespace vpp {
+
+/// How mipmaps for a format can be generated on the device.
+enum class MipmapMethod {
+	none, /// neither blitting nor compute shader storage is supported
+	blitLinear, /// blitting with linear filter
+	blitNearest, /// blitting, but the format does not support linear filtering
+	compute /// compute shader downsampling (2x2 box filter)
+};
+
+/// Returns the method with which mipmaps for optimal tiling images of
+/// the given format would be generated. Prefers blitting.
+MipmapMethod mipmapMethod(const Device&, vk::Format);
+
+/// Holds the objects needed by recorded compute mipmap generation commands.
+/// Must be kept alive until the commands completed execution.
+/// Empty (default constructed) if the mipmaps were generated by blitting.
+struct MipmapResources {
+	ShaderModule shader;
+	DescriptorSetLayout dsLayout;
+	PipelineLayout pipelineLayout;
+	Pipeline pipeline;
+	DescriptorPool pool;
+	Sampler sampler;
+	std::vector<ImageView> views;
+	std::vector<DescriptorSet> sets;
+};
+
+/// Records the commands for generating the mip levels [1, levels) of the given
+/// image from its first mip level into the given command buffer.
+/// Every level is generated from the previous one, using vkCmdBlitImage with the
+/// per-level layout transitions. If the format cannot be blitted (see mipmapMethod),
+/// a compute shader downsample is used instead, which requires a 2D image with
+/// the storage and sampled usage bits and the shaderStorageImageWriteWithoutFormat
+/// device feature.
+/// Can e.g. be appended to the commands filling the first level.
+/// \param cmdBuffer The command buffer in recording state. Its queue family must
+/// support graphics operations (blitting) or compute operations (compute fallback).
+/// \param image The image to generate the mipmaps for. Must have been created
+/// with the transferSrc and transferDst usage bits for blitting.
+/// \param format The format of the image, used to query blit support.
+/// \param extent The extent of the first mip level.
+/// \param layout The layout of the first mip level when the commands are executed.
+/// The other levels are treated as undefined, i.e. their contents discarded.
+/// Will be set to finalLayout, the layout of all levels afterwards.
+/// \param layers The number of array layers to generate the mipmaps for.
+/// \param queueFlags The flags of the queue family of the command buffer.
+/// Only used if there is just one level and therefore only the layout
+/// transition recorded, which then only uses the supported pipeline stages.
+/// \return The resources used by the recorded commands, empty when blitting.
+/// \exception std::runtime_error if the format supports neither blitting nor
+/// compute storage or the compute fallback is used for a 3D image.
+MipmapResources generateMipmapsCommand(vk::CommandBuffer cmdBuffer,
+	const Image& image,
+	vk::Format format,
+	const vk::Extent3D& extent,
+	vk::ImageLayout& layout,
+	unsigned int levels,
+	unsigned int layers = 1,
+	vk::ImageLayout finalLayout = vk::ImageLayout::shaderReadOnlyOptimal,
+	vk::QueueFlags queueFlags = allQueueBits);
+
+/// Generates the mip levels [1, levels) of the given image from its first level.
+/// Records the commands into a new command buffer for a graphics (or compute
+/// if the fallback is used) queue and returns the associated work.
+/// \sa generateMipmapsCommand
+/// \exception std::logic_error if the device has no valid queue.
+WorkPtr generateMipmaps(const Image& image,
+	vk::Format format,
+	const vk::Extent3D& extent,
+	vk::ImageLayout& layout,
+	unsigned int levels,
+	unsigned int layers = 1,
+	vk::ImageLayout finalLayout = vk::ImageLayout::shaderReadOnlyOptimal);
+
+} // namespace vpp
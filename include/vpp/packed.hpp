@@ -0,0 +1,124 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <vpp/fwd.hpp>
+#include <vpp/bufferOps.hpp> // vpp::VulkanType
+
+#include <array> // std::array
+#include <cstdint> // std::uint16_t
+
+namespace vpp {
+
+/// Quantized formats in which float values can be stored on a buffer.
+/// The conversions follow the vulkan rules for the matching vk::Format, so
+/// the values can be used as e.g. vertex attributes with the matching format.
+enum class PackedFormat {
+	sfloat16, // ieee half float, vk::Format::r16*Sfloat
+	unorm8, // [0, 1] as 8 bit unsigned integer, vk::Format::r8*Unorm
+	snorm8, // [-1, 1] as 8 bit signed integer, vk::Format::r8*Snorm
+	unorm16, // [0, 1] as 16 bit unsigned integer, vk::Format::r16*Unorm
+	snorm16, // [-1, 1] as 16 bit signed integer, vk::Format::r16*Snorm
+	a2b10g10r10Unorm // 4 unorm values in 32 bits, vk::Format::a2b10g10r10UnormPack32
+};
+
+/// Returns the size in bytes count values have in the given format.
+/// For a2b10g10r10Unorm count must be a multiple of 4.
+constexpr std::size_t packedSize(PackedFormat format, std::size_t count)
+{
+	switch(format) {
+		case PackedFormat::unorm8:
+		case PackedFormat::snorm8:
+		case PackedFormat::a2b10g10r10Unorm:
+			return count;
+		default:
+			return count * 2;
+	}
+}
+
+/// Converts count float values from src into the given format and writes
+/// them to dst which must have at least packedSize(format, count) bytes.
+/// Values out of the formats range are clamped.
+/// Uses F16C instructions for half floats if the cpu supports them, the results
+/// are equal to floatToHalf and halfToFloat.
+void pack(PackedFormat format, const float* src, void* dst, std::size_t count);
+
+/// Converts count values in the given format from src to float values.
+/// Reverse operation of pack.
+void unpack(PackedFormat format, const void* src, float* dst, std::size_t count);
+
+/// Converts a single float to/from the ieee half float representation.
+/// Rounds to the nearest representable value.
+std::uint16_t floatToHalf(float);
+float halfToFloat(std::uint16_t);
+
+/// Host vector of N float values that is stored as N packed values of format F
+/// on the buffer. Has a VulkanType specialization that converts the values when
+/// written by a BufferUpdate and converts them back when read by a BufferReader, so
+/// e.g. a vertex struct can keep its float values and still be uploaded quantized.
+template<PackedFormat F, std::size_t N>
+struct Packed : public std::array<float, N> {
+	static_assert(N > 0 && N <= 4, "Packed vectors must have 1 to 4 values");
+	static_assert(F != PackedFormat::a2b10g10r10Unorm || N == 4,
+		"a2b10g10r10Unorm packs exactly 4 values");
+};
+
+template<std::size_t N> using Half = Packed<PackedFormat::sfloat16, N>;
+template<std::size_t N> using Unorm8 = Packed<PackedFormat::unorm8, N>;
+template<std::size_t N> using Snorm8 = Packed<PackedFormat::snorm8, N>;
+template<std::size_t N> using Unorm16 = Packed<PackedFormat::unorm16, N>;
+template<std::size_t N> using Snorm16 = Packed<PackedFormat::snorm16, N>;
+using A2B10G10R10 = Packed<PackedFormat::a2b10g10r10Unorm, 4>;
+
+namespace detail {
+
+/// Custom VulkanType implementation for Packed.
+/// The generic call overload is used for all writing operators (e.g. BufferUpdate or
+/// InlineBufferUpdate) while BufferReader and BufferSizer have own overloads.
+/// The packed values are aligned like vectors of the smaller component type,
+/// as required e.g. for 8- and 16-bit storage buffer types.
+template<PackedFormat F, std::size_t N>
+struct PackedImpl {
+	static constexpr auto byteSize = packedSize(F, N);
+
+	template<typename O>
+	static void call(O& op, const Packed<F, N>& obj)
+	{
+		op.align(align<void>(op.std140()));
+		pack(F, obj.data(), op.operateRange(byteSize), N);
+	}
+
+	static void call(BufferReader& op, Packed<F, N>& obj)
+	{
+		op.align(align<void>(op.std140()));
+		unpack(F, op.operateRange(byteSize), obj.data(), N);
+	}
+
+	static constexpr void call(BufferSizer& op, const Packed<F, N>&) { size(op); }
+
+	template<typename O>
+	static constexpr void size(O& op)
+	{
+		op.align(align<void>(op.std140()));
+		op.operate(nullptr, byteSize);
+	}
+
+	template<typename T>
+	static constexpr unsigned int align(bool)
+	{
+		if(F == PackedFormat::a2b10g10r10Unorm) return 4u;
+		return packedSize(F, N == 3 ? 4 : N);
+	}
+};
+
+} // namespace detail
+
+template<PackedFormat F, std::size_t N>
+struct VulkanType<Packed<F, N>> {
+	static constexpr auto type = ShaderType::custom;
+	using impl = detail::PackedImpl<F, N>;
+};
+
+} // namespace vpp
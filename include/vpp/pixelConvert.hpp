@@ -0,0 +1,36 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <vpp/fwd.hpp>
+#include <vpp/vulkan/enums.hpp> // vk::Format
+
+#include <cstddef> // std::size_t
+
+namespace vpp {
+
+/// Returns whether pixels can be converted between the two formats with convertPixels.
+/// Supported are the 8 bit unorm and srgb formats with 1 to 4 channels (including the
+/// bgr(a) variants) and the 16 bit unorm, 16 bit sfloat and 32 bit sfloat formats
+/// with 1 to 4 channels. Equal formats are always convertible.
+bool pixelConvertible(vk::Format src, vk::Format dst);
+
+/// Converts count tightly packed pixels from srcFormat in src to dstFormat in dst.
+/// Channels missing in the source are set to 0, alpha to 1. Channels missing
+/// in the destination are dropped. srgb formats are decoded and encoded, their
+/// alpha channel is always linear. Values out of the destinations range are clamped.
+/// Swizzles and channel expansion between 8 bit formats use SSSE3 shuffles
+/// and half float conversions F16C instructions if the cpu supports them.
+/// Pixels of equal formats are copied, for block-compressed formats count is
+/// the number of blocks.
+/// The formats must be convertible, see pixelConvertible. src and dst must not overlap.
+void convertPixels(vk::Format srcFormat, const void* src, vk::Format dstFormat, void* dst,
+	std::size_t count);
+
+/// Converts between linear and srgb encoded values in the range [0, 1].
+float srgbToLinear(float);
+float linearToSrgb(float);
+
+} // namespace vpp
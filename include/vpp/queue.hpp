@@ -32,9 +32,8 @@ public:
 
 	/// The queue must be locked before performing any operations (such as presenting or sparse
 	/// binding) on the queue.
-	/// Note that locking the queues mutex is not enough for submitting command buffers
-	/// to the queue, since while submitting, no operation on any other queue is allowed.
-	/// Prefer to use the vpp::QueueManager class over using the plain mutex.
+	/// Prefer to use vpp::QueueLock over using the plain mutex, it also
+	/// synchronizes with operations that lock all queues.
 	std::mutex& mutex() const noexcept { return mutex_; }
 
 	vk::Queue vkHandle() const noexcept { return queue_; }
@@ -55,9 +54,9 @@ private:
 
 /// Acquires ownership over a single or all queues.
 /// Used for queue synchronization across threads.
-/// The constructor without a specific queue will lock all queues,
-/// which is e.g. needed when submitting command buffes.
-/// Otherwise just ownership over the given queue is claimed.
+/// The constructor without a specific queue will lock all queues.
+/// Otherwise just ownership over the given queue is claimed, which is
+/// e.g. needed when submitting command buffers to it.
 /// RAII lock class, i.e. the lock is bound the objects lifetime.
 struct QueueLock : public nytl::NonMovable {
 	QueueLock(const Device& dev);
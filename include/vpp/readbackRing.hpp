@@ -0,0 +1,104 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <vpp/fwd.hpp>
+#include <vpp/buffer.hpp> // vpp::Buffer
+#include <vpp/work.hpp> // vpp::CommandWork
+#include <vpp/memoryMap.hpp> // vpp::MemoryMapView
+#include <vpp/vulkan/structs.hpp> // vk::BufferCopy
+#include <vpp/util/span.hpp> // nytl::Span
+
+#include <functional> // std::function
+#include <vector> // std::vector
+#include <memory> // std::unique_ptr
+
+namespace vpp {
+
+/// Ring of persistently mapped (and, if possible, host cached) download memory
+/// split into a fixed number of frames. Meant for small per-frame readbacks like
+/// picking results or compute outputs that should neither stall the cpu nor allocate
+/// a new download buffer every time.
+/// Copies are added to the current frame using read and submitted together with submit.
+/// Finished frames are detected without blocking by poll, which calls the callbacks
+/// of the finished copies with spans directly into the mapped ring memory.
+///
+/// Lifetime rules: The span passed to a callback references the ring memory and is
+/// only valid until the frame is reused, i.e. until frameCount further calls of submit
+/// (or the destruction of the ring). Copy the data if it is needed longer.
+/// Callbacks are never called for frames still in flight on destruction.
+/// The ring is not synchronized in any way and callbacks are always called
+/// from poll, submit or wait.
+class ReadbackRing : public Resource {
+public:
+	using Callback = std::function<void(nytl::Span<const uint8_t> data)>;
+
+public:
+	ReadbackRing() = default;
+
+	/// \param frameSize The maximum size of data that can be read in one frame.
+	/// \param frameCount The number of frames that can be in flight at the same time.
+	/// Must be at least 2.
+	/// \exception std::logic_error if frameSize is 0, frameCount is smaller than 2
+	/// or the device has no queue that supports transfer operations.
+	ReadbackRing(const Device& dev, vk::DeviceSize frameSize, unsigned int frameCount = 3);
+	~ReadbackRing();
+
+	ReadbackRing(ReadbackRing&& rhs) noexcept { swap(*this, rhs); }
+	ReadbackRing& operator=(ReadbackRing rhs) noexcept { swap(*this, rhs); return *this; }
+
+	/// Adds a copy of the given buffer range to the current frame.
+	/// The given callback will be called with the data once the copy has finished.
+	/// The given buffer must have the transferSrc usage bit and remain valid until
+	/// the frame was submitted and finished.
+	/// Returns false (and does nothing) if the current frame has not enough space left.
+	bool read(vk::Buffer src, vk::DeviceSize offset, vk::DeviceSize size, Callback callback);
+
+	/// Submits the copies of the current frame and makes the next frame current.
+	/// Only blocks if the next frame is still in flight, i.e. if all frames
+	/// are in flight. Then waits for it and calls its callbacks.
+	/// Has no effect if no copies were added to the current frame.
+	void submit();
+
+	/// Calls the callbacks of all frames that have finished execution and
+	/// makes them available again. Never blocks.
+	/// Returns the number of completed frames.
+	unsigned int poll();
+
+	/// Waits for all submitted frames and calls their callbacks.
+	void wait();
+
+	vk::DeviceSize frameSize() const { return frameSize_; }
+	unsigned int frameCount() const { return frames_.size(); }
+	const Buffer& buffer() const { return buffer_; }
+
+	friend void swap(ReadbackRing& a, ReadbackRing& b) noexcept;
+
+protected:
+	struct Copy {
+		vk::Buffer src;
+		vk::BufferCopy region;
+		Callback callback;
+	};
+
+	struct Frame {
+		vk::DeviceSize used {};
+		std::vector<Copy> copies;
+		std::unique_ptr<CommandWork<void>> work; // set while in flight
+	};
+
+	void complete(Frame& frame);
+
+protected:
+	Buffer buffer_;
+	MemoryMapView map_;
+	vk::DeviceSize frameSize_ {};
+	std::vector<Frame> frames_;
+	unsigned int current_ {};
+	const Queue* queue_ {};
+	int queueFamily_ {};
+};
+
+} // namespace vpp
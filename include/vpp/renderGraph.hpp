@@ -0,0 +1,208 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <vpp/fwd.hpp>
+#include <vpp/resource.hpp> // vpp::Resource
+#include <vpp/barrier.hpp> // vpp::Access, vpp::AccessBarrier
+#include <vpp/image.hpp> // vpp::ImageView
+#include <vpp/renderPass.hpp> // vpp::RenderPass
+#include <vpp/framebuffer.hpp> // vpp::Framebuffer
+#include <vpp/vulkan/structs.hpp> // vk::ClearValue
+
+#include <functional> // std::function
+#include <optional> // std::optional
+#include <memory> // std::unique_ptr
+#include <string> // std::string
+#include <vector> // std::vector
+
+namespace vpp {
+
+/// Describes an image created and owned by a RenderGraph.
+struct GraphImageInfo {
+	vk::Format format {};
+	vk::Extent2D extent {};
+	vk::SampleCountBits samples {vk::SampleCountBits::e1};
+	vk::ImageUsageFlags usage {}; // additional usage, the usage of the passes is added
+};
+
+/// Frame graph of render and compute passes that are recorded into one command buffer.
+/// Passes declare the images they use and how they use them. On compilation,
+/// the graph culls passes whose results are never used, creates the transient images
+/// (aliasing the memory of images whose lifetimes do not overlap), the render passes
+/// and derives all barriers and layout transitions between the passes.
+/// Recording the compiled graph then only records the precomputed barriers, begins
+/// the render passes and calls the passes' record functions, so it can cheaply be
+/// done every frame or once into a prerecorded command buffer.
+///
+/// Passes are executed in the order they were added, a pass sees the results of
+/// all previously added passes. Transient images are undefined at the beginning of
+/// each execution. External images (e.g. the images sampled by a SwapchainRenderer's
+/// render pass) have a known initial and final access, they must be bound before
+/// recording. Passes are executed on the queue of the command buffer they are
+/// recorded into, the graph only checks that it supports all passes.
+/// To use it with a SwapchainRenderer, record it from RendererBuilder::beforeRender.
+///
+/// All pass and image ids are indices in the order they were added.
+/// The graph is not synchronized in any way.
+class RenderGraph : public Resource {
+public:
+	using RecordFunc = std::function<void(vk::CommandBuffer)>;
+
+public:
+	RenderGraph() = default;
+	RenderGraph(const Device&);
+	~RenderGraph();
+
+	RenderGraph(RenderGraph&& rhs) noexcept { swap(*this, rhs); }
+	RenderGraph& operator=(RenderGraph rhs) noexcept { swap(*this, rhs); return *this; }
+
+	/// Adds an image that is created by the graph on compilation.
+	/// Images that are not used by any (not culled) pass are not created.
+	unsigned int addImage(const GraphImageInfo&);
+
+	/// Adds an image that is not owned by the graph and must be bound before recording.
+	/// \param initial How the image was accessed before the graph is executed.
+	/// Its contents are discarded if the layout is undefined.
+	/// \param final How the image will be accessed after the graph was executed.
+	/// The graph transitions the image into the final layout.
+	/// \param range The subresources the graph accesses and transitions,
+	/// all subresources of the image by default.
+	unsigned int addExternal(vk::Format, const vk::Extent2D&, const Access& initial,
+		const Access& final, std::optional<vk::ImageSubresourceRange> range = {});
+
+	/// Adds a pass. The given record function is called with the command buffer
+	/// when the pass is recorded, inside its render pass if it has attachments.
+	/// \param queue The queue capabilities the pass needs. Passes with attachments
+	/// always need graphics capabilities.
+	unsigned int addPass(std::string name, vk::QueueFlags queue, RecordFunc);
+
+	/// Adds the given image as color attachment to the given pass.
+	/// If a clear value is given, it will be cleared when the render pass begins.
+	void color(unsigned int pass, unsigned int image, std::optional<vk::ClearValue> = {});
+
+	/// Adds the given image as depth (and stencil) attachment to the given pass.
+	void depth(unsigned int pass, unsigned int image, std::optional<vk::ClearValue> = {});
+
+	/// Declares that the given pass samples the given image in the given stages.
+	void sampled(unsigned int pass, unsigned int image,
+		vk::PipelineStageFlags = vk::PipelineStageBits::fragmentShader);
+
+	/// Declares any other access of the given image by the given pass,
+	/// e.g. as storage image or by transfer commands.
+	/// \exception std::logic_error if the pass already uses the image in a different layout.
+	void access(unsigned int pass, unsigned int image, const Access&);
+
+	/// Compiles the graph. Has to be called again when passes or images were added.
+	/// Destroys all previously created images, render passes and framebuffers.
+	/// \param queueFlags The capabilities of the queue family the graph will
+	/// be recorded for.
+	/// \exception std::logic_error if a pass needs capabilities the queue family
+	/// does not have or has attachments of different sizes.
+	void compile(vk::QueueFlags queueFlags = allQueueBits);
+
+	/// Binds the image (and view, if it is used as attachment) of an external image.
+	/// Binding a different view destroys the cached framebuffers of the passes
+	/// using the image as attachment, so command buffers recorded with the previous
+	/// view must have completed execution and must not be submitted again.
+	/// To prerecord command buffers for multiple views (e.g. the images of a
+	/// swapchain), use one graph per view.
+	void bind(unsigned int image, vk::Image, vk::ImageView = {});
+
+	/// Records the compiled graph into the given command buffer.
+	/// The framebuffers for the bound external image views are cached until
+	/// a different view is bound or the graph is compiled again.
+	void record(vk::CommandBuffer);
+
+	/// Returns the render pass of the given pass, e.g. for pipeline creation.
+	/// Only valid after compilation, null if the pass has no attachments or was culled.
+	vk::RenderPass renderPass(unsigned int pass) const;
+
+	/// Returns the extent of the attachments of the given pass.
+	vk::Extent2D extent(unsigned int pass) const;
+
+	/// Returns whether the given pass was culled on compilation.
+	bool culled(unsigned int pass) const;
+
+	/// Returns the (created or bound) image and view of the given image.
+	vk::Image image(unsigned int image) const;
+	vk::ImageView imageView(unsigned int image) const;
+
+	/// Returns the size of the memory allocated for all images of the graph.
+	vk::DeviceSize memorySize() const;
+
+	friend void swap(RenderGraph& a, RenderGraph& b) noexcept;
+
+protected:
+	enum class Attachment {
+		none,
+		color,
+		depth
+	};
+
+	struct Use {
+		unsigned int image;
+		Access access;
+		Attachment attachment {Attachment::none};
+		std::optional<vk::ClearValue> clear;
+	};
+
+	// barrier recorded before a pass, for an image or just an execution dependency
+	struct Barrier {
+		unsigned int image;
+		AccessBarrier barrier; // recorded for the image's range
+	};
+
+	struct ImageEntry {
+		bool external {};
+		GraphImageInfo info;
+		Access initial;
+		Access final;
+		vk::ImageAspectFlags aspect {};
+		vk::ImageSubresourceRange range {};
+
+		vk::Image image {};
+		vk::ImageView view {};
+		bool owned {};
+		ImageView ownedView;
+
+		// in the execution order of the compiled graph
+		unsigned int first {};
+		unsigned int last {};
+		unsigned int memory {};
+		vk::DeviceSize offset {};
+		vk::DeviceSize size {};
+	};
+
+	struct Pass {
+		std::string name;
+		vk::QueueFlags queue;
+		RecordFunc record;
+		std::vector<Use> uses;
+
+		bool culled {};
+		std::vector<Barrier> barriers;
+		RenderPass renderPass;
+		vk::Extent2D extent {};
+		std::vector<unsigned int> attachments;
+		std::vector<vk::ClearValue> clearValues;
+		Framebuffer framebuffer; // for the currently bound views
+	};
+
+	Use& use(unsigned int pass, unsigned int image, const Access&);
+	void destroy();
+	void createImages();
+	void createRenderPass(Pass&, unsigned int index, const std::vector<AccessState>& states);
+	vk::Framebuffer framebuffer(Pass&);
+
+protected:
+	std::vector<ImageEntry> images_;
+	std::vector<Pass> passes_;
+	std::vector<unsigned int> order_;
+	std::vector<Barrier> finalBarriers_;
+	std::vector<std::unique_ptr<DeviceMemory>> memories_;
+};
+
+} // namespace vpp
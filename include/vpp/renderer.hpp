@@ -9,7 +9,9 @@
 #include <vpp/framebuffer.hpp>
 #include <vpp/renderPass.hpp>
 #include <vpp/image.hpp>
+#include <vpp/sync.hpp>
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -46,6 +48,12 @@ public:
 	/// Will be called to record additional command buffer commands before rendering.
 	virtual void beforeRender(vk::CommandBuffer) {};
 
+	/// Will be called after beforeRender to add the barriers needed before rendering,
+	/// e.g. the layout transitions of all sampled images, to the given batch.
+	/// They are recorded with one pipeline barrier before the render pass begins.
+	/// \param id The id of the current render buffer.
+	virtual void barriers(unsigned int, BarrierBatch&) {};
+
 	/// Will be called to record additional command buffer commands after rendering.
 	virtual void afterRender(vk::CommandBuffer) {};
 
@@ -104,6 +112,10 @@ public:
 		// terms of memory allocation
 		unsigned int maxWidth = 1920;
 		unsigned int maxHeight = 1080;
+
+		// the maximum number of frames that can be rendered at the same time, i.e.
+		// how many frames the cpu can be ahead of the device before render blocks
+		unsigned int framesInFlight = 2;
 	};
 
 	/// The RenderBuffer class hold a framebuffer for each swapChain image as well a
@@ -115,10 +127,17 @@ public:
 	struct RenderBuffer {
 		Framebuffer framebuffer;
 		CommandBuffer commandBuffer;
+		vk::Fence fence {}; // fence of the frame that last submitted the commandBuffer
 	};
 
-	/// Convinience typedef for the rendering work and presentation work.
-	using RenderWork = std::unique_ptr<Work<void>>;
+	/// The synchronization primitives for one frame in flight.
+	/// They are created once and reused for every framesInFlight-th frame.
+	struct Frame {
+		Semaphore acquire; // signaled when the swapchain image was acquired
+		Semaphore render; // signaled when rendering finished, waited for by present
+		Fence fence; // signaled when rendering finished
+		bool submitted {}; // whether fence was submitted since the last reset
+	};
 
 	/// Typedef for the renderer builder implementation.
 	using RenderImpl = std::unique_ptr<RendererBuilder>;
@@ -137,26 +156,39 @@ public:
 	/// Initialized all attachments and creates the vulkan framebuffers.
 	void init(RenderImpl builder);
 
-	/// Renders one frame and returns after that. May block (waiting for the next present image)
-	/// depending on the settings of the given swapChain.
+	/// Renders one frame and returns after the commands were submitted.
+	/// Only blocks if there are already CreateInfo::framesInFlight frames
+	/// being rendered (until the oldest one finished) or while waiting for the
+	/// next present image (at most for the given timeout).
 	/// The queue paramters are optional. If they are nullptr, a queue will automatically be selected.
 	/// \param presentQueue The queue to submit the present commands to.
 	/// \param graphicsQueue The queue to submit the graphics commands to.
 	/// Will choose just some queue with graphics flags from the device if nullptr.
+	/// \param timeout The maximum time in nanoseconds to wait for the next present image.
 	/// \exception std::logic_error If a valid present or graphics queue cannot be found or if
 	/// the family of the grahpics queue is not compatible with the recorded command buffers.
-	/// \return A Work pointer that can be used to track the state or wait for the rendering
-	/// to finish.
-	RenderWork render(const Queue& present, const Queue* graphics = nullptr);
+	/// \return The result of acquiring the next image if it was not successful
+	/// (e.g. timeout or outOfDate), nothing is rendered in this case.
+	/// Otherwise the result of presenting the image.
+	vk::Result render(const Queue& present, const Queue* graphics = nullptr,
+		std::uint64_t timeout = UINT64_MAX);
 
 	/// Renders one frame and waits until all rendering operations are finished.
+	/// Should only be used if the frame has to be finished before continuing,
+	/// render allows the cpu to work on the next frames in the meantime.
 	/// The queue paramters are optional. If they are nullptr, a queue will automatically be selected.
 	/// \param presentQueue The queue to submit the present commands to.
 	/// \param graphicsQueue The queue to submit the graphics commands to.
 	/// Will choose just some queue with graphics flags from the device if nullptr.
 	/// \exception std::logic_error If a valid present or graphics queue cannot be found or if
 	/// the family of the grahpics queue is not compatible with the recorded command buffers.
-	void renderBlock(const Queue& present, const Queue* graphics = nullptr);
+	/// \return The same as render.
+	vk::Result renderBlock(const Queue& present, const Queue* graphics = nullptr);
+
+	/// Waits until all frames in flight have finished rendering.
+	/// Must be called before resources used by the recorded commands are changed
+	/// or destroyed. Called by recreate and the destructor.
+	void wait();
 
 	/// Calls the builder to build the commandBuffer with the given id.
 	/// \param id The id of the render buffer to (re)record. If it is -1, all buffers will be recorded.
@@ -184,6 +216,8 @@ protected:
 	std::vector<RenderBuffer> renderBuffers_;
 	std::vector<ViewableImage> staticAttachments_;
 	CreateInfo info_;
+	std::vector<Frame> frames_;
+	unsigned int frame_ {}; // the frame used next
 };
 
 } // namespace vpp
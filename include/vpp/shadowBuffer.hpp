@@ -0,0 +1,80 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <vpp/fwd.hpp>
+#include <vpp/resource.hpp> // vpp::ResourceReference
+#include <vpp/work.hpp> // vpp::WorkPtr
+#include <vpp/util/span.hpp> // nytl::Span
+
+#include <vector> // std::vector
+
+namespace vpp {
+
+/// Keeps a host shadow copy of a buffer and uploads only the pages of it that
+/// changed since the last upload. Meant for large, mostly static buffers that
+/// change only slightly between uploads.
+/// Changes can be marked explicitly (write, markDirty) or detected on upload by
+/// comparing the shadow copy with a copy of the last uploaded state, which
+/// doubles the host memory needed.
+/// All dirty pages are uploaded with a single copy command with one region per range
+/// of adjacent dirty pages or, if the buffer is mappable, written directly.
+/// Not synchronized in any way.
+class ShadowBuffer : public ResourceReference<ShadowBuffer> {
+public:
+	ShadowBuffer() = default;
+
+	/// \param buffer The buffer to upload to. Must be mappable or have the
+	/// transferDst usage bit set. Must remain valid for the lifetime of this object.
+	/// \param size The size of the buffer range to shadow, starting at offset 0.
+	/// \param pageSize The granularity in which changes are detected and uploaded.
+	/// Smaller pages mean less uploaded data but more copy regions.
+	/// \param compare Whether to detect changes by comparing against the last
+	/// uploaded state. Otherwise only explicitly marked changes are uploaded.
+	/// The initial contents of the shadow copy are zero and considered uploaded.
+	ShadowBuffer(const Buffer& buffer, std::size_t size, std::size_t pageSize = 4096,
+		bool compare = true);
+	~ShadowBuffer() = default;
+
+	ShadowBuffer(ShadowBuffer&& rhs) noexcept { swap(*this, rhs); }
+	ShadowBuffer& operator=(ShadowBuffer rhs) noexcept { swap(*this, rhs); return *this; }
+
+	/// Returns the shadow copy. Changes to it are only uploaded if they
+	/// are detected by comparison or explicitly marked dirty.
+	nytl::Span<uint8_t> data() { return shadow_; }
+	nytl::Span<const uint8_t> data() const { return shadow_; }
+
+	/// Copies the given data into the shadow copy at the given offset and marks
+	/// the range dirty.
+	void write(std::size_t offset, nytl::Span<const uint8_t> data);
+
+	/// Explicitly marks the given range of the shadow copy as changed.
+	void markDirty(std::size_t offset, std::size_t size);
+
+	/// Uploads all dirty (and, if enabled, all changed) pages to the buffer.
+	/// The returned work must be finished before the buffer is used by the device.
+	/// If nothing changed, returns an already finished work.
+	WorkPtr upload();
+
+	/// Returns the number of pages that are currently marked dirty.
+	/// Does not include pages whose changes would be detected by comparison.
+	std::size_t dirtyPages() const;
+
+	std::size_t pageSize() const { return pageSize_; }
+	std::size_t size() const { return shadow_.size(); }
+	const Buffer& buffer() const { return *buffer_; }
+	const Buffer& resourceRef() const { return *buffer_; }
+
+	friend void swap(ShadowBuffer& a, ShadowBuffer& b) noexcept;
+
+protected:
+	const Buffer* buffer_ {};
+	std::size_t pageSize_ {};
+	std::vector<uint8_t> shadow_;
+	std::vector<uint8_t> uploaded_; // last uploaded state, only with compare
+	std::vector<bool> dirty_; // explicitly dirty pages
+};
+
+} // namespace vpp
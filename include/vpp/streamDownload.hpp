@@ -0,0 +1,35 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <vpp/fwd.hpp>
+#include <vpp/util/stringParam.hpp> // nytl::StringParam
+
+namespace vpp {
+
+/// Default chunk size used by retrieveToFile.
+constexpr vk::DeviceSize defaultStreamChunkSize = 8 * 1024 * 1024;
+
+/// Streams the contents of the given buffer range into the file at the given path.
+/// In comparison to retrieving the whole buffer and writing it with writeFile this
+/// only needs stagingCount * chunkSize bytes of host visible memory and overlaps
+/// the device copy of the next chunk with writing the previous chunk to disk (on
+/// a separate thread). Meant for large buffers, e.g. checkpoints or snapshots.
+/// Blocks until all data was written. An existing file at the given path is overwritten.
+/// If the buffer is mappable, the data is directly written from its memory.
+/// \param size The size of the range to write. If size is vk::wholeSize (default) the range
+/// from offset until the end of the buffer will be written.
+/// \param chunkSize The size of the chunks the range is copied and written in.
+/// Must not be 0.
+/// \param stagingCount The number of staging buffers (each chunkSize bytes).
+/// Must be at least 2 for the copies and writes to overlap.
+/// \exception std::runtime_error if the file cannot be opened or written.
+/// \exception std::logic_error if chunkSize or stagingCount is 0 or the device has
+/// no queue that supports transfer operations.
+void retrieveToFile(const Buffer& buf, nytl::StringParam path, vk::DeviceSize offset = 0,
+	vk::DeviceSize size = vk::wholeSize, vk::DeviceSize chunkSize = defaultStreamChunkSize,
+	unsigned int stagingCount = 2);
+
+} // namespace vpp
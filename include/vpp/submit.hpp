@@ -6,22 +6,57 @@
 
 #include <vpp/fwd.hpp>
 #include <vpp/resource.hpp>
+#include <vpp/sync.hpp> // vpp::Semaphore
+#include <vpp/vulkan/enums.hpp>
 #include <vpp/util/span.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
 #include <vector>
 #include <mutex>
+#include <thread>
 
 namespace vpp {
 
 /// Responsible for synchronizing submissions to the device.
 /// In vulkan, submitting work to the device is a pretty heavy operation and must be synchronized
-/// (e.g. there should always only be one thread calling vkQueueSubmit no matter on which queue).
+/// (vkQueueSubmit must not be called from multiple threads for the same queue at once).
 /// This class manages these submissions and also batches mulitple command buffers together.
+/// Every queue has its own lane: adding submissions to it is lock-free and submitting
+/// only locks the lane and its queue (see QueueLock), so submissions to different
+/// queues don't block each other. Optionally, a dedicated thread submits the
+/// pending submissions, see startThread.
+/// When pending submissions are submitted without being explicitly requested
+/// can be configured per queue, see FlushPolicy.
 /// There is always only one SubmitManager for a vulkan device and if vkQueueSumit is called
-/// maually, it must be assured that no other thread calls this function or uses the submitManager
-/// for the same device at the same time.
+/// maually, the queue must be locked.
 /// See also the Queue class for more on queue and submission synchronization.
 class SubmitManager : public Resource {
+public:
+	/// When the pending submissions of a queue are submitted automatically.
+	/// Waiting for pending submissions to batch them trades a bounded delay
+	/// for fewer vkQueueSubmit calls. Submissions are always submitted when
+	/// explicitly requested (e.g. by waiting for them), independent of the policy.
+	/// Without any limit (the default), pending submissions are only submitted on request
+	/// or immediately by the submission thread, if it is running.
+	struct FlushPolicy {
+		/// Submit as soon as at least this many command buffers are pending.
+		/// 0 for no limit.
+		unsigned int commandBuffers {};
+
+		/// Submit as soon as the oldest pending submission was added this long ago.
+		/// Only checked when submissions are added and by the submission thread,
+		/// so without a running thread, the delay is not bounded. 0 for no limit.
+		std::chrono::microseconds age {};
+
+		/// Whether to submit pending submissions on endFrame.
+		bool frame {true};
+	};
+
 public:
 	/// Submits all CommandBuffers in the submission queue.
 	/// Is the same as calling submit with all queues that have pending submissions.
@@ -32,6 +67,7 @@ public:
 
 	/// Adds a given vulkan submit info for exection of a commandBuffer on the given queue.
 	/// Note that this function does not directly submits the given info.
+	/// Does not lock, i.e. never waits for other threads submitting.
 	/// All pointers in the vk::SubmitInfo must remain valid until the submission gets
 	/// submitted to the device (which can be assured by using an passed CommandExecutionState
 	/// or calling submit on this SubmitManager).
@@ -53,18 +89,131 @@ public:
 	/// Moves the given CommandExeuctionState observer to another object.
 	/// Usually not called manually, triggered by the CommandExeuctionState move
 	/// constructor and assignment operator.
+	/// Since the submission might be submitted by another thread at the same time,
+	/// this also sets the value of the new state, with the queue's lane locked.
 	void moveStateObserver(const CommandExecutionState& old, CommandExecutionState& newOne);
 
+	/// Makes the submission of the given pending state wait for the submission of
+	/// the given dependency. Usually not called manually, prefer to use
+	/// CommandExecutionState::dependsOn.
+	/// Submissions to the same queue are ordered so that the dependency is submitted
+	/// before (or in the same batch), its commands are expected to contain the needed
+	/// pipeline barriers. A later dependency is moved in front of the state,
+	/// together with the pending submissions it depends on; the order of all
+	/// other submissions stays the same. For submissions to different queues, the dependency is submitted
+	/// before the dependent submission which then waits for a semaphore signaled by it
+	/// (the queues timeline semaphore if available).
+	/// If the dependency was already submitted without a semaphore this can wait for,
+	/// waits for it on the cpu.
+	/// Submitting a submission only submits the pending submissions of other
+	/// queues up to the ones it depends on, so queues may depend on each
+	/// other in both directions. Dependencies between submissions must not form cycles.
+	/// \exception std::logic_error if the state is not pending or the dependency
+	/// would form a cycle with the pending submissions of the same queue.
+	void addDependency(const CommandExecutionState& state,
+		const CommandExecutionState& dependency, vk::PipelineStageFlags waitStages);
+
+	/// Every submission to a queue is associated with a value, the values
+	/// of the submissions to a queue are increasing, starting with 1.
+	/// Returns the value of the last submission to the given queue that has completed
+	/// execution. If update is false, only returns the last queried value, otherwise
+	/// queries the device.
+	std::uint64_t completed(const vpp::Queue&, bool update = true);
+
+	/// Waits until the submission with the given value to the given queue has completed
+	/// execution or the given timeout in nanoseconds has elapsed.
+	/// Returns whether the submission has completed.
+	bool wait(const vpp::Queue&, std::uint64_t value, std::uint64_t timeout = ~std::uint64_t(0));
+
+	/// Waits until all (or any, if all is false) of the given states have completed
+	/// execution or the given timeout in nanoseconds has elapsed.
+	/// Only needs one vkWaitForFences or vkWaitSemaphoresKHR call for all of them.
+	/// States that were not yet submitted are submitted, null and invalid states are
+	/// ignored. Returns whether the condition was met, true if there was
+	/// nothing to wait for.
+	bool wait(nytl::Span<CommandExecutionState* const>, bool all = true,
+		std::uint64_t timeout = ~std::uint64_t(0));
+
+	/// Returns the timeline semaphore that is signaled with the values of the
+	/// submissions to the given queue. Returns a nullHandle if timeline semaphores
+	/// are not used.
+	vk::Semaphore semaphore(const vpp::Queue&);
+
+	/// Returns whether submissions are tracked with one timeline semaphore per queue.
+	/// This is the case if the device was created with the VK_KHR_timeline_semaphore
+	/// extension and feature enabled, see Device::timelineSemaphores.
+	/// Otherwise every submission uses a fence, which are reused.
+	bool timelineSemaphores() const { return getCounterValue_ != nullptr; }
+
+	/// Starts a thread that submits pending submissions as defined by the
+	/// FlushPolicy of their queue, so that threads adding submissions never
+	/// wait for vkQueueSubmit. Submissions added while the
+	/// thread submits are batched into its next vkQueueSubmit call.
+	/// Submissions can still be submitted explicitly, e.g. by waiting for them.
+	/// \param latency The maximum time the thread sleeps before checking
+	/// for new submissions.
+	/// Has no effect if the thread is already running.
+	/// Must not be called at the same time as stopThread.
+	void startThread(std::chrono::nanoseconds latency = std::chrono::milliseconds(1));
+
+	/// Stops the submission thread, if running. The submissions pending on
+	/// the lanes are not submitted by this.
+	void stopThread();
+
+	/// Returns whether the submission thread is running.
+	bool threaded() const { return threaded_; }
+
+	/// Sets or returns the flush policy for the given queue.
+	/// When the limits of the policy are reached in add, the submissions are submitted
+	/// by the submission thread or, if it is not running, by the thread calling add.
+	void flushPolicy(const vpp::Queue&, const FlushPolicy&);
+	FlushPolicy flushPolicy(const vpp::Queue&);
+
+	/// Marks a frame boundary, i.e. submits the pending submissions of all
+	/// queues whose FlushPolicy has frame set.
+	void endFrame();
+
 protected:
 	struct Submission;
+	struct Dependency;
+	struct Wait;
+	struct Lane;
 	friend class Device;
 
 	SubmitManager(const Device& dev);
 	~SubmitManager();
 
+	// shared value of a submission, 0 while it is pending
+	using SubmissionValue = std::shared_ptr<std::atomic<std::uint64_t>>;
+
+	Lane& lane(const vpp::Queue&);
+
+	// submits all pending submissions of the lane or only those up to
+	// the one with the given value
+	void submit(Lane&, const std::atomic<std::uint64_t>* until = {});
+	void submitLocked(Lane&, std::size_t count); // expects the lanes mutex to be locked
+	void drain(Lane&); // moves the lock-free intake to the pending submissions
+	// moves the pending submission at dep (and the ones between it and pos
+	// it depends on) before the one at pos, expects the lanes mutex to be locked
+	void moveBefore(Lane&, std::size_t pos, std::size_t dep);
+	void update(Lane&); // expects the lanes mutex to be locked
+	bool due(const Lane&, bool threaded) const; // whether the flush policy is met
+	void run(); // submission thread
+
 protected:
-	std::vector<Submission> pending_;
-	std::mutex mutex_; // internal mutex
+	std::deque<Lane> lanes_; // one per queue, created on construction
+	std::vector<Semaphore> semaphores_; // unused binary semaphores for dependencies
+	std::mutex mutex_; // for semaphores_
+
+	std::thread thread_;
+	std::mutex threadMutex_;
+	std::condition_variable threadCv_;
+	std::chrono::nanoseconds latency_ {};
+	bool stop_ {};
+	std::atomic<bool> threaded_ {};
+
+	vk::PfnVoidFunction getCounterValue_ {}; // vkGetSemaphoreCounterValueKHR
+	vk::PfnVoidFunction waitSemaphores_ {}; // vkWaitSemaphoresKHR
 };
 
 /// Can be used to track the state of a queued command buffer.
@@ -72,9 +221,12 @@ protected:
 /// to the device or wait for them to complete execution.
 /// Created with default constructor and then passed to SubmitManager when
 /// adding a pending command buffer submission.
-/// Internally uses a shared fence pointer as soon as the command buffers are submitted
-/// since multiple CommandExeuctionState objects might be associated with the
-/// same fence.
+/// As soon as the command buffers are submitted, only stores the value of the
+/// submission on its queue (see SubmitManager::completed), so checking
+/// for completion is just a comparison with the last completed value of the queue.
+/// Use wait or completed to check for completion on the host, or
+/// SubmitManager::semaphore for the queue together with value to wait for
+/// the submission on the device.
 class CommandExecutionState {
 public:
 	CommandExecutionState(); // = default
@@ -87,6 +239,13 @@ public:
 	/// Will have no effect if they were already submitted.
 	void submit();
 
+	/// Makes the associated command buffers wait for the ones associated with the given
+	/// state in the given stages, see SubmitManager::addDependency.
+	/// Submitting this state will submit the given one as well, without
+	/// waiting on the cpu. Must only be called before this state is submitted.
+	void dependsOn(const CommandExecutionState&,
+		vk::PipelineStageFlags waitStages = vk::PipelineStageBits::allCommands);
+
 	/// Waits until execution of the associated command buffers has finished.
 	/// Has no effect and returns immediatly if they already have finished.
 	/// Will submit them if they are not already submitted.
@@ -99,7 +258,8 @@ public:
 	bool wait(std::uint64_t timeout = ~std::uint64_t(0));
 
 	/// Returns whether the associated command buffers were submitted to the device.
-	bool submitted() const;
+	/// Can be called while they are submitted by another thread.
+	bool submitted() const { return value_ != 0; }
 
 	/// Returns whether the associated command buffers have finished their
 	/// execution on the device.
@@ -111,23 +271,24 @@ public:
 	/// Is invalid if only defaulted constructed and valid if it was
 	/// passed to a SubmitManager when adding a submission.
 	/// Will return true even if the associated command buffers have finished.
-	bool valid() const { return (submitManager_ || completed_ || fence_); }
+	bool valid() const { return (submitManager_ || completed_); }
 
-	/// Returns the fence associated with the exeuction of the associated command buffers.
-	/// If this object is invalid, the associated command buffers were not yet submitted or
-	/// have already finished returns a nullHandle.
-	vk::Fence fence() const;
+	/// Returns the queue the associated command buffers are submitted to.
+	const vpp::Queue* queue() const { return queue_; }
+
+	/// Returns the value of the submission on its queue or 0 if the command
+	/// buffers were not yet submitted. When timeline semaphores are used,
+	/// SubmitManager::semaphore for the queue is signaled with this value on completion.
+	std::uint64_t value() const { return value_; }
 
 protected:
 	friend class SubmitManager;
-	void init(SubmitManager&);
+	void init(SubmitManager&, const vpp::Queue&);
 
 	SubmitManager* submitManager_ {};
-
-	// mutable since changed by completed(), used as cache
-	mutable std::shared_ptr<Fence> fence_ {};
-	mutable bool completed_ {};
+	const vpp::Queue* queue_ {};
+	std::atomic<std::uint64_t> value_ {}; // set by the submitting thread
+	mutable bool completed_ {}; // mutable since changed by completed(), used as cache
 };
 
-
 } // namespace vpp
@@ -13,6 +13,7 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <cstdint>
 
 namespace vpp {
 
@@ -119,10 +120,15 @@ public:
 	/// \param sem Semaphore to be signaled when acquiring is complete or nullHandle.
 	/// \param fence Fence to be signaled when acquiring is complete or nullHandle.
 	/// \param id Will be set to the id of the newly acquired image.
+	/// \param timeout The maximum time in nanoseconds to wait for an image to become
+	/// available. If it is 0, the function does not block.
 	/// \return The result returned by vkAcquireImageKHR. The caller has to handle
 	/// results like outOfDate or suboptimal and can decide if to recreate (resize()) the
-	/// swapChain. There will not be any check performed on the result.
-	vk::Result acquire(unsigned int& id, vk::Semaphore sem = {}, vk::Fence fence = {}) const;
+	/// swapChain. If no image was available in time, timeout (or notReady if the
+	/// given timeout was 0) is returned and id is not changed.
+	/// There will not be any check performed on the result.
+	vk::Result acquire(unsigned int& id, vk::Semaphore sem = {}, vk::Fence fence = {},
+		std::uint64_t timeout = UINT64_MAX) const;
 
 	/// Queues commands to present the image with the given id on the given queue.
 	/// Will temporarily acquire ownership over the given queue.
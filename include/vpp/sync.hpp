@@ -2,6 +2,8 @@
 // Distributed under the Boost Software License, Version 1.0.
 // See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
 
+#pragma once
+
 #include <vpp/fwd.hpp>
 #include <vpp/resource.hpp>
 
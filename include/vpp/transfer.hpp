@@ -51,7 +51,9 @@ public:
 	TransferManager(const Device& dev);
 
 	/// Returns an avaible upload buffer with the given size (allocates one if not already there).
-	BufferRange buffer(std::size_t size);
+	/// The offset of the returned range is a multiple of the given alignment, which
+	/// is needed e.g. for buffer image copies (multiple of the texel block size and 4).
+	BufferRange buffer(std::size_t size, std::size_t alignment = 16);
 
 	/// Returns the amount of vulkan buffers managed.
 	std::size_t bufferCount() const { return buffers_.size(); }
@@ -79,7 +81,7 @@ public:
 
 		const Buffer& buffer() const { return buffer_; }
 
-		Allocation use(std::size_t size);
+		Allocation use(std::size_t size, std::size_t alignment = 1);
 		bool release(const Allocation& alloc);
 		std::size_t rangesCount() const { return ranges_.size(); }
 
@@ -87,6 +89,7 @@ public:
 
 	protected:
 		Buffer buffer_;
+		std::size_t size_ {};
 		std::vector<Allocation> ranges_;
 		std::mutex& mutex_;
 	};
@@ -43,6 +43,20 @@ public:
 	virtual void finish() = 0; // will block until the work has completed and finish it
 	virtual State state() = 0; // returns the current state of the work
 
+	/// Makes this work depend on the given work, i.e. this work will only be
+	/// executed after the given one. Must be called before this work is submitted.
+	/// If both are device submissions (see commandState), the dependency is
+	/// resolved on the device (see CommandExecutionState::dependsOn) and submitting
+	/// this work will submit the given work as well, without waiting on the cpu.
+	/// Otherwise waits for the given work.
+	/// \param waitStages The stages of this work that have to wait.
+	virtual void dependsOn(WorkBase& other,
+		vk::PipelineStageFlags waitStages = vk::PipelineStageBits::allCommands);
+
+	/// Returns the state of the device submission this work represents, if any.
+	/// Used to resolve dependencies.
+	virtual CommandExecutionState* commandState() { return nullptr; }
+
 	bool pending() { return state() == State::pending; }
 	bool submitted() { return static_cast<unsigned int>(state()) > 1; }
 	bool executed() { return static_cast<unsigned int>(state()) > 2; }
@@ -109,6 +123,7 @@ public:
 	virtual void finish() override;
 	virtual void wait() override;
 	virtual WorkBase::State state() override;
+	virtual CommandExecutionState* commandState() override { return &executionState_; }
 
 	CommandBuffer& commandBuffer() { return cmdBuffer_; }
 	const CommandBuffer& commandBuffer() const { return cmdBuffer_; }
@@ -123,7 +138,8 @@ protected:
 
 /// Manages (i.e. submits and waits) for multiple work objects.
 /// On desctruction this call will automatically finish all owned work objects.
-/// The work objects are always finished in the same order that they were added.
+/// finish finishes the work objects in the same order that they were added,
+/// poll finishes them in the order they complete.
 /// Can be really useful when postponing multiple work batches together and not expliclity
 /// finish them until end of initialization which can result in better performance.
 class WorkManager {
@@ -144,9 +160,28 @@ public:
 	void submit();
 
 	/// Finished all owned work objects.
+	/// Waits for all of them at once before finishing them.
 	/// This function might block.
 	void finish();
 
+	/// Waits until all (or any, if all is false) owned work objects were executed or the
+	/// given timeout in nanoseconds elapsed. Waits for all command submissions with
+	/// one call per device (see SubmitManager::wait), other work objects are waited
+	/// for separately. When waiting for all, the timeout applies to every device.
+	/// When waiting for any with command submissions to multiple devices, only
+	/// the submissions to the first device are waited for with the timeout.
+	/// Submits all owned work objects. Returns whether the condition was met.
+	bool wait(bool all = true, std::uint64_t timeout = ~std::uint64_t(0));
+
+	/// Finishes all owned work objects that were already executed, independent of
+	/// the order they were added in, so their resources are freed as early as possible.
+	/// Does not block and does not submit anything. Also removes empty entries.
+	/// Returns the number of finished work objects.
+	std::size_t poll();
+
+	/// Returns the number of owned, not yet finished work objects.
+	std::size_t size() const { return todo_.size(); }
+
 protected:
 	std::vector<std::unique_ptr<WorkBase>> todo_;
 };
@@ -0,0 +1,793 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <vpp/barrier.hpp>
+#include <vpp/vk.hpp>
+#include <vpp/util/log.hpp>
+
+#include <algorithm> // std::max, std::min, std::find_if
+#include <cstdint> // std::uint32_t
+#include <utility> // std::swap
+
+namespace vpp {
+namespace {
+
+// stages that can only be executed on queues with graphics support
+constexpr auto graphicsStages = vk::PipelineStageBits::vertexInput |
+	vk::PipelineStageBits::vertexShader |
+	vk::PipelineStageBits::tessellationControlShader |
+	vk::PipelineStageBits::tessellationEvaluationShader |
+	vk::PipelineStageBits::geometryShader |
+	vk::PipelineStageBits::fragmentShader |
+	vk::PipelineStageBits::earlyFragmentTests |
+	vk::PipelineStageBits::lateFragmentTests |
+	vk::PipelineStageBits::colorAttachmentOutput |
+	vk::PipelineStageBits::allGraphics;
+
+template<typename F>
+F without(F flags, F remove)
+{
+	return flags ^ (flags & remove);
+}
+
+unsigned int rangeEnd(unsigned int base, unsigned int count, unsigned int known)
+{
+	if(count == vk::remainingMipLevels) {
+		return std::max(known, base + 1);
+	}
+
+	return base + count;
+}
+
+vk::DeviceSize rangeEnd(vk::DeviceSize offset, vk::DeviceSize size)
+{
+	return (size == vk::wholeSize) ? vk::wholeSize : offset + size;
+}
+
+// whether the two barriers are equal in everything but their subresource range
+bool compatible(const vk::ImageMemoryBarrier& a, const vk::ImageMemoryBarrier& b)
+{
+	return a.srcAccessMask == b.srcAccessMask && a.dstAccessMask == b.dstAccessMask &&
+		a.oldLayout == b.oldLayout && a.newLayout == b.newLayout;
+}
+
+// extends the range [base, base + count) by [obase, obase + ocount) if they
+// overlap or are adjacent. A count of ~0u (remaining levels or layers) means
+// until the end. Returns false and does nothing otherwise.
+bool extend(std::uint32_t& base, std::uint32_t& count, std::uint32_t obase,
+		std::uint32_t ocount)
+{
+	constexpr auto remaining = vk::remainingArrayLayers; // same as for levels
+	auto end = [&](std::uint32_t b, std::uint32_t c) {
+		return (c == remaining) ? remaining : b + c;
+	};
+
+	auto aend = end(base, count);
+	auto bend = end(obase, ocount);
+	if(obase > aend || base > bend) {
+		return false;
+	}
+
+	base = std::min(base, obase);
+	auto nend = std::max(aend, bend);
+	count = (nend == remaining) ? remaining : nend - base;
+	return true;
+}
+
+// whether the range [obase, obase + ocount) lies in [base, base + count)
+bool contains(std::uint32_t base, std::uint32_t count, std::uint32_t obase,
+		std::uint32_t ocount)
+{
+	constexpr auto remaining = vk::remainingArrayLayers;
+	if(obase < base) {
+		return false;
+	}
+
+	if(count == remaining) {
+		return true;
+	}
+
+	return ocount != remaining && obase + ocount <= base + count;
+}
+
+// whether the given state already made its last write visible to
+// the given read, i.e. no barrier is needed for it
+bool covered(const vk::PipelineStageFlags& writeStages, const Access& state,
+		const Access& read)
+{
+	return !writeStages || (!without(read.stages, state.stages) &&
+		!without(read.access, state.access));
+}
+
+// removes the access types that can't be performed by any of the given stages
+vk::AccessFlags stageAccess(vk::AccessFlags access, vk::PipelineStageFlags stages)
+{
+	using Stage = vk::PipelineStageBits;
+	using Acc = vk::AccessBits;
+
+	if(stages & Stage::allCommands) {
+		return access;
+	}
+
+	constexpr auto shaderStages = Stage::vertexShader | Stage::tessellationControlShader |
+		Stage::tessellationEvaluationShader | Stage::geometryShader |
+		Stage::fragmentShader | Stage::computeShader;
+
+	vk::AccessFlags allowed = Acc::memoryRead | Acc::memoryWrite;
+	if(stages & Stage::allGraphics) {
+		allowed |= Acc::indirectCommandRead | Acc::indexRead | Acc::vertexAttributeRead |
+			Acc::uniformRead | Acc::shaderRead | Acc::shaderWrite |
+			Acc::inputAttachmentRead | Acc::colorAttachmentRead |
+			Acc::colorAttachmentWrite | Acc::depthStencilAttachmentRead |
+			Acc::depthStencilAttachmentWrite;
+	}
+
+	if(stages & Stage::drawIndirect) allowed |= Acc::indirectCommandRead;
+	if(stages & Stage::vertexInput) allowed |= Acc::indexRead | Acc::vertexAttributeRead;
+	if(stages & shaderStages) allowed |= Acc::uniformRead | Acc::shaderRead | Acc::shaderWrite;
+	if(stages & Stage::fragmentShader) allowed |= Acc::inputAttachmentRead;
+	if(stages & Stage::colorAttachmentOutput) {
+		allowed |= Acc::colorAttachmentRead | Acc::colorAttachmentWrite;
+	}
+	if(stages & (Stage::earlyFragmentTests | Stage::lateFragmentTests)) {
+		allowed |= Acc::depthStencilAttachmentRead | Acc::depthStencilAttachmentWrite;
+	}
+	if(stages & Stage::transfer) allowed |= Acc::transferRead | Acc::transferWrite;
+	if(stages & Stage::host) allowed |= Acc::hostRead | Acc::hostWrite;
+	if(stages & Stage::commandProcessNVX) {
+		allowed |= Acc::commandProcessReadNVX | Acc::commandProcessWriteNVX;
+	}
+
+	return access & allowed;
+}
+
+} // anonymous util namespace
+
+vk::PipelineStageFlags supportedStages(vk::PipelineStageFlags stages, vk::QueueFlags queue)
+{
+	auto ret = stages;
+	if(!(queue & vk::QueueBits::graphics)) {
+		ret = without(ret, vk::PipelineStageFlags(graphicsStages));
+		if(!(queue & vk::QueueBits::compute)) {
+			ret = without(ret, vk::PipelineStageBits::computeShader |
+				vk::PipelineStageBits::drawIndirect);
+		}
+	} else if(!(queue & vk::QueueBits::compute)) {
+		ret = without(ret, vk::PipelineStageFlags(vk::PipelineStageBits::computeShader));
+	}
+
+	if(!ret && stages) {
+		ret = vk::PipelineStageBits::allCommands;
+	}
+
+	return ret;
+}
+
+Access layoutAccess(vk::ImageLayout layout, vk::QueueFlags queue)
+{
+	using Stage = vk::PipelineStageBits;
+	using Acc = vk::AccessBits;
+
+	Access ret;
+	ret.layout = layout;
+
+	switch(layout) {
+		case vk::ImageLayout::undefined:
+			ret.stages = Stage::topOfPipe;
+			break;
+		case vk::ImageLayout::preinitialized:
+			ret.stages = Stage::host;
+			ret.access = Acc::hostWrite;
+			break;
+		case vk::ImageLayout::colorAttachmentOptimal:
+			ret.stages = Stage::colorAttachmentOutput;
+			ret.access = Acc::colorAttachmentRead | Acc::colorAttachmentWrite;
+			break;
+		case vk::ImageLayout::depthStencilAttachmentOptimal:
+			ret.stages = Stage::earlyFragmentTests | Stage::lateFragmentTests;
+			ret.access = Acc::depthStencilAttachmentRead | Acc::depthStencilAttachmentWrite;
+			break;
+		case vk::ImageLayout::depthStencilReadOnlyOptimal:
+			ret.stages = Stage::earlyFragmentTests | Stage::lateFragmentTests |
+				Stage::fragmentShader;
+			ret.access = Acc::depthStencilAttachmentRead | Acc::shaderRead;
+			break;
+		case vk::ImageLayout::shaderReadOnlyOptimal:
+			ret.stages = Stage::vertexShader | Stage::fragmentShader | Stage::computeShader;
+			ret.access = Acc::shaderRead | Acc::inputAttachmentRead;
+			break;
+		case vk::ImageLayout::transferSrcOptimal:
+			ret.stages = Stage::transfer;
+			ret.access = Acc::transferRead;
+			break;
+		case vk::ImageLayout::transferDstOptimal:
+			ret.stages = Stage::transfer;
+			ret.access = Acc::transferWrite;
+			break;
+		case vk::ImageLayout::presentSrcKHR:
+			// the presentation engine is synchronized using semaphores
+			ret.stages = Stage::bottomOfPipe;
+			break;
+		default:
+			ret.stages = Stage::allCommands;
+			ret.access = Acc::memoryRead | Acc::memoryWrite;
+			break;
+	}
+
+	// the access types of removed stages are invalid for the remaining ones
+	ret.stages = supportedStages(ret.stages, queue);
+	ret.access = stageAccess(ret.access, ret.stages);
+	return ret;
+}
+
+std::optional<AccessBarrier> accessBarrier(AccessState& state, const Access& dst)
+{
+	auto& src = state.access;
+	auto transition = src.layout != dst.layout;
+
+	// reading the same data in the same layout again only needs a barrier
+	// if the last write was not yet made visible to the new stages or access
+	if(!transition && !writes(src.access) && !writes(dst.access)) {
+		std::optional<AccessBarrier> ret;
+		if(!covered(state.writeStages, src, dst)) {
+			ret = AccessBarrier {state.writeStages, dst.stages, state.writeAccess,
+				dst.access, dst.layout, dst.layout, true};
+		}
+
+		src.stages |= dst.stages;
+		src.access |= dst.access;
+		return ret;
+	}
+
+	auto srcStages = src.stages;
+	auto srcAccess = src.access & writeAccessBits;
+	auto oldLayout = src.layout;
+
+	// remember the last write (layout transitions count as one)
+	// for the following reads
+	if(transition || writes(dst.access)) {
+		state = {dst, dst.stages, dst.access & writeAccessBits};
+	} else {
+		state = {dst, srcStages, srcAccess};
+	}
+
+	if(!transition && !srcStages) {
+		return {};
+	}
+
+	if(!srcStages) {
+		srcStages = vk::PipelineStageBits::topOfPipe;
+	}
+
+	// for write-after-read hazards an execution dependency is enough
+	auto memory = transition || srcAccess;
+	return AccessBarrier {srcStages, dst.stages, srcAccess, dst.access,
+		oldLayout, dst.layout, memory};
+}
+
+// BarrierBatch
+BarrierBatch::BarrierBatch(vk::CommandBuffer cmdBuffer) : cmdBuffer_(cmdBuffer)
+{
+}
+
+BarrierBatch::~BarrierBatch()
+{
+	if(cmdBuffer_) {
+		flush();
+	}
+}
+
+void swap(BarrierBatch& a, BarrierBatch& b) noexcept
+{
+	using std::swap;
+	swap(a.cmdBuffer_, b.cmdBuffer_);
+	swap(a.srcStages_, b.srcStages_);
+	swap(a.dstStages_, b.dstStages_);
+	swap(a.memory_, b.memory_);
+	swap(a.buffer_, b.buffer_);
+	swap(a.image_, b.image_);
+}
+
+void BarrierBatch::barrier(vk::PipelineStageFlags src, vk::PipelineStageFlags dst,
+	const vk::ImageMemoryBarrier& barrier)
+{
+	this->barrier(src, dst);
+
+	// extend the last barrier if possible. Once a barrier was extended, it may
+	// in turn cover the same subresources as the one before on adjacent levels
+	if(!image_.empty() && merge(image_.back(), barrier)) {
+		while(image_.size() > 1 && merge(image_[image_.size() - 2], image_.back())) {
+			image_.pop_back();
+		}
+
+		return;
+	}
+
+	image_.push_back(barrier);
+}
+
+void BarrierBatch::barrier(vk::PipelineStageFlags src, vk::PipelineStageFlags dst,
+	const vk::BufferMemoryBarrier& barrier)
+{
+	this->barrier(src, dst);
+	buffer_.push_back(barrier);
+}
+
+void BarrierBatch::barrier(vk::PipelineStageFlags src, vk::PipelineStageFlags dst,
+	const vk::MemoryBarrier& barrier)
+{
+	this->barrier(src, dst);
+
+	// all global barriers apply to the same (merged) stages
+	if(!memory_.empty()) {
+		memory_.front().srcAccessMask |= barrier.srcAccessMask;
+		memory_.front().dstAccessMask |= barrier.dstAccessMask;
+		return;
+	}
+
+	memory_.push_back(barrier);
+}
+
+void BarrierBatch::barrier(vk::PipelineStageFlags src, vk::PipelineStageFlags dst)
+{
+	dlg_check("BarrierBatch::barrier", {
+		if(!src || !dst) {
+			vpp_error("empty stage mask");
+		}
+	});
+
+	srcStages_ |= src;
+	dstStages_ |= dst;
+}
+
+void BarrierBatch::barrier(const AccessBarrier& barrier, vk::Image image,
+	const vk::ImageSubresourceRange& range)
+{
+	if(!barrier.memory) {
+		this->barrier(barrier.srcStages, barrier.dstStages);
+		return;
+	}
+
+	vk::ImageMemoryBarrier imgBarrier;
+	imgBarrier.srcAccessMask = barrier.srcAccess;
+	imgBarrier.dstAccessMask = barrier.dstAccess;
+	imgBarrier.oldLayout = barrier.oldLayout;
+	imgBarrier.newLayout = barrier.newLayout;
+	imgBarrier.srcQueueFamilyIndex = vk::queueFamilyIgnored;
+	imgBarrier.dstQueueFamilyIndex = vk::queueFamilyIgnored;
+	imgBarrier.image = image;
+	imgBarrier.subresourceRange = range;
+	this->barrier(barrier.srcStages, barrier.dstStages, imgBarrier);
+}
+
+void BarrierBatch::flush()
+{
+	if(empty()) {
+		return;
+	}
+
+	vk::cmdPipelineBarrier(cmdBuffer_, srcStages_, dstStages_, {}, memory_, buffer_, image_);
+
+	srcStages_ = {};
+	dstStages_ = {};
+	memory_.clear();
+	buffer_.clear();
+	image_.clear();
+}
+
+bool BarrierBatch::merge(vk::ImageMemoryBarrier& a, const vk::ImageMemoryBarrier& b)
+{
+	if(a.image != b.image || !compatible(a, b) ||
+			a.srcQueueFamilyIndex != b.srcQueueFamilyIndex ||
+			a.dstQueueFamilyIndex != b.dstQueueFamilyIndex) {
+		return false;
+	}
+
+	auto& ra = a.subresourceRange;
+	auto& rb = b.subresourceRange;
+	if(ra.aspectMask != rb.aspectMask) {
+		return false;
+	}
+
+	// overlapping or adjacent layers on the same levels
+	if(ra.baseMipLevel == rb.baseMipLevel && ra.levelCount == rb.levelCount) {
+		return extend(ra.baseArrayLayer, ra.layerCount, rb.baseArrayLayer, rb.layerCount);
+	}
+
+	// overlapping or adjacent levels on the same layers
+	if(ra.baseArrayLayer == rb.baseArrayLayer && ra.layerCount == rb.layerCount) {
+		return extend(ra.baseMipLevel, ra.levelCount, rb.baseMipLevel, rb.levelCount);
+	}
+
+	// b is already completely covered by a. Otherwise the subresources in
+	// both ranges would be transitioned twice
+	return contains(ra.baseMipLevel, ra.levelCount, rb.baseMipLevel, rb.levelCount) &&
+		contains(ra.baseArrayLayer, ra.layerCount, rb.baseArrayLayer, rb.layerCount);
+}
+
+// EventPool
+void swap(EventPool& a, EventPool& b) noexcept
+{
+	using std::swap;
+	swap(static_cast<Resource&>(a), static_cast<Resource&>(b));
+	swap(a.events_, b.events_);
+}
+
+Event EventPool::get()
+{
+	if(events_.empty()) {
+		return Event(device());
+	}
+
+	auto event = std::move(events_.back());
+	events_.pop_back();
+	return event;
+}
+
+void EventPool::recycle(Event event)
+{
+	if(event.vkHandle()) {
+		events_.push_back(std::move(event));
+	}
+}
+
+// SplitBarrier
+SplitBarrier::SplitBarrier(EventPool& pool) : pool_(&pool), event_(pool.get())
+{
+}
+
+SplitBarrier::~SplitBarrier()
+{
+	if(pool_) {
+		pool_->recycle(std::move(event_));
+	}
+}
+
+void swap(SplitBarrier& a, SplitBarrier& b) noexcept
+{
+	using std::swap;
+	swap(a.pool_, b.pool_);
+	swap(a.event_, b.event_);
+	swap(a.srcStages_, b.srcStages_);
+}
+
+void SplitBarrier::signal(vk::CommandBuffer cmdBuffer, vk::PipelineStageFlags srcStages)
+{
+	dlg_check("SplitBarrier::signal", {
+		if(!srcStages) {
+			vpp_error("empty stage mask");
+		}
+	});
+
+	vk::cmdSetEvent(cmdBuffer, event_, srcStages);
+	srcStages_ = srcStages;
+}
+
+void SplitBarrier::wait(vk::CommandBuffer cmdBuffer, vk::PipelineStageFlags dstStages,
+	nytl::Span<const vk::MemoryBarrier> memory,
+	nytl::Span<const vk::BufferMemoryBarrier> buffer,
+	nytl::Span<const vk::ImageMemoryBarrier> image)
+{
+	dlg_check("SplitBarrier::wait", {
+		if(!srcStages_) {
+			vpp_error("wait called before signal");
+		}
+	});
+
+	vk::cmdWaitEvents(cmdBuffer, {event_}, srcStages_, dstStages, memory, buffer, image);
+
+	// the reset is executed after the waiting stages, i.e. no longer
+	// concurrently to the wait
+	vk::cmdResetEvent(cmdBuffer, event_, dstStages);
+}
+
+// AccessTracker
+void AccessTracker::set(vk::Image img, const vk::ImageSubresourceRange& range,
+	const Access& access)
+{
+	auto& state = image(img, range);
+	auto levelEnd = rangeEnd(range.baseMipLevel, range.levelCount, state.levels);
+	auto layerEnd = rangeEnd(range.baseArrayLayer, range.layerCount, state.layers);
+
+	for(auto l = range.baseMipLevel; l < levelEnd; ++l) {
+		for(auto a = range.baseArrayLayer; a < layerEnd; ++a) {
+			state.subresources[l * state.layers + a] = accessState(access);
+		}
+	}
+}
+
+void AccessTracker::set(vk::Buffer buf, vk::DeviceSize offset, vk::DeviceSize size,
+	const Access& access)
+{
+	replace(buffer(buf), offset, rangeEnd(offset, size), accessState(access));
+}
+
+bool AccessTracker::access(BarrierBatch& batch, vk::Image img,
+	const vk::ImageSubresourceRange& range, const Access& dst)
+{
+	dlg_check("AccessTracker::access(image)", {
+		if(dst.layout == vk::ImageLayout::undefined ||
+				dst.layout == vk::ImageLayout::preinitialized) {
+			vpp_error("invalid access layout {}", (int) dst.layout);
+		}
+
+		if(!dst.stages) {
+			vpp_error("no access stages given");
+		}
+	});
+
+	auto& state = image(img, range);
+	auto levelEnd = rangeEnd(range.baseMipLevel, range.levelCount, state.levels);
+	auto layerEnd = rangeEnd(range.baseArrayLayer, range.layerCount, state.layers);
+
+	auto ret = false;
+	for(auto l = range.baseMipLevel; l < levelEnd; ++l) {
+		for(auto a = range.baseArrayLayer; a < layerEnd; ++a) {
+			auto& tracked = state.subresources[l * state.layers + a];
+			if(auto barrier = accessBarrier(tracked, dst)) {
+				batch.barrier(*barrier, img, {range.aspectMask, l, 1, a, 1});
+				ret = true;
+			}
+		}
+	}
+
+	return ret;
+}
+
+bool AccessTracker::access(BarrierBatch& batch, vk::Buffer buf,
+	vk::DeviceSize offset, vk::DeviceSize size, const Access& dst)
+{
+	dlg_check("AccessTracker::access(buffer)", {
+		if(!dst.stages) {
+			vpp_error("no access stages given");
+		}
+	});
+
+	auto& state = buffer(buf);
+	auto end = rangeEnd(offset, size);
+
+	Access src {};
+	vk::PipelineStageFlags writeStages {}; // of reads not covered yet
+	vk::AccessFlags writeAccess {};
+	for(auto& range : state.ranges) {
+		if(range.offset < end && range.end > offset) {
+			src.stages |= range.state.access.stages;
+			src.access |= range.state.access.access;
+			if(!covered(range.state.writeStages, range.state.access, dst)) {
+				writeStages |= range.state.writeStages;
+				writeAccess |= range.state.writeAccess;
+			}
+		}
+	}
+
+	// first access or reading the same data again: only needs a barrier
+	// if the last write was not yet made visible to the new stages or access
+	if(!src.stages || (!writes(src.access) && !writes(dst.access))) {
+		if(writeStages) {
+			vk::BufferMemoryBarrier barrier;
+			barrier.srcAccessMask = writeAccess;
+			barrier.dstAccessMask = dst.access;
+			barrier.srcQueueFamilyIndex = vk::queueFamilyIgnored;
+			barrier.dstQueueFamilyIndex = vk::queueFamilyIgnored;
+			barrier.buffer = buf;
+			barrier.offset = offset;
+			barrier.size = size;
+			batch.barrier(writeStages, dst.stages, barrier);
+		}
+
+		if(writes(dst.access)) {
+			replace(state, offset, end, {dst, dst.stages, dst.access & writeAccessBits});
+		} else {
+			merge(state, offset, end, dst);
+		}
+
+		return bool(writeStages);
+	}
+
+	// for write-after-read hazards an execution dependency is enough
+	auto srcAccess = src.access & writeAccessBits;
+	if(srcAccess) {
+		vk::BufferMemoryBarrier barrier;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dst.access;
+		barrier.srcQueueFamilyIndex = vk::queueFamilyIgnored;
+		barrier.dstQueueFamilyIndex = vk::queueFamilyIgnored;
+		barrier.buffer = buf;
+		barrier.offset = offset;
+		barrier.size = size;
+		batch.barrier(src.stages, dst.stages, barrier);
+	} else {
+		batch.barrier(src.stages, dst.stages);
+	}
+
+	// remember the last write for the following reads
+	if(writes(dst.access)) {
+		replace(state, offset, end, {dst, dst.stages, dst.access & writeAccessBits});
+	} else {
+		replace(state, offset, end, {dst, src.stages, srcAccess});
+	}
+
+	return true;
+}
+
+bool AccessTracker::access(vk::CommandBuffer cmdBuffer, vk::Image img,
+	const vk::ImageSubresourceRange& range, const Access& dst)
+{
+	BarrierBatch batch(cmdBuffer);
+	return access(batch, img, range, dst);
+}
+
+bool AccessTracker::access(vk::CommandBuffer cmdBuffer, vk::Buffer buf,
+	vk::DeviceSize offset, vk::DeviceSize size, const Access& dst)
+{
+	BarrierBatch batch(cmdBuffer);
+	return access(batch, buf, offset, size, dst);
+}
+
+Access AccessTracker::state(vk::Image img, unsigned int level, unsigned int layer) const
+{
+	auto it = std::find_if(images_.begin(), images_.end(),
+		[&](auto& state) { return state.image == img; });
+	if(it == images_.end() || level >= it->levels || layer >= it->layers) {
+		return {};
+	}
+
+	return it->subresources[level * it->layers + layer].access;
+}
+
+void AccessTracker::forget(vk::Image img)
+{
+	auto it = std::find_if(images_.begin(), images_.end(),
+		[&](auto& state) { return state.image == img; });
+	if(it != images_.end()) {
+		images_.erase(it);
+	}
+}
+
+void AccessTracker::forget(vk::Buffer buf)
+{
+	auto it = std::find_if(buffers_.begin(), buffers_.end(),
+		[&](auto& state) { return state.buffer == buf; });
+	if(it != buffers_.end()) {
+		buffers_.erase(it);
+	}
+}
+
+void AccessTracker::clear()
+{
+	images_.clear();
+	buffers_.clear();
+}
+
+AccessTracker::ImageState& AccessTracker::image(vk::Image img,
+	const vk::ImageSubresourceRange& range)
+{
+	auto it = std::find_if(images_.begin(), images_.end(),
+		[&](auto& state) { return state.image == img; });
+	if(it == images_.end()) {
+		images_.push_back({img, 0, 0, {}});
+		it = images_.end() - 1;
+	}
+
+	// grow the tracked subresources if needed
+	auto& state = *it;
+	auto levels = std::max(state.levels,
+		rangeEnd(range.baseMipLevel, range.levelCount, state.levels));
+	auto layers = std::max(state.layers,
+		rangeEnd(range.baseArrayLayer, range.layerCount, state.layers));
+	if(levels != state.levels || layers != state.layers) {
+		std::vector<State> subresources(levels * layers);
+		for(auto l = 0u; l < state.levels; ++l) {
+			for(auto a = 0u; a < state.layers; ++a) {
+				subresources[l * layers + a] = state.subresources[l * state.layers + a];
+			}
+		}
+
+		state.subresources = std::move(subresources);
+		state.levels = levels;
+		state.layers = layers;
+	}
+
+	return state;
+}
+
+AccessTracker::BufferState& AccessTracker::buffer(vk::Buffer buf)
+{
+	auto it = std::find_if(buffers_.begin(), buffers_.end(),
+		[&](auto& state) { return state.buffer == buf; });
+	if(it == buffers_.end()) {
+		buffers_.push_back({buf, {}});
+		it = buffers_.end() - 1;
+	}
+
+	return *it;
+}
+
+void AccessTracker::replace(BufferState& state, vk::DeviceSize offset,
+	vk::DeviceSize end, const State& access)
+{
+	std::vector<BufferRange> ranges;
+	ranges.reserve(state.ranges.size() + 2);
+
+	auto inserted = false;
+	for(auto& range : state.ranges) {
+		if(range.end <= offset) {
+			ranges.push_back(range);
+			continue;
+		}
+
+		if(range.offset < offset) {
+			ranges.push_back({range.offset, offset, range.state});
+		}
+
+		if(!inserted) {
+			ranges.push_back({offset, end, access});
+			inserted = true;
+		}
+
+		if(range.offset >= end) {
+			ranges.push_back(range);
+		} else if(range.end > end) {
+			ranges.push_back({end, range.end, range.state});
+		}
+	}
+
+	if(!inserted) {
+		ranges.push_back({offset, end, access});
+	}
+
+	state.ranges = std::move(ranges);
+}
+
+void AccessTracker::merge(BufferState& state, vk::DeviceSize offset,
+	vk::DeviceSize end, const Access& access)
+{
+	std::vector<BufferRange> ranges;
+	ranges.reserve(state.ranges.size() * 2 + 2);
+
+	// the ranges keep their last write, untracked gaps get the access
+	auto pos = offset; // start of the part of [offset, end) not handled yet
+	for(auto& range : state.ranges) {
+		if(range.end <= offset) {
+			ranges.push_back(range);
+			continue;
+		}
+
+		if(range.offset >= end) {
+			if(pos < end) {
+				ranges.push_back({pos, end, {access}});
+				pos = end;
+			}
+
+			ranges.push_back(range);
+			continue;
+		}
+
+		if(range.offset < offset) {
+			ranges.push_back({range.offset, offset, range.state});
+		} else if(range.offset > pos) {
+			ranges.push_back({pos, range.offset, {access}});
+		}
+
+		auto merged = range.state;
+		merged.access.stages |= access.stages;
+		merged.access.access |= access.access;
+		auto mergedEnd = std::min(range.end, end);
+		ranges.push_back({std::max(range.offset, offset), mergedEnd, merged});
+
+		if(range.end > end) {
+			ranges.push_back({end, range.end, range.state});
+		}
+
+		pos = mergedEnd;
+	}
+
+	if(pos < end) {
+		ranges.push_back({pos, end, {access}});
+	}
+
+	state.ranges = std::move(ranges);
+}
+
+} // namespace vpp
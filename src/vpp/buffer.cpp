@@ -3,6 +3,7 @@
 // See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
 
 #include <vpp/buffer.hpp>
+#include <vpp/externalMemoryHost.hpp>
 #include <vpp/vk.hpp>
 #include <utility> // std::move
 
@@ -27,12 +28,44 @@ Buffer::Buffer(const Device& dev, const vk::BufferCreateInfo& info, unsigned int
 	dev.deviceAllocator().request(vkHandle(), reqs, info.usage, memoryEntry_);
 }
 
+Buffer::Buffer(const Device& dev, const vk::BufferCreateInfo& info, MemoryUsage usage)
+{
+	handle_ = vk::createBuffer(dev, info);
+	auto reqs = vk::getBufferMemoryRequirements(dev, vkHandle());
+
+	reqs.memoryTypeBits = dev.memoryTypeBits(usage, reqs.memoryTypeBits);
+	dev.deviceAllocator().request(vkHandle(), reqs, info.usage, memoryEntry_);
+}
+
 Buffer::Buffer(vk::Buffer buffer, MemoryEntry&& entry)
 {
 	handle_ = buffer;
 	memoryEntry_ = std::move(entry);
 }
 
+Buffer::Buffer(DeviceMemory& memory, const vk::BufferCreateInfo& info)
+{
+	using HandleTypeBits = vk::ExternalMemoryHandleTypeBitsKHX;
+	vk::ExternalMemoryBufferCreateInfoKHX externalInfo;
+	externalInfo.pNext = info.pNext;
+	externalInfo.handleTypes = static_cast<HandleTypeBits>(ext::hostAllocationBit);
+
+	auto createInfo = info;
+	createInfo.pNext = &externalInfo;
+
+	handle_ = vk::createBuffer(memory.device(), createInfo);
+	auto reqs = vk::getBufferMemoryRequirements(memory.device(), vkHandle());
+
+	dlg_check("Buffer(importedMemory)", {
+		if(!(reqs.memoryTypeBits & (1 << memory.type())))
+			vpp_error("memory type of the imported memory not supported");
+	});
+
+	auto allocation = memory.alloc(reqs.size, reqs.alignment, AllocationType::linear);
+	vk::bindBufferMemory(memory.device(), vkHandle(), memory, allocation.offset);
+	memoryEntry_ = {memory, allocation};
+}
+
 Buffer::~Buffer()
 {
 	if(vkHandle()) vk::destroyBuffer(device(), vkHandle());
@@ -10,10 +10,111 @@
 #include <vpp/vk.hpp>
 
 #include <cstring> // std::memset
+#include <algorithm> // std::min
+#include <vector> // std::vector
 #include <utility> // std::move
 #include <memory> // std::make_unique
 
 namespace vpp {
+namespace {
+
+/// Size of the cache-resident block the structures are assembled in
+/// before they are written to (or after they were read from) the buffer memory.
+constexpr auto interleaveBlockSize = 4096u;
+
+/// Copies count values of N bytes between arrays with the given strides.
+/// The size known at compile time allows the compiler to use single
+/// (vector) loads and stores for the common attribute sizes.
+template<std::size_t N>
+void stridedCopy(uint8_t* dst, std::size_t dstStride, const uint8_t* src,
+	std::size_t srcStride, std::size_t count)
+{
+	for(std::size_t i = 0u; i < count; ++i)
+		std::memcpy(dst + i * dstStride, src + i * srcStride, N);
+}
+
+void stridedCopy(uint8_t* dst, std::size_t dstStride, const uint8_t* src,
+	std::size_t srcStride, std::size_t count, std::size_t size)
+{
+	switch(size) {
+		case 4: stridedCopy<4>(dst, dstStride, src, srcStride, count); break;
+		case 8: stridedCopy<8>(dst, dstStride, src, srcStride, count); break;
+		case 12: stridedCopy<12>(dst, dstStride, src, srcStride, count); break;
+		case 16: stridedCopy<16>(dst, dstStride, src, srcStride, count); break;
+		case 24: stridedCopy<24>(dst, dstStride, src, srcStride, count); break;
+		case 32: stridedCopy<32>(dst, dstStride, src, srcStride, count); break;
+		default:
+			for(std::size_t i = 0u; i < count; ++i)
+				std::memcpy(dst + i * dstStride, src + i * srcStride, size);
+	}
+}
+
+} // anonymous util namespace
+
+namespace detail {
+
+// The structures are assembled block-wise in a small buffer that stays in cache and
+// every block is then written with one sequential memcpy. Scattering the members
+// directly over the mapped memory would result in partial writes which are
+// expensive for write-combined (and for reading uncached) memory.
+void interleave(uint8_t* dst, std::size_t stride, std::size_t count,
+	nytl::Span<const InterleaveMember> members, nytl::Span<const uint8_t* const> src)
+{
+	dlg_check("detail::interleave", {
+		if(members.size() != src.size()) vpp_error("invalid src count");
+	});
+
+	auto blockCount = std::max<std::size_t>(interleaveBlockSize / stride, 1u);
+	std::vector<uint8_t> block(blockCount * stride); // zeroed padding bytes
+
+	for(std::size_t i = 0u; i < count; i += blockCount) {
+		auto n = std::min(blockCount, count - i);
+		for(auto m = 0u; m < members.size(); ++m) {
+			auto size = members[m].size;
+			stridedCopy(block.data() + members[m].offset, stride, src[m] + i * size,
+				size, n, size);
+		}
+
+		std::memcpy(dst + i * stride, block.data(), n * stride);
+	}
+}
+
+void deinterleave(const uint8_t* src, std::size_t stride, std::size_t count,
+	nytl::Span<const InterleaveMember> members, nytl::Span<uint8_t* const> dst)
+{
+	dlg_check("detail::deinterleave", {
+		if(members.size() != dst.size()) vpp_error("invalid dst count");
+	});
+
+	auto blockCount = std::max<std::size_t>(interleaveBlockSize / stride, 1u);
+	std::vector<uint8_t> block(blockCount * stride);
+
+	for(std::size_t i = 0u; i < count; i += blockCount) {
+		auto n = std::min(blockCount, count - i);
+		std::memcpy(block.data(), src + i * stride, n * stride);
+		for(auto m = 0u; m < members.size(); ++m) {
+			auto size = members[m].size;
+			stridedCopy(dst[m] + i * size, size, block.data() + members[m].offset,
+				stride, n, size);
+		}
+	}
+}
+
+void cmdPushConstants(vk::CommandBuffer cmdBuf, vk::PipelineLayout layout,
+	vk::ShaderStageFlags stages, std::uint32_t offset, nytl::Span<const uint8_t> data)
+{
+	dlg_check("cmdPushConstants", {
+		if(offset % 4) vpp_error("offset must be a multiple of 4");
+	});
+
+	// push constant sizes must be a multiple of 4 while the size of the written
+	// data might not be (e.g. for packed types). The capacity of the storage
+	// is always a multiple of 4 and the remaining bytes are zero
+	auto size = vpp::align(data.size(), 4u);
+	vk::cmdPushConstants(cmdBuf, layout, stages, offset, size, data.data());
+}
+
+} // namespace detail
 
 DataWorkPtr retrieve(const Buffer& buf, vk::DeviceSize offset, vk::DeviceSize size)
 {
@@ -25,7 +126,8 @@ DataWorkPtr retrieve(const Buffer& buf, vk::DeviceSize offset, vk::DeviceSize si
 
 	// retrieve by mapping if possible
 	if(buf.mappable()) {
-		return std::make_unique<MappableDownloadWork>(buf.memoryMap());
+		return std::make_unique<MappableDownloadWork>(buf.memoryMap(),
+			Allocation{offset, size});
 	} else {
 		//use transfer buffer
 		const Queue* queue;
@@ -33,7 +135,7 @@ DataWorkPtr retrieve(const Buffer& buf, vk::DeviceSize offset, vk::DeviceSize si
 		auto cmdBuffer = buf.device().commandProvider().get(qFam);
 		auto downloadBuffer = buf.device().transferManager().buffer(size);
 
-		vk::BufferCopy region {offset, 0, size};
+		vk::BufferCopy region {offset, downloadBuffer.offset(), size};
 
 		vk::beginCommandBuffer(cmdBuffer, {});
 		vk::cmdCopyBuffer(cmdBuffer, buf, downloadBuffer.buffer(), {region});
@@ -44,6 +146,36 @@ DataWorkPtr retrieve(const Buffer& buf, vk::DeviceSize offset, vk::DeviceSize si
 	}
 }
 
+WorkPtr write(const Buffer& dst, const Buffer& src, vk::DeviceSize dstOffset,
+	vk::DeviceSize srcOffset, vk::DeviceSize size)
+{
+	dlg_check("write(buffer, buffer)", {
+		if(!src.memoryEntry().allocated()) vpp_error("src buffer has no memory");
+	});
+
+	dst.assureMemory();
+	if(size == vk::wholeSize) size = src.memoryEntry().size() - srcOffset;
+
+	const Queue* queue;
+	auto qFam = transferQueueFamily(dst.device(), &queue);
+	if(qFam == -1) throw std::logic_error("vpp::write: device has no valid queue");
+
+	auto cmdBuffer = dst.device().commandProvider().get(qFam);
+	vk::BufferCopy region {srcOffset, dstOffset, size};
+
+	vk::beginCommandBuffer(cmdBuffer, {});
+	vk::cmdCopyBuffer(cmdBuffer, src, dst, {region});
+	vk::endCommandBuffer(cmdBuffer);
+
+	return std::make_unique<CommandWork<void>>(std::move(cmdBuffer), *queue);
+}
+
+WorkPtr retrieve(const Buffer& src, const Buffer& dst, vk::DeviceSize srcOffset,
+	vk::DeviceSize dstOffset, vk::DeviceSize size)
+{
+	return write(dst, src, dstOffset, srcOffset, size);
+}
+
 WorkPtr write(const Buffer& buf, nytl::Span<const uint8_t> data)
 {
 	BufferUpdate update(buf, BufferLayout::std140); // the layout does not matter in this case
@@ -72,6 +204,7 @@ BufferUpdate::BufferUpdate(const Buffer& buf, BufferLayout align, bool direct)
 		} else {
 			auto uploadBuffer = device().transferManager().buffer(buf.memorySize());
 			map_ = uploadBuffer.buffer().memoryMap();
+			rangeOffset_ = uploadBuffer.offset();
 			work_ = std::make_unique<UploadWork>(std::move(cmdBuffer), *queue,
 				std::move(uploadBuffer));
 		}
@@ -123,11 +256,17 @@ void BufferUpdate::operate(const void* ptr, std::size_t size)
 		if(!ptr) vpp_error("invalid data ptr");
 	});
 
-	std::memcpy(&data(), ptr, size);
+	std::memcpy(operateRange(size), ptr, size);
+}
+
+std::uint8_t* BufferUpdate::operateRange(std::size_t size)
+{
+	auto ptr = &data();
 	offset_ = std::max(offset_, nextOffset_) + size;
 	internalOffset_ += size;
 	if(!buffer().mappable()) copies_.back().size += size;
 	checkCopies();
+	return ptr;
 }
 
 void BufferUpdate::checkCopies()
@@ -146,7 +285,7 @@ void BufferUpdate::checkCopies()
 std::uint8_t& BufferUpdate::data()
 {
 	if(!direct_ && buffer().mappable()) return *(map_.ptr() + offset_);
-	else if(!direct_) return *(map_.ptr() + internalOffset_);
+	else if(!direct_) return *(map_.ptr() + rangeOffset_ + internalOffset_);
 	else return data_[internalOffset_];
 }
 
@@ -175,6 +314,9 @@ WorkPtr BufferUpdate::apply()
 		auto& cmdBuf = uploadWork->commandBuffer();
 		auto& transferRange = uploadWork->transferRange();
 
+		// the copies are relative to the used range of the transfer buffer
+		for(auto& update : copies_) update.srcOffset += transferRange.offset();
+
 		vk::beginCommandBuffer(cmdBuf, {});
 		for(auto& update : copies_)
 			vk::cmdCopyBuffer(cmdBuf, transferRange.buffer(), buffer(), {update});
@@ -226,14 +368,20 @@ BufferReader::BufferReader(const Device& dev, BufferLayout align,
 }
 
 void BufferReader::operate(void* ptr, std::size_t size)
+{
+	std::memcpy(ptr, operateRange(size), size);
+}
+
+const std::uint8_t* BufferReader::operateRange(std::size_t size)
 {
 	offset_ = std::max(offset_, nextOffset_);
-	dlg_check("BufferReader::operate", {
-		if(offset_ > data_.size()) vpp_error("buffer read overflow");
+	dlg_check("BufferReader::operateRange", {
+		if(offset_ + size > data_.size()) vpp_error("buffer read overflow");
 	});
 
-	std::memcpy(ptr, &data_[offset_], size);
+	auto ptr = &data_[offset_];
 	offset_ += size;
+	return ptr;
 }
 
 void BufferReader::alignUniform() noexcept
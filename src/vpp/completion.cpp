@@ -0,0 +1,231 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <vpp/completion.hpp>
+#include <vpp/submit.hpp>
+#include <vpp/util/log.hpp>
+
+#include <algorithm> // std::remove_if
+#include <exception> // std::exception
+#include <stdexcept> // std::logic_error
+#include <utility> // std::swap
+
+namespace vpp {
+
+CompletionService::CompletionService(const Device& dev, unsigned int threads,
+	std::chrono::nanoseconds latency) : Resource(dev), latency_(latency)
+{
+	thread_ = std::thread([this]{ complete(); });
+	for(auto i = 0u; i < threads; ++i) {
+		workers_.emplace_back([this]{ run(); });
+	}
+}
+
+CompletionService::~CompletionService()
+{
+	wait();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+
+	cv_.notify_all();
+	taskCv_.notify_all();
+
+	thread_.join();
+	for(auto& worker : workers_) {
+		worker.join();
+	}
+}
+
+void CompletionService::then(WorkBase& work, Continuation continuation)
+{
+	// such a state would never be completed by waiting for it
+	auto state = work.commandState();
+	if(state && !state->valid()) {
+		throw std::logic_error("vpp::CompletionService::then: invalid command state");
+	}
+
+	if(!work.submitted()) {
+		work.submit();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		entries_.push_back({&work, std::move(continuation)});
+		++outstanding_;
+	}
+
+	cv_.notify_one();
+}
+
+void CompletionService::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	idleCv_.wait(lock, [&]{ return outstanding_ == 0; });
+}
+
+std::size_t CompletionService::pending() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return outstanding_;
+}
+
+void CompletionService::complete()
+{
+	std::vector<CommandExecutionState*> states;
+	std::vector<Continuation> completed;
+
+	while(true) {
+		auto poll = false;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			cv_.wait(lock, [&]{ return stop_ || !entries_.empty(); });
+			if(stop_) {
+				break;
+			}
+
+			// the entries are only removed by this thread, so they
+			// stay valid while waiting without the lock
+			states.clear();
+			for(auto& entry : entries_) {
+				auto state = entry.work->commandState();
+				if(state) states.push_back(state);
+				else poll = true;
+			}
+		}
+
+		// wait for any submission to complete or the latency to elapse
+		// to consider new entries
+		auto timeout = latency_.count();
+		auto waited = false;
+		if(!states.empty()) {
+			waited = device().submitManager().wait(states, false, timeout);
+		} else if(poll) {
+			std::this_thread::sleep_for(latency_);
+		}
+
+		// whether waiting returned without any work being executed
+		auto idle = false;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			auto pred = [&](Entry& entry) {
+				if(!entry.work->executed()) return false;
+				completed.push_back(std::move(entry.continuation));
+				return true;
+			};
+
+			entries_.erase(std::remove_if(entries_.begin(), entries_.end(), pred),
+				entries_.end());
+			idle = waited && completed.empty();
+
+			if(!workers_.empty()) {
+				for(auto& continuation : completed) {
+					tasks_.push_back(std::move(continuation));
+				}
+
+				completed.clear();
+			}
+		}
+
+		taskCv_.notify_all();
+		for(auto& continuation : completed) {
+			call(continuation);
+		}
+
+		completed.clear();
+
+		// the states can't be waited for (e.g. the work is not updated
+		// by completing them), only check them again after the latency
+		if(idle) {
+			std::this_thread::sleep_for(latency_);
+		}
+	}
+}
+
+void CompletionService::run()
+{
+	while(true) {
+		Continuation continuation;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			taskCv_.wait(lock, [&]{ return stop_ || !tasks_.empty(); });
+			if(tasks_.empty()) {
+				break;
+			}
+
+			continuation = std::move(tasks_.front());
+			tasks_.pop_front();
+		}
+
+		call(continuation);
+	}
+}
+
+void CompletionService::call(Continuation& continuation)
+{
+	if(continuation) {
+		try {
+			continuation();
+		} catch(const std::exception& err) {
+			vpp_warn("::CompletionService"_src, "continuation: {}", err.what());
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		--outstanding_;
+	}
+
+	idleCv_.notify_all();
+}
+
+// Executor
+Executor& Executor::current()
+{
+	static thread_local Executor executor;
+	return executor;
+}
+
+void Executor::post(Task task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		tasks_.push_back(std::move(task));
+	}
+
+	cv_.notify_one();
+}
+
+std::size_t Executor::run()
+{
+	std::deque<Task> tasks;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::swap(tasks, tasks_);
+	}
+
+	for(auto& task : tasks) {
+		task();
+	}
+
+	return tasks.size();
+}
+
+std::size_t Executor::wait(std::chrono::nanoseconds timeout)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		cv_.wait_for(lock, timeout, [&]{ return !tasks_.empty(); });
+	}
+
+	return run();
+}
+
+} // namespace vpp
@@ -0,0 +1,206 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <vpp/compressedUpload.hpp>
+#include <vpp/buffer.hpp>
+#include <vpp/transfer.hpp>
+#include <vpp/queue.hpp>
+#include <vpp/vk.hpp>
+#include <vpp/util/log.hpp>
+
+#include <atomic> // std::atomic
+#include <mutex> // std::mutex
+#include <condition_variable> // std::condition_variable
+#include <thread> // std::thread
+#include <exception> // std::exception_ptr
+#include <algorithm> // std::min
+#include <vector> // std::vector
+
+namespace vpp {
+namespace {
+
+/// Work implementation owning the staging range and the works of all submitted copies.
+class CompressedUploadWork : public Work<void> {
+public:
+	CompressedUploadWork(TransferRange&& range) : range_(std::move(range)) {}
+	~CompressedUploadWork()
+	{
+		try {
+			finish();
+		} catch(const std::exception& error) {
+			vpp_warn("~CompressedUploadWork"_scope, "finish(): {}", error.what());
+		}
+	}
+
+	void submit() override { for(auto& work : works_) work->submit(); }
+	void wait() override { for(auto& work : works_) work->wait(); }
+	void finish() override
+	{
+		for(auto& work : works_) work->finish();
+		works_.clear();
+		range_ = {};
+	}
+
+	State state() override
+	{
+		auto ret = State::finished;
+		for(auto& work : works_) ret = std::min(ret, work->state());
+		return ret;
+	}
+
+	void add(WorkPtr&& work) { works_.push_back(std::move(work)); }
+
+protected:
+	TransferRange range_; // must outlive the works
+	std::vector<WorkPtr> works_;
+};
+
+/// Decompresses the blocks with the given number of worker threads into dst.
+/// Calls the given function on the calling thread with the indices and offsets of
+/// all blocks that got ready since the last call.
+template<typename F>
+void decompress(nytl::Span<const CompressedBlock> blocks, const Decompressor& decompressor,
+	unsigned int threadCount, uint8_t* dst, F&& onReady)
+{
+	std::vector<std::size_t> offsets;
+	offsets.reserve(blocks.size());
+	auto total = std::size_t {};
+	for(auto& block : blocks) {
+		offsets.push_back(total);
+		total += block.size;
+	}
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::vector<std::size_t> ready;
+	std::exception_ptr error;
+	std::atomic<std::size_t> next {0};
+
+	auto worker = [&]{
+		while(true) {
+			auto i = next++;
+			if(i >= blocks.size()) return;
+
+			try {
+				if(blocks[i].size) {
+					decompressor(blocks[i].data, {dst + offsets[i], blocks[i].size});
+				}
+			} catch(...) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if(!error) error = std::current_exception();
+				next = blocks.size();
+				cv.notify_one();
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			ready.push_back(i);
+			cv.notify_one();
+		}
+	};
+
+	if(!threadCount) threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	threadCount = std::min<std::size_t>(threadCount, blocks.size());
+
+	// makes sure the threads are joined when onReady throws
+	struct Threads {
+		std::vector<std::thread> threads;
+		void join() { for(auto& t : threads) if(t.joinable()) t.join(); }
+		~Threads() { join(); }
+	} threads;
+
+	threads.threads.reserve(threadCount);
+	for(auto i = 0u; i < threadCount; ++i) threads.threads.emplace_back(worker);
+
+	auto done = std::size_t {};
+	std::vector<std::size_t> batch;
+	while(done < blocks.size()) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [&]{ return !ready.empty() || error; });
+			if(error) break;
+
+			batch.clear();
+			std::swap(batch, ready);
+		}
+
+		onReady(nytl::Span<const std::size_t>(batch), nytl::Span<const std::size_t>(offsets));
+		done += batch.size();
+	}
+
+	threads.join();
+	if(error) std::rethrow_exception(error);
+}
+
+} // anonymous util namespace
+
+WorkPtr uploadCompressed(const Buffer& buffer, vk::DeviceSize offset,
+	nytl::Span<const CompressedBlock> blocks, const Decompressor& decompressor,
+	unsigned int threads)
+{
+	buffer.assureMemory();
+
+	auto total = std::size_t {};
+	for(auto& block : blocks) total += block.size;
+	if(!total) return std::make_unique<FinishedWork<void>>();
+
+	// decompress directly into the buffer
+	if(buffer.mappable()) {
+		auto map = buffer.memoryMap();
+		auto coherent = map.coherent();
+		auto ptr = map.ptr() + offset;
+		decompress(blocks, decompressor, threads, ptr, [&](auto batch, auto offsets) {
+			if(coherent) return;
+			for(auto i : batch) {
+				if(blocks[i].size) map.flush({offset + offsets[i], blocks[i].size});
+			}
+		});
+
+		return std::make_unique<FinishedWork<void>>();
+	}
+
+	const Queue* queue;
+	auto qFam = transferQueueFamily(buffer.device(), &queue);
+	if(qFam == -1) throw std::logic_error("vpp::uploadCompressed: device has no valid queue");
+
+	auto& dev = buffer.device();
+	auto stage = dev.transferManager().buffer(total);
+	auto map = stage.buffer().memoryMap();
+	auto coherent = map.coherent();
+	auto stageOffset = stage.offset();
+	auto stageBuffer = stage.buffer().vkHandle();
+
+	auto work = std::make_unique<CompressedUploadWork>(std::move(stage));
+	std::vector<vk::BufferCopy> regions;
+
+	// blocks that are ready at the same time are submitted together
+	decompress(blocks, decompressor, threads, map.ptr() + stageOffset,
+		[&](auto batch, auto offsets) {
+			regions.clear();
+			for(auto i : batch) {
+				// empty blocks would result in invalid copy regions of size 0
+				if(!blocks[i].size) continue;
+
+				auto blockOffset = offsets[i];
+				if(!coherent) map.flush({stageOffset + blockOffset, blocks[i].size});
+				regions.push_back({stageOffset + blockOffset, offset + blockOffset,
+					blocks[i].size});
+			}
+
+			if(regions.empty()) return;
+
+			auto cmdBuffer = dev.commandProvider().get(qFam);
+			vk::beginCommandBuffer(cmdBuffer, {});
+			vk::cmdCopyBuffer(cmdBuffer, stageBuffer, buffer, regions);
+			vk::endCommandBuffer(cmdBuffer);
+
+			auto copyWork = std::make_unique<CommandWork<void>>(std::move(cmdBuffer), *queue);
+			copyWork->submit();
+			work->add(std::move(copyWork));
+		});
+
+	return work;
+}
+
+} // namespace vpp
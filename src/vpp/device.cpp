@@ -7,8 +7,10 @@
 #include <vpp/queue.hpp>
 #include <vpp/commandBuffer.hpp>
 #include <vpp/submit.hpp>
+#include <vpp/completion.hpp>
 #include <vpp/transfer.hpp>
 #include <vpp/physicalDevice.hpp>
+#include <vpp/timelineSemaphore.hpp>
 #include <vpp/util/threadStorage.hpp>
 
 #include <map> // std::map
@@ -28,6 +30,9 @@ struct Device::Impl {
 	std::vector<std::unique_ptr<Queue, Device::QueueDeleter>> queues;
 	std::vector<const Queue*> queuesVec; // cache vector for queues() function
 	std::shared_timed_mutex sharedQueueMutex;
+
+	std::mutex completionMutex;
+	std::unique_ptr<CompletionService> completion; // created on first use
 };
 
 struct Device::Provider {
@@ -50,6 +55,7 @@ Device::Device(vk::Instance ini, vk::PhysicalDevice phdev, const vk::DeviceCreat
 {
 	// (void) vk::getPhysicalDeviceQueueFamilyProperties(phdev);
 	device_ = vk::createDevice(vkPhysicalDevice(), info);
+	timelineSemaphores_ = ext::timelineSemaphoresEnabled(info);
 
 	// we can assume that info.pQueueCreateInfo contains for every
 	// family only one create info entry
@@ -114,11 +120,18 @@ Device::Device(vk::Instance ini, vk::PhysicalDevice phdev,
 	devInfo.pQueueCreateInfos = &queueInfo;
 	devInfo.queueCreateInfoCount = 1;
 
+	// the feature must be supported if the extension is
+	ext::PhysicalDeviceTimelineSemaphoreFeatures timelineFeatures;
+	timelineFeatures.timelineSemaphore = true;
+	if(ext::hasTimelineExtension(extensions)) devInfo.pNext = &timelineFeatures;
+
 	// create the device
 	device_ = vk::createDevice(vkPhysicalDevice(), devInfo);
 	if(!device_)
 		throw std::runtime_error("vpp::Device: device creation failed");
 
+	timelineSemaphores_ = ext::timelineSemaphoresEnabled(devInfo);
+
 	// retrieve the queues and init the device
 	init({{vk::getDeviceQueue(vkDevice(), gfxCompQueueFam, 0), gfxCompQueueFam}});
 }
@@ -185,10 +198,16 @@ Device::Device(vk::Instance ini, vk::SurfaceKHR surface, const Queue*& present,
 
 	devInfo.pQueueCreateInfos = queueInfos;
 
+	ext::PhysicalDeviceTimelineSemaphoreFeatures timelineFeatures;
+	timelineFeatures.timelineSemaphore = true;
+	if(ext::hasTimelineExtension(exts)) devInfo.pNext = &timelineFeatures;
+
 	device_ = vk::createDevice(vkPhysicalDevice(), devInfo);
 	if(!device_)
 		throw std::runtime_error("vpp::Device: device creation failed");
 
+	timelineSemaphores_ = ext::timelineSemaphoresEnabled(devInfo);
+
 	// retrieve the queues and init the device
 	std::vector<std::pair<vk::Queue, unsigned int>> queuePairs;
 	auto presentQueue = vk::getDeviceQueue(vkDevice(), presentQueueFam, 0);
@@ -212,6 +231,8 @@ Device::~Device()
 	// vulkan device.
 	// When adding additional members that depend on the vulkan device, make
 	// sure to destroy them here before calling vk::destroyDevice
+	// The completion service uses the submit manager and must be destroyed first.
+	if(impl_) impl_->completion.reset();
 	provider_.reset();
 	impl_.reset();
 
@@ -306,7 +327,11 @@ int Device::memoryType(vk::MemoryPropertyFlags mflags, unsigned int typeBits) co
 
 unsigned int Device::memoryTypeBits(vk::MemoryPropertyFlags mflags, unsigned int typeBits) const
 {
-	for(auto i = 0u; i < memoryProperties().memoryTypeCount; ++i) {
+	// bits of memory types that don't exist are never valid
+	auto count = memoryProperties().memoryTypeCount;
+	if(count < 32) typeBits &= (1u << count) - 1;
+
+	for(auto i = 0u; i < count; ++i) {
 		if(typeBits & (1 << i)) {
 			if((memoryProperties().memoryTypes[i].propertyFlags & mflags) != mflags)
 				typeBits &= ~(1 << i);
@@ -316,6 +341,33 @@ unsigned int Device::memoryTypeBits(vk::MemoryPropertyFlags mflags, unsigned int
 	return typeBits;
 }
 
+unsigned int Device::memoryTypeBits(MemoryUsage usage, unsigned int typeBits) const
+{
+	using MPB = vk::MemoryPropertyBits;
+
+	// the preferred properties, in order
+	vk::MemoryPropertyFlags preferred[2] {};
+	switch(usage) {
+		case MemoryUsage::hostWrite:
+			preferred[0] = MPB::deviceLocal | MPB::hostVisible;
+			break;
+		case MemoryUsage::hostRead:
+			preferred[0] = MPB::hostVisible | MPB::hostCached;
+			preferred[1] = MPB::hostVisible;
+			break;
+		default:
+			return typeBits;
+	}
+
+	for(auto& flags : preferred) {
+		if(!flags) continue;
+		auto bits = memoryTypeBits(flags, typeBits);
+		if(bits) return bits;
+	}
+
+	return typeBits;
+}
+
 DeviceMemoryAllocator& Device::deviceAllocator() const
 {
 	auto ptr = impl_->tls.get(impl_->tlsDeviceAllocatorID); // DynamicStoragePtr*
@@ -344,6 +396,16 @@ SubmitManager& Device::submitManager() const
 	return provider_->submit;
 }
 
+CompletionService& Device::completionService() const
+{
+	std::lock_guard<std::mutex> lock(impl_->completionMutex);
+	if(!impl_->completion) {
+		impl_->completion = std::make_unique<CompletionService>(*this);
+	}
+
+	return *impl_->completion;
+}
+
 TransferManager& Device::transferManager() const
 {
 	return provider_->transfer;
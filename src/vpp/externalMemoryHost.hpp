@@ -0,0 +1,42 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <vpp/fwd.hpp>
+#include <vpp/vulkan/enums.hpp>
+
+// VK_EXT_external_memory_host is newer than the generated vulkan api, therefore
+// the used parts of it are declared here manually.
+// Used internally for importing host memory (DeviceMemory, Buffer).
+
+namespace vpp {
+namespace ext {
+
+constexpr auto externalMemoryHostExtensionName = "VK_EXT_external_memory_host";
+
+constexpr auto importMemoryHostPointerInfoEXT = static_cast<vk::StructureType>(1000178000);
+constexpr auto memoryHostPointerPropertiesEXT = static_cast<vk::StructureType>(1000178001);
+
+/// VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT
+constexpr auto hostAllocationBit = 0x00000080u;
+
+struct ImportMemoryHostPointerInfo {
+	vk::StructureType sType {importMemoryHostPointerInfoEXT};
+	const void* pNext {};
+	uint32_t handleType {hostAllocationBit};
+	void* pHostPointer {};
+};
+
+struct MemoryHostPointerProperties {
+	vk::StructureType sType {memoryHostPointerPropertiesEXT};
+	void* pNext {};
+	uint32_t memoryTypeBits {};
+};
+
+using PfnGetMemoryHostPointerProperties = vk::Result(*VKAPI_PTR)(vk::Device device,
+	uint32_t handleType, const void* pHostPointer, MemoryHostPointerProperties* properties);
+
+} // namespace ext
+} // namespace vpp
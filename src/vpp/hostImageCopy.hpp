@@ -0,0 +1,88 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <vpp/fwd.hpp>
+#include <vpp/vulkan/enums.hpp>
+#include <vpp/vulkan/structs.hpp>
+
+// VK_EXT_host_image_copy is newer than the generated vulkan api, therefore
+// the used parts of it are declared here manually.
+// Used internally for filling and retrieving images without staging buffer.
+
+namespace vpp {
+namespace ext {
+
+constexpr auto hostImageCopyExtensionName = "VK_EXT_host_image_copy";
+
+constexpr auto memoryToImageCopyEXT = static_cast<vk::StructureType>(1000270002);
+constexpr auto imageToMemoryCopyEXT = static_cast<vk::StructureType>(1000270003);
+constexpr auto copyImageToMemoryInfoEXT = static_cast<vk::StructureType>(1000270004);
+constexpr auto copyMemoryToImageInfoEXT = static_cast<vk::StructureType>(1000270005);
+constexpr auto hostImageLayoutTransitionInfoEXT = static_cast<vk::StructureType>(1000270006);
+
+/// VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT
+constexpr auto imageUsageHostTransferBit = 0x00400000u;
+
+struct MemoryToImageCopy {
+	vk::StructureType sType {memoryToImageCopyEXT};
+	const void* pNext {};
+	const void* pHostPointer {};
+	uint32_t memoryRowLength {};
+	uint32_t memoryImageHeight {};
+	vk::ImageSubresourceLayers imageSubresource {};
+	vk::Offset3D imageOffset {};
+	vk::Extent3D imageExtent {};
+};
+
+struct ImageToMemoryCopy {
+	vk::StructureType sType {imageToMemoryCopyEXT};
+	const void* pNext {};
+	void* pHostPointer {};
+	uint32_t memoryRowLength {};
+	uint32_t memoryImageHeight {};
+	vk::ImageSubresourceLayers imageSubresource {};
+	vk::Offset3D imageOffset {};
+	vk::Extent3D imageExtent {};
+};
+
+struct CopyMemoryToImageInfo {
+	vk::StructureType sType {copyMemoryToImageInfoEXT};
+	const void* pNext {};
+	uint32_t flags {};
+	vk::Image dstImage {};
+	vk::ImageLayout dstImageLayout {};
+	uint32_t regionCount {};
+	const MemoryToImageCopy* pRegions {};
+};
+
+struct CopyImageToMemoryInfo {
+	vk::StructureType sType {copyImageToMemoryInfoEXT};
+	const void* pNext {};
+	uint32_t flags {};
+	vk::Image srcImage {};
+	vk::ImageLayout srcImageLayout {};
+	uint32_t regionCount {};
+	const ImageToMemoryCopy* pRegions {};
+};
+
+struct HostImageLayoutTransitionInfo {
+	vk::StructureType sType {hostImageLayoutTransitionInfoEXT};
+	const void* pNext {};
+	vk::Image image {};
+	vk::ImageLayout oldLayout {};
+	vk::ImageLayout newLayout {};
+	vk::ImageSubresourceRange subresourceRange {};
+};
+
+using PfnCopyMemoryToImage = vk::Result(*VKAPI_PTR)(vk::Device device,
+	const CopyMemoryToImageInfo* info);
+using PfnCopyImageToMemory = vk::Result(*VKAPI_PTR)(vk::Device device,
+	const CopyImageToMemoryInfo* info);
+using PfnTransitionImageLayout = vk::Result(*VKAPI_PTR)(vk::Device device,
+	uint32_t transitionCount, const HostImageLayoutTransitionInfo* transitions);
+
+} // namespace ext
+} // namespace vpp
@@ -5,38 +5,224 @@
 #include <vpp/image.hpp>
 #include <vpp/transfer.hpp> // vpp::TransferManager
 #include <vpp/transferWork.hpp> // vpp::transferWork
+#include <vpp/hostImageCopy.hpp> // vpp::ext::CopyMemoryToImageInfo
+#include <vpp/procAddr.hpp> // vpp::vulkanProc
 #include <vpp/queue.hpp> // vpp::Queue
+#include <vpp/pixelConvert.hpp> // vpp::convertPixels
 #include <vpp/util/log.hpp> // dlg_check
 #include <vpp/vk.hpp>
 
+#include <algorithm> // std::max, std::min, std::find_if
 #include <utility> // std::move, std::swap
 #include <cstring> // std::memcpy
 #include <memory> // std::make_unique
+#include <numeric> // std::lcm
 #include <vector> // std::vector
+#include <stdexcept> // std::logic_error
 
 namespace vpp {
 namespace {
 
-/// Returns the memory address for an image for the given parameters.
-vk::DeviceSize imageAddress(const vk::SubresourceLayout& layout, unsigned int texelSize,
-	unsigned int x, unsigned int y, unsigned int z, unsigned int layer)
+/// Returns the memory address of the given texel in a subresource with the given layout.
+/// For compressed formats, the texel must be the first one of a block.
+vk::DeviceSize imageAddress(const vk::SubresourceLayout& layout, vk::Format format,
+	unsigned int x, unsigned int y, unsigned int z)
 {
-	return layer * layout.arrayPitch + z * layout.depthPitch + y * layout.rowPitch +
-		x * texelSize + layout.offset;
+	auto block = blockSize(format);
+	return z * layout.depthPitch + (y / block.height) * layout.rowPitch +
+		(x / block.width) * formatSize(format) + layout.offset;
 }
 
+/// Returns the size of the given region when tightly packed.
+vk::DeviceSize regionSize(const vk::BufferImageCopy& region, vk::Format format)
+{
+	return dataSize(format, region.imageExtent) * region.imageSubresource.layerCount;
+}
+
+/// Returns the size of the tightly packed data for all given regions.
+vk::DeviceSize regionsSize(nytl::Span<const vk::BufferImageCopy> regions, vk::Format format)
+{
+	vk::DeviceSize size = 0u;
+	for(auto& region : regions)
+		size = std::max(size, region.bufferOffset + regionSize(region, format));
+	return size;
+}
+
+/// Returns the alignment of staging buffer ranges for copies of the given format.
+/// The buffer offset of copies must be a multiple of the texel (block) size and of 4.
+std::size_t stagingAlignment(vk::Format format)
+{
+	return std::lcm(std::size_t(formatSize(format)), std::size_t(4u));
+}
+
+/// Returns the subresource range covering all given regions.
+vk::ImageSubresourceRange coveredRange(nytl::Span<const vk::BufferImageCopy> regions)
+{
+	auto& first = regions[0].imageSubresource;
+	vk::ImageSubresourceRange range {first.aspectMask, first.mipLevel, 1,
+		first.baseArrayLayer, first.layerCount};
+
+	for(auto& region : regions) {
+		auto& sub = region.imageSubresource;
+		auto levelEnd = std::max(range.baseMipLevel + range.levelCount, sub.mipLevel + 1);
+		auto layerEnd = std::max(range.baseArrayLayer + range.layerCount,
+			sub.baseArrayLayer + sub.layerCount);
+
+		range.aspectMask |= sub.aspectMask;
+		range.baseMipLevel = std::min(range.baseMipLevel, sub.mipLevel);
+		range.baseArrayLayer = std::min(range.baseArrayLayer, sub.baseArrayLayer);
+		range.levelCount = levelEnd - range.baseMipLevel;
+		range.layerCount = layerEnd - range.baseArrayLayer;
+	}
+
+	return range;
+}
+
+/// Returns the offset in data of the given data format for the given offset
+/// in tightly packed data of the image format.
+vk::DeviceSize dataOffset(vk::DeviceSize offset, vk::Format format, vk::Format dataFormat)
+{
+	if(format == dataFormat) return offset;
+	return offset / formatSize(format) * formatSize(dataFormat);
+}
+
+/// Copies count texels between data of the data format and memory of the image
+/// format, converting them if the formats differ.
+void copyTexels(uint8_t* image, uint8_t* data, vk::Format format, vk::Format dataFormat,
+	std::size_t size, bool toImage)
+{
+	if(format == dataFormat) {
+		if(toImage) std::memcpy(image, data, size);
+		else std::memcpy(data, image, size);
+		return;
+	}
+
+	auto count = size / formatSize(format);
+	if(toImage) convertPixels(dataFormat, data, format, image, count);
+	else convertPixels(format, image, dataFormat, data, count);
+}
+
+/// Copies the given region between the tightly packed data and the mapped
+/// memory of a linear image. If the rows of the image are contiguous, only one
+/// copy per slice is needed. Converts the texels from/to the data format.
+void mapCopy(const Image& image, uint8_t* mapped, uint8_t* data,
+	const vk::BufferImageCopy& region, vk::Format format, vk::Format dataFormat,
+	bool toImage)
+{
+	auto& sub = region.imageSubresource;
+	auto& offset = region.imageOffset;
+	auto& extent = region.imageExtent;
+
+	// rows of compressed formats are rows of blocks
+	auto blocks = blockExtent(format, extent);
+	auto rowSize = vk::DeviceSize(formatSize(format)) * blocks.width;
+	auto rowHeight = blockSize(format).height;
+	auto copy = [&](vk::DeviceSize address, std::size_t size) {
+		copyTexels(mapped + address, data, format, dataFormat, size, toImage);
+		data += dataOffset(size, format, dataFormat);
+	};
+
+	data += dataOffset(region.bufferOffset, format, dataFormat);
+	for(auto layer = sub.baseArrayLayer; layer < sub.baseArrayLayer + sub.layerCount; ++layer) {
+		auto& layout = image.subresourceLayout({sub.aspectMask, sub.mipLevel, layer});
+		auto contiguous = (layout.rowPitch == rowSize);
+
+		for(auto z = 0u; z < blocks.depth; ++z) {
+			auto d = offset.z + z;
+			if(contiguous) {
+				copy(imageAddress(layout, format, offset.x, offset.y, d),
+					rowSize * blocks.height);
+				continue;
+			}
+
+			for(auto y = 0u; y < blocks.height; ++y) {
+				auto row = offset.y + y * rowHeight;
+				copy(imageAddress(layout, format, offset.x, row, d), rowSize);
+			}
+		}
+	}
+}
+
+/// Returns whether the host can copy to (or from) an image in the given layout
+/// using VK_EXT_host_image_copy. The general layout is always supported for host
+/// copies. Undefined and preinitialized images can be transitioned to it by the host.
+bool hostCopyable(vk::ImageLayout layout, bool write)
+{
+	return layout == vk::ImageLayout::general ||
+		layout == vk::ImageLayout::preinitialized ||
+		(write && layout == vk::ImageLayout::undefined);
+}
+
+/// Transitions the given subresource range to the general layout on the host
+/// if it is not already in it.
+void hostTransition(const Image& image, vk::ImageLayout& layout,
+	const vk::ImageSubresourceRange& range)
+{
+	if(layout == vk::ImageLayout::general) return;
+
+	auto pfTransitionImageLayout = reinterpret_cast<ext::PfnTransitionImageLayout>(
+		vulkanProc(image.vkDevice(), "vkTransitionImageLayoutEXT"));
+
+	ext::HostImageLayoutTransitionInfo transition;
+	transition.image = image;
+	transition.oldLayout = layout;
+	transition.newLayout = vk::ImageLayout::general;
+	transition.subresourceRange = range;
+	VPP_CALL(pfTransitionImageLayout(image.vkDevice(), 1, &transition));
+
+	layout = vk::ImageLayout::general;
+}
+
+/// Download work that converts the downloaded texels into the data format
+/// directly from the (mapped) download memory when the data is retrieved.
+class ConvertingDownloadWork : public DownloadWork {
+public:
+	ConvertingDownloadWork(CommandBuffer&& cmdBuf, const Queue& queue, TransferRange&& range,
+		vk::Format format, vk::Format dataFormat) :
+			DownloadWork(std::move(cmdBuf), queue, std::move(range)),
+			format_(format), dataFormat_(dataFormat) {}
+
+	nytl::Span<const uint8_t> data() override
+	{
+		if(converted_.empty()) {
+			auto data = DownloadWork::data();
+			auto ptr = const_cast<uint8_t*>(data.data()); // only read from
+			converted_.resize(dataOffset(data.size(), format_, dataFormat_));
+			copyTexels(ptr, converted_.data(), format_, dataFormat_, data.size(), false);
+		}
+
+		return converted_;
+	}
+
+protected:
+	vk::Format format_;
+	vk::Format dataFormat_;
+	std::vector<uint8_t> converted_;
+};
+
 } // anonymous util namespace
 
 // Image
 Image::Image(const Device& dev, const vk::ImageCreateInfo& info, unsigned int memoryTypeBits)
 {
 	handle_ = vk::createImage(dev.vkDevice(), info);
+	hostTransfer_ = info.usage.value() & ext::imageUsageHostTransferBit;
 	auto reqs = vk::getImageMemoryRequirements(dev.vkDevice(), vkHandle());
 
 	reqs.memoryTypeBits &= memoryTypeBits;
 	dev.deviceAllocator().request(vkHandle(), reqs, info.tiling, memoryEntry_);
 }
 
+Image::Image(const Device& dev, const vk::ImageCreateInfo& info, MemoryUsage usage)
+{
+	handle_ = vk::createImage(dev.vkDevice(), info);
+	hostTransfer_ = info.usage.value() & ext::imageUsageHostTransferBit;
+	auto reqs = vk::getImageMemoryRequirements(dev.vkDevice(), vkHandle());
+
+	reqs.memoryTypeBits = dev.memoryTypeBits(usage, reqs.memoryTypeBits);
+	dev.deviceAllocator().request(vkHandle(), reqs, info.tiling, memoryEntry_);
+}
+
 Image::Image(const Device& dev, vk::Image image, vk::ImageTiling tiling,
 	unsigned int memoryTypeBits)
 {
@@ -57,171 +243,326 @@ Image::~Image()
 	if(vkHandle()) vk::destroyImage(device(), vkHandle());
 }
 
+void swap(Image& a, Image& b) noexcept
+{
+	using std::swap;
+	using MR = MemoryResource<vk::Image>;
+
+	swap(static_cast<MR&>(a), static_cast<MR&>(b));
+	swap(a.hostTransfer_, b.hostTransfer_);
+	swap(a.layouts_, b.layouts_);
+}
+
+const vk::SubresourceLayout& Image::subresourceLayout(const vk::ImageSubresource& subres) const
+{
+	std::lock_guard<std::mutex> lock(layoutsMutex_);
+	auto it = std::find_if(layouts_.begin(), layouts_.end(), [&](auto& entry) {
+		return entry.first.aspectMask == subres.aspectMask &&
+			entry.first.mipLevel == subres.mipLevel &&
+			entry.first.arrayLayer == subres.arrayLayer;
+	});
+
+	if(it != layouts_.end()) return it->second;
+
+	auto layout = vk::getImageSubresourceLayout(device(), vkHandle(), subres);
+	layouts_.emplace_back(subres, layout);
+	return layouts_.back().second;
+}
+
 WorkPtr fill(const Image& image, const uint8_t& data, vk::Format format,
 	vk::ImageLayout& layout, const vk::Extent3D& extent, const vk::ImageSubresource& subres,
-	const vk::Offset3D& offset, bool allowMap)
+	const vk::Offset3D& offset, bool allowMap, vk::Format dataFormat)
 {
-	image.assureMemory();
-	const auto texSize = formatSize(format);
+	if(dataFormat == vk::Format::undefined) dataFormat = format;
 
-	if(image.mappable() && allowMap) {
+	vk::BufferImageCopy region;
+	region.imageSubresource = {subres.aspectMask, subres.mipLevel, subres.arrayLayer, 1};
+	region.imageOffset = offset;
+	region.imageExtent = {extent.width, extent.height, std::max(extent.depth, 1u)};
 
-		// baiscally the size of the format in bytes. Can be computed from the given size/extent.
-		auto sresLayout = vk::getImageSubresourceLayout(image.device(), image, subres);
-		auto map = image.memoryEntry().map();
-
-		// make it work for 2d images that specify a depth of zero
-		auto depth = extent.depth ? extent.depth : 1;
-		auto doffset = 0u; // current data offset
-		for(unsigned int d = offset.z; d < offset.z + depth; ++d) {
-			for(unsigned int h = offset.y; h < offset.y + extent.height; ++h) {
-				auto ioff = imageAddress(sresLayout, texSize, offset.x, h, d, subres.arrayLayer);
-				std::memcpy(map.ptr() + ioff, &data + doffset, texSize * extent.width);
-				doffset += extent.width * texSize;
-			}
+	auto size = dataOffset(regionSize(region, format), format, dataFormat);
+	return fill(image, {&data, size}, format, layout, {region}, allowMap, dataFormat);
+}
+
+WorkPtr fill(const Image& image, nytl::Span<const uint8_t> data, vk::Format format,
+	vk::ImageLayout& layout, nytl::Span<const vk::BufferImageCopy> regions, bool allowMap,
+	vk::Format dataFormat)
+{
+	if(dataFormat == vk::Format::undefined) dataFormat = format;
+	const auto size = regionsSize(regions, format);
+	const auto src = const_cast<uint8_t*>(data.data()); // only read from
+
+	image.assureMemory();
+	dlg_check("fill(image)", {
+		if(regions.empty()) vpp_error("no regions given");
+		if(dataOffset(size, format, dataFormat) > data.size()) vpp_error("data too small");
+		if(!pixelConvertible(dataFormat, format)) vpp_error("formats not convertible");
+	});
+
+	// copy directly from the host, without staging buffer and submission
+	if(image.hostTransfer() && hostCopyable(layout, true)) {
+		hostTransition(image, layout, coveredRange(regions));
+
+		// the host copy cannot convert, therefore convert it beforehand
+		std::vector<uint8_t> converted;
+		auto hostData = data.data();
+		if(dataFormat != format) {
+			converted.resize(size);
+			copyTexels(converted.data(), src, format, dataFormat, size, true);
+			hostData = converted.data();
 		}
 
+		std::vector<ext::MemoryToImageCopy> copies(regions.size());
+		for(auto i = 0u; i < regions.size(); ++i) {
+			copies[i].pHostPointer = hostData + regions[i].bufferOffset;
+			copies[i].imageSubresource = regions[i].imageSubresource;
+			copies[i].imageOffset = regions[i].imageOffset;
+			copies[i].imageExtent = regions[i].imageExtent;
+		}
+
+		ext::CopyMemoryToImageInfo info;
+		info.dstImage = image;
+		info.dstImageLayout = layout;
+		info.regionCount = copies.size();
+		info.pRegions = copies.data();
+
+		auto pfCopyMemoryToImage = reinterpret_cast<ext::PfnCopyMemoryToImage>(
+			vulkanProc(image.vkDevice(), "vkCopyMemoryToImageEXT"));
+		VPP_CALL(pfCopyMemoryToImage(image.vkDevice(), &info));
+		return std::make_unique<FinishedWork<void>>();
+	}
+
+	if(image.mappable() && allowMap) {
+		auto map = image.memoryMap();
+		for(auto& region : regions)
+			mapCopy(image, map.ptr(), src, region, format, dataFormat, true);
+
 		if(!map.coherent()) map.flush();
 		return std::make_unique<FinishedWork<void>>();
-	} else {
-		const auto byteSize = texSize * extent.width * extent.height * extent.depth;
-		const Queue* queue;
-		auto qFam = transferQueueFamily(image.device(), &queue);
-		auto cmdBuffer = image.device().commandProvider().get(qFam);
-		auto uploadBuffer = image.device().transferManager().buffer(byteSize);
-		fill140(uploadBuffer.buffer(), raw(data, byteSize));
+	}
 
-		vk::BufferImageCopy region;
-		region.imageOffset = offset;
-		region.imageExtent = extent;
-		region.imageSubresource = {subres.aspectMask, subres.mipLevel, subres.arrayLayer, 1};
+	// upload all regions with one staging range and one copy command
+	const Queue* queue;
+	auto qFam = transferQueueFamily(image.device(), &queue);
+	if(qFam == -1) throw std::logic_error("vpp::fill(image): device has no valid queue");
 
-		vk::beginCommandBuffer(cmdBuffer, {});
+	auto cmdBuffer = image.device().commandProvider().get(qFam);
+	auto uploadBuffer = image.device().transferManager().buffer(size,
+		stagingAlignment(format));
 
-		// change layout if needed
-		if(layout != vk::ImageLayout::transferDstOptimal && layout != vk::ImageLayout::general) {
-			changeLayoutCommand(cmdBuffer, image, layout, vk::ImageLayout::transferDstOptimal,
-				{subres.aspectMask, subres.mipLevel, 1, subres.arrayLayer, 1});
-			layout = vk::ImageLayout::transferDstOptimal;
-		}
+	// converted directly into the staging memory
+	{
+		auto map = uploadBuffer.buffer().memoryMap();
+		copyTexels(map.ptr() + uploadBuffer.offset(), src, format, dataFormat, size, true);
+		if(!map.coherent()) map.flush();
+	}
+
+	std::vector<vk::BufferImageCopy> copies(regions.begin(), regions.end());
+	for(auto& copy : copies) copy.bufferOffset += uploadBuffer.offset();
+
+	vk::beginCommandBuffer(cmdBuffer, {});
+	BarrierBatch batch(cmdBuffer);
+
+	// change layout if needed
+	if(layout != vk::ImageLayout::transferDstOptimal && layout != vk::ImageLayout::general) {
+		changeLayoutCommand(batch, image, layout, vk::ImageLayout::transferDstOptimal,
+			coveredRange(regions), queue->properties().queueFlags);
+		layout = vk::ImageLayout::transferDstOptimal;
+	}
+
+	vk::cmdCopyBufferToImage(batch.record(), uploadBuffer.buffer(), image, layout, copies);
+	vk::endCommandBuffer(cmdBuffer);
+
+	return std::make_unique<UploadWork>(std::move(cmdBuffer), *queue, std::move(uploadBuffer));
+}
+
+WorkPtr fill(const Image& image, const Buffer& src, vk::DeviceSize srcOffset,
+	vk::ImageLayout& layout, const vk::Extent3D& extent, const vk::ImageSubresource& subres,
+	const vk::Offset3D& offset)
+{
+	image.assureMemory();
+
+	const Queue* queue;
+	auto qFam = transferQueueFamily(image.device(), &queue);
+	if(qFam == -1) throw std::logic_error("vpp::fill(image): device has no valid queue");
+	auto cmdBuffer = image.device().commandProvider().get(qFam);
 
-		vk::cmdCopyBufferToImage(cmdBuffer, uploadBuffer.buffer(), image, layout, {region});
-		vk::endCommandBuffer(cmdBuffer);
+	vk::BufferImageCopy region;
+	region.bufferOffset = srcOffset;
+	region.imageOffset = offset;
+	region.imageExtent = extent;
+	region.imageSubresource = {subres.aspectMask, subres.mipLevel, subres.arrayLayer, 1};
 
-		return std::make_unique<UploadWork>(std::move(cmdBuffer), *queue, std::move(uploadBuffer));
+	vk::beginCommandBuffer(cmdBuffer, {});
+	BarrierBatch batch(cmdBuffer);
+
+	// change layout if needed
+	if(layout != vk::ImageLayout::transferDstOptimal && layout != vk::ImageLayout::general) {
+		changeLayoutCommand(batch, image, layout, vk::ImageLayout::transferDstOptimal,
+			{subres.aspectMask, subres.mipLevel, 1, subres.arrayLayer, 1},
+			queue->properties().queueFlags);
+		layout = vk::ImageLayout::transferDstOptimal;
 	}
+
+	vk::cmdCopyBufferToImage(batch.record(), src, image, layout, {region});
+	vk::endCommandBuffer(cmdBuffer);
+
+	return std::make_unique<CommandWork<void>>(std::move(cmdBuffer), *queue);
 }
 
 DataWorkPtr retrieve(const Image& image, vk::ImageLayout& layout, vk::Format format,
 	const vk::Extent3D& extent, const vk::ImageSubresource& subres, const vk::Offset3D& offset,
-	bool allowMap)
+	bool allowMap, vk::Format dataFormat)
 {
+	vk::BufferImageCopy region;
+	region.imageSubresource = {subres.aspectMask, subres.mipLevel, subres.arrayLayer, 1};
+	region.imageOffset = offset;
+	region.imageExtent = {extent.width, extent.height, std::max(extent.depth, 1u)};
+	return retrieve(image, layout, format, {region}, allowMap, dataFormat);
+}
+
+DataWorkPtr retrieve(const Image& image, vk::ImageLayout& layout, vk::Format format,
+	nytl::Span<const vk::BufferImageCopy> regions, bool allowMap, vk::Format dataFormat)
+{
+	if(dataFormat == vk::Format::undefined) dataFormat = format;
+
 	dlg_check("retrieve(image)", {
 		if(!image.memoryEntry().allocated()) vpp_error("Image has no memory");
+		if(regions.empty()) vpp_error("no regions given");
+		if(!pixelConvertible(format, dataFormat)) vpp_error("formats not convertible");
 	})
 
-	if(image.mappable() && allowMap) {
-		std::vector<std::uint8_t> data(image.memorySize());
-		auto map = image.memoryMap();
+	const auto size = regionsSize(regions, format);
+	const auto convertedSize = dataOffset(size, format, dataFormat);
 
-		//baiscally the size of the format in bytes. Can be computed from the given size/extent.
-		const auto texelSize = formatSize(format);
-		auto subresLayout = vk::getImageSubresourceLayout(image.device(), image, subres);
-
-		auto depth = extent.depth ? extent.depth : 1;
-		auto doffset = 0u; // dataOffset
-		for(unsigned int d = offset.z; d < offset.z + depth; ++d) {
-			for(unsigned int h = offset.y; h < offset.y + extent.height; ++h) {
-				auto ioffset = imageAddress(subresLayout, texelSize, 0, h, d, subres.arrayLayer);
-				std::memcpy(data.data() + doffset, map.ptr() + ioffset, extent.width);
-				doffset += extent.width;
-			}
+	// copy directly to the host, without staging buffer and submission
+	if(image.hostTransfer() && hostCopyable(layout, false)) {
+		hostTransition(image, layout, coveredRange(regions));
+
+		std::vector<std::uint8_t> data(size);
+		std::vector<ext::ImageToMemoryCopy> copies(regions.size());
+		for(auto i = 0u; i < regions.size(); ++i) {
+			copies[i].pHostPointer = data.data() + regions[i].bufferOffset;
+			copies[i].imageSubresource = regions[i].imageSubresource;
+			copies[i].imageOffset = regions[i].imageOffset;
+			copies[i].imageExtent = regions[i].imageExtent;
 		}
 
-		return std::make_unique<StoredDataWork>(std::move(data));
-	} else {
-		const Queue* queue;
-		auto qFam = transferQueueFamily(image.device(), &queue);
-		auto cmdBuffer = image.device().commandProvider().get(qFam);
-		auto downloadBuffer = image.device().transferManager().buffer(image.memorySize());
-
-		vk::beginCommandBuffer(cmdBuffer, {});
-
-		//change layout if needed
-		if(layout != vk::ImageLayout::transferSrcOptimal && layout != vk::ImageLayout::general) {
-			changeLayoutCommand(cmdBuffer, image, layout, vk::ImageLayout::transferSrcOptimal,
-				{subres.aspectMask, subres.mipLevel, 1, subres.arrayLayer, 1});
-			layout = vk::ImageLayout::transferSrcOptimal;
+		ext::CopyImageToMemoryInfo info;
+		info.srcImage = image;
+		info.srcImageLayout = layout;
+		info.regionCount = copies.size();
+		info.pRegions = copies.data();
+
+		auto pfCopyImageToMemory = reinterpret_cast<ext::PfnCopyImageToMemory>(
+			vulkanProc(image.vkDevice(), "vkCopyImageToMemoryEXT"));
+		VPP_CALL(pfCopyImageToMemory(image.vkDevice(), &info));
+
+		// the host copy cannot convert, therefore convert it afterwards
+		if(dataFormat != format) {
+			std::vector<std::uint8_t> converted(convertedSize);
+			copyTexels(data.data(), converted.data(), format, dataFormat, size, false);
+			data = std::move(converted);
 		}
 
-		vk::BufferImageCopy region;
-		region.imageOffset = offset;
-		region.imageExtent = extent;
-		region.imageSubresource = {subres.aspectMask, subres.mipLevel, subres.arrayLayer, 1};
+		return std::make_unique<StoredDataWork>(std::move(data));
+	}
 
-		vk::cmdCopyImageToBuffer(cmdBuffer, image, layout, downloadBuffer.buffer(), {region});
-		vk::endCommandBuffer(cmdBuffer);
+	if(image.mappable() && allowMap) {
+		std::vector<std::uint8_t> data(convertedSize);
+		auto map = image.memoryMap();
+		if(!map.coherent()) map.reload();
 
-		return std::make_unique<DownloadWork>(std::move(cmdBuffer), *queue,
-			std::move(downloadBuffer));
+		for(auto& region : regions)
+			mapCopy(image, map.ptr(), data.data(), region, format, dataFormat, false);
+		return std::make_unique<StoredDataWork>(std::move(data));
+	}
+
+	// download all regions into one staging range with one copy command
+	const Queue* queue;
+	auto qFam = transferQueueFamily(image.device(), &queue);
+	if(qFam == -1) throw std::logic_error("vpp::retrieve(image): device has no valid queue");
+
+	auto cmdBuffer = image.device().commandProvider().get(qFam);
+	auto downloadBuffer = image.device().transferManager().buffer(size,
+		stagingAlignment(format));
+
+	std::vector<vk::BufferImageCopy> copies(regions.begin(), regions.end());
+	for(auto& copy : copies) copy.bufferOffset += downloadBuffer.offset();
+
+	vk::beginCommandBuffer(cmdBuffer, {});
+	BarrierBatch batch(cmdBuffer);
+
+	// change layout if needed
+	if(layout != vk::ImageLayout::transferSrcOptimal && layout != vk::ImageLayout::general) {
+		changeLayoutCommand(batch, image, layout, vk::ImageLayout::transferSrcOptimal,
+			coveredRange(regions), queue->properties().queueFlags);
+		layout = vk::ImageLayout::transferSrcOptimal;
+	}
+
+	vk::cmdCopyImageToBuffer(batch.record(), image, layout, downloadBuffer.buffer(), copies);
+	vk::endCommandBuffer(cmdBuffer);
+
+	if(dataFormat != format) {
+		return std::make_unique<ConvertingDownloadWork>(std::move(cmdBuffer), *queue,
+			std::move(downloadBuffer), format, dataFormat);
 	}
+
+	return std::make_unique<DownloadWork>(std::move(cmdBuffer), *queue,
+		std::move(downloadBuffer));
+}
+
+std::vector<vk::BufferImageCopy> mipRegions(vk::Format format, const vk::Extent3D& extent,
+	vk::ImageAspectFlags aspect, unsigned int levels, unsigned int layers,
+	unsigned int baseLevel, unsigned int baseLayer)
+{
+	std::vector<vk::BufferImageCopy> regions;
+	regions.reserve(levels);
+
+	vk::DeviceSize offset = 0u;
+	for(auto i = 0u; i < levels; ++i) {
+		auto level = baseLevel + i;
+
+		vk::BufferImageCopy region;
+		region.bufferOffset = offset;
+		region.imageSubresource = {aspect, level, baseLayer, layers};
+		region.imageExtent.width = std::max(extent.width >> level, 1u);
+		region.imageExtent.height = std::max(extent.height >> level, 1u);
+		region.imageExtent.depth = std::max(extent.depth >> level, 1u);
+
+		offset += regionSize(region, format);
+		regions.push_back(region);
+	}
+
+	return regions;
 }
 
 //free utility functions
-void changeLayoutCommand(vk::CommandBuffer cmdBuffer, vk::Image img, vk::ImageLayout ol,
-	vk::ImageLayout nl, const vk::ImageSubresourceRange& range)
+void changeLayoutCommand(BarrierBatch& batch, vk::Image img, vk::ImageLayout ol,
+	vk::ImageLayout nl, const vk::ImageSubresourceRange& range, vk::QueueFlags queueFlags)
 {
+	auto src = layoutAccess(ol, queueFlags);
+	auto dst = layoutAccess(nl, queueFlags);
+
+	// previous reads only need an execution dependency
 	vk::ImageMemoryBarrier barrier;
+	barrier.srcAccessMask = src.access & writeAccessBits;
+	barrier.dstAccessMask = dst.access;
 	barrier.oldLayout = ol;
 	barrier.newLayout = nl;
+	barrier.srcQueueFamilyIndex = vk::queueFamilyIgnored;
+	barrier.dstQueueFamilyIndex = vk::queueFamilyIgnored;
 	barrier.image = img;
 	barrier.subresourceRange = range;
 
-	switch(ol) {
-		case vk::ImageLayout::undefined:
-			barrier.srcAccessMask = {}; break;
-		case vk::ImageLayout::preinitialized:
-			barrier.srcAccessMask = vk::AccessBits::hostWrite; break;
-		case vk::ImageLayout::colorAttachmentOptimal:
-			barrier.srcAccessMask = vk::AccessBits::colorAttachmentWrite; break;
-		case vk::ImageLayout::depthStencilAttachmentOptimal:
-			barrier.srcAccessMask = vk::AccessBits::depthStencilAttachmentWrite; break;
-		case vk::ImageLayout::transferSrcOptimal:
-			barrier.srcAccessMask = vk::AccessBits::transferRead; break;
-		case vk::ImageLayout::transferDstOptimal:
-			barrier.srcAccessMask = vk::AccessBits::transferWrite; break;
-		case vk::ImageLayout::shaderReadOnlyOptimal:
-			barrier.srcAccessMask = vk::AccessBits::shaderRead; break;
-		default:
-			break;
-	}
-
-	switch(nl) {
-		case vk::ImageLayout::transferDstOptimal:
-			barrier.dstAccessMask = vk::AccessBits::transferWrite; break;
-			break;
-		case vk::ImageLayout::transferSrcOptimal:
-			barrier.srcAccessMask |= vk::AccessBits::transferRead;
-			barrier.dstAccessMask = vk::AccessBits::transferRead;
-			break;
-		case vk::ImageLayout::colorAttachmentOptimal:
-			barrier.srcAccessMask = vk::AccessBits::transferRead;
-			barrier.dstAccessMask = vk::AccessBits::colorAttachmentWrite;
-			break;
-		case vk::ImageLayout::depthStencilAttachmentOptimal:
-			barrier.dstAccessMask |= vk::AccessBits::depthStencilAttachmentWrite;
-			break;
-		case vk::ImageLayout::shaderReadOnlyOptimal:
-			if(!barrier.srcAccessMask)
-				barrier.srcAccessMask = vk::AccessBits::hostWrite | vk::AccessBits::transferWrite;
-			barrier.dstAccessMask = vk::AccessBits::shaderRead;
-			break;
-		default:
-			break;
-	}
+	batch.barrier(src.stages, dst.stages, barrier);
+}
 
-	const auto stage = vk::PipelineStageBits::topOfPipe;
-	vk::cmdPipelineBarrier(cmdBuffer, stage, stage, {}, {}, {}, {barrier});
+void changeLayoutCommand(vk::CommandBuffer cmdBuffer, vk::Image img, vk::ImageLayout ol,
+	vk::ImageLayout nl, const vk::ImageSubresourceRange& range, vk::QueueFlags queueFlags)
+{
+	BarrierBatch batch(cmdBuffer);
+	changeLayoutCommand(batch, img, ol, nl, range, queueFlags);
 }
 
 WorkPtr changeLayout(const Device& dev, vk::Image img, vk::ImageLayout ol, vk::ImageLayout nl,
@@ -232,7 +573,7 @@ WorkPtr changeLayout(const Device& dev, vk::Image img, vk::ImageLayout ol, vk::I
 
 	auto cmdBuffer = dev.commandProvider().get(qFam);
 	vk::beginCommandBuffer(cmdBuffer, {});
-	changeLayoutCommand(cmdBuffer, img, ol, nl, range);
+	changeLayoutCommand(cmdBuffer, img, ol, nl, range, queue->properties().queueFlags);
 	vk::endCommandBuffer(cmdBuffer);
 
 	return std::make_unique<CommandWork<void>>(std::move(cmdBuffer), *queue);
@@ -654,4 +995,22 @@ vk::Extent2D blockSize(vk::Format format) {
 	}
 }
 
+vk::Extent3D blockExtent(vk::Format format, const vk::Extent3D& extent)
+{
+	auto block = blockSize(format);
+	if(!block.width || !block.height) return {0, 0, 0};
+
+	return {
+		(extent.width + block.width - 1) / block.width,
+		(extent.height + block.height - 1) / block.height,
+		std::max(extent.depth, 1u)
+	};
+}
+
+vk::DeviceSize dataSize(vk::Format format, const vk::Extent3D& extent)
+{
+	auto blocks = blockExtent(format, extent);
+	return vk::DeviceSize(formatSize(format)) * blocks.width * blocks.height * blocks.depth;
+}
+
 } // namespace vpp
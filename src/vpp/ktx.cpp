@@ -0,0 +1,212 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <vpp/ktx.hpp>
+#include <vpp/image.hpp> // vpp::Image
+#include <vpp/transfer.hpp> // vpp::TransferManager
+#include <vpp/transferWork.hpp> // vpp::UploadWork
+#include <vpp/queue.hpp> // vpp::Queue
+#include <vpp/util/log.hpp> // dlg_check
+#include <vpp/vk.hpp>
+
+#include <algorithm> // std::max, std::equal
+#include <fstream> // std::ifstream
+#include <memory> // std::make_unique
+#include <numeric> // std::lcm
+#include <stdexcept> // std::runtime_error
+#include <string> // std::string
+
+namespace vpp {
+namespace {
+
+constexpr std::uint8_t ktx2Identifier[] = {
+	0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+};
+
+// The KTX2 header (after the identifier) and the first part of the index.
+// All values are little endian.
+struct Ktx2Header {
+	std::uint32_t vkFormat;
+	std::uint32_t typeSize;
+	std::uint32_t pixelWidth;
+	std::uint32_t pixelHeight;
+	std::uint32_t pixelDepth;
+	std::uint32_t layerCount;
+	std::uint32_t faceCount;
+	std::uint32_t levelCount;
+	std::uint32_t supercompressionScheme;
+
+	std::uint32_t dfdByteOffset;
+	std::uint32_t dfdByteLength;
+	std::uint32_t kvdByteOffset;
+	std::uint32_t kvdByteLength;
+};
+
+static_assert(sizeof(Ktx2Header) == 13 * 4, "Ktx2Header must not be padded");
+
+// One entry of the level index.
+struct Ktx2LevelIndex {
+	std::uint64_t byteOffset;
+	std::uint64_t byteLength;
+	std::uint64_t uncompressedByteLength;
+};
+
+[[noreturn]] void invalid(nytl::StringParam path, const char* reason)
+{
+	throw std::runtime_error(std::string("vpp::readKtx2Info: ") + path.data() + ": " + reason);
+}
+
+template<typename T>
+void read(std::ifstream& ifs, T& obj, nytl::StringParam path)
+{
+	if(!ifs.read(reinterpret_cast<char*>(&obj), sizeof(obj))) invalid(path, "unexpected end");
+}
+
+/// Reads the ktx2 info from the given stream.
+Ktx2Info readInfo(std::ifstream& ifs, nytl::StringParam path)
+{
+	std::uint8_t identifier[sizeof(ktx2Identifier)];
+	read(ifs, identifier, path);
+	if(!std::equal(std::begin(identifier), std::end(identifier), ktx2Identifier))
+		invalid(path, "not a KTX2 file");
+
+	Ktx2Header header;
+	read(ifs, header, path);
+
+	// supercompression global data offset and length, unused
+	std::uint64_t sgd[2];
+	read(ifs, sgd, path);
+
+	if(header.supercompressionScheme != 0) invalid(path, "supercompression not supported");
+	if(header.vkFormat == 0) invalid(path, "undefined format not supported");
+	if(header.faceCount != 1 && header.faceCount != 6) invalid(path, "invalid face count");
+	if(!header.pixelWidth) invalid(path, "invalid width");
+
+	Ktx2Info info;
+	info.format = static_cast<vk::Format>(header.vkFormat);
+	info.extent.width = header.pixelWidth;
+	info.extent.height = std::max(header.pixelHeight, 1u);
+	info.extent.depth = std::max(header.pixelDepth, 1u);
+	info.levels = std::max(header.levelCount, 1u);
+	info.layers = std::max(header.layerCount, 1u) * header.faceCount;
+	info.cube = (header.faceCount == 6);
+
+	if(header.pixelDepth) info.type = vk::ImageType::e3d;
+	else if(header.pixelHeight) info.type = vk::ImageType::e2d;
+	else info.type = vk::ImageType::e1d;
+
+	if(!formatSize(info.format)) invalid(path, "unknown format");
+
+	// levels are stored without supercompression, so their size is known
+	info.levelData.resize(info.levels);
+	for(auto i = 0u; i < info.levels; ++i) {
+		Ktx2LevelIndex index;
+		read(ifs, index, path);
+
+		vk::Extent3D extent {
+			std::max(info.extent.width >> i, 1u),
+			std::max(info.extent.height >> i, 1u),
+			std::max(info.extent.depth >> i, 1u)
+		};
+
+		if(index.byteLength != dataSize(info.format, extent) * info.layers)
+			invalid(path, "invalid level size");
+
+		info.levelData[i] = {index.byteOffset, index.byteLength};
+	}
+
+	return info;
+}
+
+} // anonymous util namespace
+
+vk::ImageCreateInfo Ktx2Info::imageInfo() const
+{
+	vk::ImageCreateInfo info;
+	info.flags = cube ? vk::ImageCreateBits::cubeCompatible : vk::ImageCreateFlags {};
+	info.imageType = type;
+	info.format = format;
+	info.extent = extent;
+	info.mipLevels = levels;
+	info.arrayLayers = layers;
+	info.samples = vk::SampleCountBits::e1;
+	info.tiling = vk::ImageTiling::optimal;
+	info.usage = vk::ImageUsageBits::sampled | vk::ImageUsageBits::transferDst;
+	info.initialLayout = vk::ImageLayout::undefined;
+	return info;
+}
+
+Ktx2Info readKtx2Info(nytl::StringParam path)
+{
+	std::ifstream ifs(path, std::ios::binary);
+	if(!ifs.is_open())
+		throw std::runtime_error(std::string("vpp::readKtx2Info: couldnt open file ") + path.data());
+
+	return readInfo(ifs, path);
+}
+
+WorkPtr fillKtx2(const Image& image, nytl::StringParam path, vk::ImageLayout& layout)
+{
+	std::ifstream ifs(path, std::ios::binary);
+	if(!ifs.is_open())
+		throw std::runtime_error(std::string("vpp::fillKtx2: couldnt open file ") + path.data());
+
+	auto info = readInfo(ifs, path);
+	image.assureMemory();
+
+	// buffer offsets of copies must be multiples of the block size and 4
+	auto alignment = std::lcm(vk::DeviceSize(formatSize(info.format)), vk::DeviceSize(4u));
+	auto align = [&](vk::DeviceSize offset) {
+		return ((offset + alignment - 1) / alignment) * alignment;
+	};
+
+	auto regions = mipRegions(info.format, info.extent, vk::ImageAspectBits::color,
+		info.levels, info.layers);
+
+	vk::DeviceSize size = 0u;
+	for(auto& region : regions) {
+		region.bufferOffset = align(size);
+		size = region.bufferOffset + info.levelData[region.imageSubresource.mipLevel].size;
+	}
+
+	const Queue* queue;
+	auto qFam = transferQueueFamily(image.device(), &queue);
+	if(qFam == -1) throw std::logic_error("vpp::fillKtx2: device has no valid queue");
+
+	auto cmdBuffer = image.device().commandProvider().get(qFam);
+	auto uploadBuffer = image.device().transferManager().buffer(size, alignment);
+
+	// read the payload of every level directly into the staging memory
+	{
+		auto map = uploadBuffer.buffer().memoryMap();
+		for(auto& region : regions) {
+			auto& level = info.levelData[region.imageSubresource.mipLevel];
+			region.bufferOffset += uploadBuffer.offset();
+
+			auto dst = reinterpret_cast<char*>(map.ptr() + region.bufferOffset);
+			ifs.seekg(level.offset);
+			if(!ifs.read(dst, level.size))
+				throw std::runtime_error(std::string("vpp::fillKtx2: failed to read ") + path.data());
+		}
+
+		if(!map.coherent()) map.flush();
+	}
+
+	vk::beginCommandBuffer(cmdBuffer, {});
+	BarrierBatch batch(cmdBuffer);
+
+	if(layout != vk::ImageLayout::transferDstOptimal && layout != vk::ImageLayout::general) {
+		changeLayoutCommand(batch, image, layout, vk::ImageLayout::transferDstOptimal,
+			{vk::ImageAspectBits::color, 0, info.levels, 0, info.layers},
+			queue->properties().queueFlags);
+		layout = vk::ImageLayout::transferDstOptimal;
+	}
+
+	vk::cmdCopyBufferToImage(batch.record(), uploadBuffer.buffer(), image, layout, regions);
+	vk::endCommandBuffer(cmdBuffer);
+
+	return std::make_unique<UploadWork>(std::move(cmdBuffer), *queue, std::move(uploadBuffer));
+}
+
+} // namespace vpp
@@ -3,6 +3,8 @@
 // See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
 
 #include <vpp/memory.hpp>
+#include <vpp/externalMemoryHost.hpp>
+#include <vpp/procAddr.hpp>
 #include <vpp/vk.hpp>
 #include <vpp/util/log.hpp>
 
@@ -48,6 +50,37 @@ DeviceMemory::DeviceMemory(const Device& dev, uint32_t size, vk::MemoryPropertyF
 	handle_ = vk::allocateMemory(vkDevice(), info);
 }
 
+DeviceMemory::DeviceMemory(const Device& dev, nytl::Span<uint8_t> hostMemory,
+	unsigned int memoryTypeBits) : ResourceHandle(dev)
+{
+	auto pfGetMemoryHostPointerProperties =
+		reinterpret_cast<ext::PfnGetMemoryHostPointerProperties>(vulkanProc(vkDevice(),
+			"vkGetMemoryHostPointerPropertiesEXT"));
+
+	ext::MemoryHostPointerProperties props;
+	VPP_CALL(pfGetMemoryHostPointerProperties(vkDevice(), ext::hostAllocationBit,
+		hostMemory.data(), &props));
+
+	memoryTypeBits &= props.memoryTypeBits;
+	auto type = device().memoryType(vk::MemoryPropertyBits::hostVisible, memoryTypeBits);
+	if(type == -1) type = device().memoryType({}, memoryTypeBits);
+	if(type == -1)
+		throw std::runtime_error("vpp::DeviceMemory: no memory type to import host memory");
+
+	type_ = type;
+	size_ = hostMemory.size();
+
+	ext::ImportMemoryHostPointerInfo importInfo;
+	importInfo.pHostPointer = hostMemory.data();
+
+	vk::MemoryAllocateInfo info;
+	info.pNext = &importInfo;
+	info.allocationSize = size_;
+	info.memoryTypeIndex = type_;
+
+	handle_ = vk::allocateMemory(vkDevice(), info);
+}
+
 DeviceMemory::~DeviceMemory()
 {
 	dlg_check("~DeviceMemory", {
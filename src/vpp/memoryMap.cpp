@@ -179,6 +179,41 @@ void MemoryMapView::reload() const
 	vk::invalidateMappedMemoryRanges(vkDevice(), 1, range);
 }
 
+void MemoryMapView::flush(const Allocation& range) const
+{
+	dlg_check("MemoryMapView::flush", {
+		if(coherent()) vpp_warn("Called on coherent memory. Not needed.");
+		if(range.end() > size()) vpp_error("Range out of bounds");
+	})
+
+	auto mappedRange = alignedRange(range);
+	vk::flushMappedMemoryRanges(vkDevice(), 1, mappedRange);
+}
+
+void MemoryMapView::reload(const Allocation& range) const
+{
+	dlg_check("MemoryMapView::reload", {
+		if(coherent()) vpp_warn("Called on coherent memory. Not needed.");
+		if(range.end() > size()) vpp_error("Range out of bounds");
+	})
+
+	auto mappedRange = alignedRange(range);
+	vk::invalidateMappedMemoryRanges(vkDevice(), 1, mappedRange);
+}
+
+vk::MappedMemoryRange MemoryMapView::alignedRange(const Allocation& range) const
+{
+	auto atom = device().properties().limits.nonCoherentAtomSize;
+	auto begin = offset() + range.offset;
+	begin -= atom ? begin % atom : 0u;
+
+	auto end = vpp::align(offset() + range.end(), atom);
+	auto size = end - begin;
+	if(end >= memory().size()) size = vk::wholeSize;
+
+	return {vkMemory(), begin, size};
+}
+
 uint8_t* MemoryMapView::ptr() const noexcept
 {
 	return memoryMap().ptr() + allocation().offset - memoryMap().offset();
@@ -0,0 +1,413 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <vpp/mipmaps.hpp>
+#include <vpp/barrier.hpp> // vpp::BarrierBatch
+#include <vpp/transfer.hpp> // vpp::TransferManager
+#include <vpp/queue.hpp> // vpp::Queue
+#include <vpp/util/log.hpp> // dlg_check
+#include <vpp/vk.hpp>
+
+#include <algorithm> // std::max
+#include <array> // std::array
+#include <cstdint> // std::uint32_t
+#include <stdexcept> // std::runtime_error
+#include <memory> // std::make_unique
+#include <utility> // std::move
+
+namespace vpp {
+namespace {
+
+// SPIR-V of the compute fallback, a 2x2 box filter from the previous level.
+// #version 450
+// layout(local_size_x = 8, local_size_y = 8) in;
+// layout(set = 0, binding = 0) uniform sampler2D srcLevel;
+// layout(set = 0, binding = 1) uniform writeonly image2D dstLevel;
+// layout(push_constant) uniform Params { ivec2 srcSize; ivec2 dstSize; } params;
+//
+// void main() {
+// 	ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+// 	if(any(greaterThanEqual(pos, params.dstSize))) return;
+//
+// 	ivec2 src = 2 * pos;
+// 	ivec2 last = params.srcSize - 1;
+// 	vec4 sum = texelFetch(srcLevel, min(src, last), 0);
+// 	sum += texelFetch(srcLevel, min(src + ivec2(1, 0), last), 0);
+// 	sum += texelFetch(srcLevel, min(src + ivec2(0, 1), last), 0);
+// 	sum += texelFetch(srcLevel, min(src + ivec2(1, 1), last), 0);
+// 	imageStore(dstLevel, pos, 0.25 * sum);
+// }
+constexpr std::uint32_t downsampleSpirv[] = {
+	0x07230203, 0x00010000, 0x00000000, 0x00000043, 0x00000000, 0x00020011, 0x00000001, 0x00020011,
+	0x00000038, 0x0006000b, 0x00000001, 0x4c534c47, 0x6474732e, 0x3035342e, 0x00000000, 0x0003000e,
+	0x00000000, 0x00000001, 0x0006000f, 0x00000005, 0x00000002, 0x6e69616d, 0x00000000, 0x00000003,
+	0x00060010, 0x00000002, 0x00000011, 0x00000008, 0x00000008, 0x00000001, 0x00040047, 0x00000003,
+	0x0000000b, 0x0000001c, 0x00040047, 0x00000004, 0x00000022, 0x00000000, 0x00040047, 0x00000004,
+	0x00000021, 0x00000000, 0x00040047, 0x00000005, 0x00000022, 0x00000000, 0x00040047, 0x00000005,
+	0x00000021, 0x00000001, 0x00030047, 0x00000005, 0x00000019, 0x00030047, 0x00000006, 0x00000002,
+	0x00050048, 0x00000006, 0x00000000, 0x00000023, 0x00000000, 0x00050048, 0x00000006, 0x00000001,
+	0x00000023, 0x00000008, 0x00020013, 0x00000007, 0x00030021, 0x00000008, 0x00000007, 0x00040015,
+	0x00000009, 0x00000020, 0x00000001, 0x00040015, 0x0000000a, 0x00000020, 0x00000000, 0x00030016,
+	0x0000000b, 0x00000020, 0x00020014, 0x0000000c, 0x00040017, 0x0000000d, 0x00000009, 0x00000002,
+	0x00040017, 0x0000000e, 0x0000000a, 0x00000002, 0x00040017, 0x0000000f, 0x0000000a, 0x00000003,
+	0x00040017, 0x00000010, 0x0000000b, 0x00000004, 0x00040017, 0x00000011, 0x0000000c, 0x00000002,
+	0x00040020, 0x00000012, 0x00000001, 0x0000000f, 0x0004003b, 0x00000012, 0x00000003, 0x00000001,
+	0x00090019, 0x00000013, 0x0000000b, 0x00000001, 0x00000000, 0x00000000, 0x00000000, 0x00000001,
+	0x00000000, 0x0003001b, 0x00000014, 0x00000013, 0x00040020, 0x00000015, 0x00000000, 0x00000014,
+	0x0004003b, 0x00000015, 0x00000004, 0x00000000, 0x00090019, 0x00000016, 0x0000000b, 0x00000001,
+	0x00000000, 0x00000000, 0x00000000, 0x00000002, 0x00000000, 0x00040020, 0x00000017, 0x00000000,
+	0x00000016, 0x0004003b, 0x00000017, 0x00000005, 0x00000000, 0x0004001e, 0x00000006, 0x0000000d,
+	0x0000000d, 0x00040020, 0x00000018, 0x00000009, 0x00000006, 0x0004003b, 0x00000018, 0x00000019,
+	0x00000009, 0x00040020, 0x0000001a, 0x00000009, 0x0000000d, 0x0004002b, 0x00000009, 0x0000001b,
+	0x00000000, 0x0004002b, 0x00000009, 0x0000001c, 0x00000001, 0x0004002b, 0x00000009, 0x0000001d,
+	0x00000002, 0x0004002b, 0x0000000b, 0x0000001e, 0x3e800000, 0x0005002c, 0x0000000d, 0x0000001f,
+	0x0000001c, 0x0000001c, 0x0005002c, 0x0000000d, 0x00000020, 0x0000001d, 0x0000001d, 0x0005002c,
+	0x0000000d, 0x00000021, 0x0000001c, 0x0000001b, 0x0005002c, 0x0000000d, 0x00000022, 0x0000001b,
+	0x0000001c, 0x00050036, 0x00000007, 0x00000002, 0x00000000, 0x00000008, 0x000200f8, 0x00000023,
+	0x0004003d, 0x0000000f, 0x00000024, 0x00000003, 0x0007004f, 0x0000000e, 0x00000025, 0x00000024,
+	0x00000024, 0x00000000, 0x00000001, 0x0004007c, 0x0000000d, 0x00000026, 0x00000025, 0x00050041,
+	0x0000001a, 0x00000027, 0x00000019, 0x0000001b, 0x0004003d, 0x0000000d, 0x00000028, 0x00000027,
+	0x00050041, 0x0000001a, 0x00000029, 0x00000019, 0x0000001c, 0x0004003d, 0x0000000d, 0x0000002a,
+	0x00000029, 0x000500af, 0x00000011, 0x0000002b, 0x00000026, 0x0000002a, 0x0004009a, 0x0000000c,
+	0x0000002c, 0x0000002b, 0x000300f7, 0x0000002d, 0x00000000, 0x000400fa, 0x0000002c, 0x0000002d,
+	0x0000002e, 0x000200f8, 0x0000002e, 0x00050084, 0x0000000d, 0x0000002f, 0x00000026, 0x00000020,
+	0x00050082, 0x0000000d, 0x00000030, 0x00000028, 0x0000001f, 0x0007000c, 0x0000000d, 0x00000031,
+	0x00000001, 0x00000027, 0x0000002f, 0x00000030, 0x00050080, 0x0000000d, 0x00000032, 0x0000002f,
+	0x00000021, 0x0007000c, 0x0000000d, 0x00000033, 0x00000001, 0x00000027, 0x00000032, 0x00000030,
+	0x00050080, 0x0000000d, 0x00000034, 0x0000002f, 0x00000022, 0x0007000c, 0x0000000d, 0x00000035,
+	0x00000001, 0x00000027, 0x00000034, 0x00000030, 0x00050080, 0x0000000d, 0x00000036, 0x0000002f,
+	0x0000001f, 0x0007000c, 0x0000000d, 0x00000037, 0x00000001, 0x00000027, 0x00000036, 0x00000030,
+	0x0004003d, 0x00000014, 0x00000038, 0x00000004, 0x00040064, 0x00000013, 0x00000039, 0x00000038,
+	0x0007005f, 0x00000010, 0x0000003a, 0x00000039, 0x00000031, 0x00000002, 0x0000001b, 0x0007005f,
+	0x00000010, 0x0000003b, 0x00000039, 0x00000033, 0x00000002, 0x0000001b, 0x0007005f, 0x00000010,
+	0x0000003c, 0x00000039, 0x00000035, 0x00000002, 0x0000001b, 0x0007005f, 0x00000010, 0x0000003d,
+	0x00000039, 0x00000037, 0x00000002, 0x0000001b, 0x00050081, 0x00000010, 0x0000003e, 0x0000003a,
+	0x0000003b, 0x00050081, 0x00000010, 0x0000003f, 0x0000003e, 0x0000003c, 0x00050081, 0x00000010,
+	0x00000040, 0x0000003f, 0x0000003d, 0x0005008e, 0x00000010, 0x00000041, 0x00000040, 0x0000001e,
+	0x0004003d, 0x00000016, 0x00000042, 0x00000005, 0x00040063, 0x00000042, 0x00000026, 0x00000041,
+	0x000200f9, 0x0000002d, 0x000200f8, 0x0000002d, 0x000100fd, 0x00010038,
+};
+
+constexpr auto computeGroupSize = 8u;
+
+/// Keeps the compute resources alive until the generation finished.
+class MipmapWork : public CommandWork<void> {
+public:
+	MipmapWork(CommandBuffer&& cmdBuf, const Queue& queue, MipmapResources&& resources)
+		: CommandWork(std::move(cmdBuf), queue), resources_(std::move(resources)) {}
+
+protected:
+	MipmapResources resources_;
+};
+
+/// Returns the extent of the given mip level.
+vk::Extent3D levelExtent(const vk::Extent3D& extent, unsigned int level)
+{
+	return {
+		std::max(extent.width >> level, 1u),
+		std::max(extent.height >> level, 1u),
+		std::max(extent.depth >> level, 1u)
+	};
+}
+
+vk::ImageMemoryBarrier levelBarrier(vk::Image image, unsigned int level, unsigned int layers,
+	vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
+	vk::AccessFlags srcAccess, vk::AccessFlags dstAccess)
+{
+	vk::ImageMemoryBarrier barrier;
+	barrier.image = image;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = newLayout;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = dstAccess;
+	barrier.srcQueueFamilyIndex = vk::queueFamilyIgnored;
+	barrier.dstQueueFamilyIndex = vk::queueFamilyIgnored;
+	barrier.subresourceRange = {vk::ImageAspectBits::color, level, 1, 0, layers};
+	return barrier;
+}
+
+void blitMipmaps(vk::CommandBuffer cmdBuffer, vk::Image image, const vk::Extent3D& extent,
+	vk::ImageLayout layout, unsigned int levels, unsigned int layers,
+	vk::ImageLayout finalLayout, vk::Filter filter)
+{
+	// the first level may have been written by anything before,
+	// the contents of the other levels are discarded
+	BarrierBatch batch(cmdBuffer);
+	batch.barrier(vk::PipelineStageBits::allCommands, vk::PipelineStageBits::transfer,
+		levelBarrier(image, 0, layers, layout, vk::ImageLayout::transferSrcOptimal,
+			vk::AccessBits::memoryWrite, vk::AccessBits::transferRead));
+
+	for(auto i = 1u; i < levels; ++i) {
+		batch.barrier(vk::PipelineStageBits::topOfPipe, vk::PipelineStageBits::transfer,
+			levelBarrier(image, i, layers, vk::ImageLayout::undefined,
+				vk::ImageLayout::transferDstOptimal, {}, vk::AccessBits::transferWrite));
+	}
+
+	for(auto i = 1u; i < levels; ++i) {
+		auto src = levelExtent(extent, i - 1);
+		auto dst = levelExtent(extent, i);
+
+		vk::ImageBlit blit;
+		blit.srcSubresource = {vk::ImageAspectBits::color, i - 1, 0, layers};
+		blit.srcOffsets[1] = {int(src.width), int(src.height), int(src.depth)};
+		blit.dstSubresource = {vk::ImageAspectBits::color, i, 0, layers};
+		blit.dstOffsets[1] = {int(dst.width), int(dst.height), int(dst.depth)};
+		vk::cmdBlitImage(batch.record(), image, vk::ImageLayout::transferSrcOptimal, image,
+			vk::ImageLayout::transferDstOptimal, {blit}, filter);
+
+		// the level is the source of the next blit
+		if(i + 1 < levels) {
+			batch.barrier(vk::PipelineStageBits::transfer, vk::PipelineStageBits::transfer,
+				levelBarrier(image, i, layers, vk::ImageLayout::transferDstOptimal,
+					vk::ImageLayout::transferSrcOptimal, vk::AccessBits::transferWrite,
+					vk::AccessBits::transferRead));
+		}
+	}
+
+	// the last level is still in transferDstOptimal layout, all others
+	// in transferSrcOptimal. Transitioned with one pipeline barrier
+	auto barrier = levelBarrier(image, 0, layers, vk::ImageLayout::transferSrcOptimal,
+		finalLayout, vk::AccessBits::transferWrite, vk::AccessBits::memoryRead);
+	barrier.subresourceRange.levelCount = std::max(levels - 1, 1u);
+	batch.barrier(vk::PipelineStageBits::transfer, vk::PipelineStageBits::allCommands, barrier);
+
+	if(levels > 1) {
+		batch.barrier(vk::PipelineStageBits::transfer, vk::PipelineStageBits::allCommands,
+			levelBarrier(image, levels - 1, layers, vk::ImageLayout::transferDstOptimal,
+				finalLayout, vk::AccessBits::transferWrite, vk::AccessBits::memoryRead));
+	}
+
+	batch.flush();
+}
+
+MipmapResources computeMipmaps(vk::CommandBuffer cmdBuffer, const Image& image,
+	vk::Format format, const vk::Extent3D& extent, vk::ImageLayout layout,
+	unsigned int levels, unsigned int layers, vk::ImageLayout finalLayout)
+{
+	if(extent.depth > 1)
+		throw std::runtime_error("vpp::generateMipmaps: compute fallback requires 2D images");
+
+	auto& dev = image.device();
+	auto count = (levels - 1) * layers;
+
+	MipmapResources res;
+	res.shader = {dev, downsampleSpirv};
+
+	const vk::DescriptorSetLayoutBinding bindings[] = {
+		descriptorBinding(vk::DescriptorType::combinedImageSampler,
+			vk::ShaderStageBits::compute),
+		descriptorBinding(vk::DescriptorType::storageImage, vk::ShaderStageBits::compute)
+	};
+
+	res.dsLayout = {dev, bindings};
+
+	vk::PushConstantRange pcr {vk::ShaderStageBits::compute, 0, 4 * sizeof(std::int32_t)};
+	res.pipelineLayout = {dev, {res.dsLayout}, {pcr}};
+
+	vk::ComputePipelineCreateInfo info;
+	info.layout = res.pipelineLayout;
+	info.stage.stage = vk::ShaderStageBits::compute;
+	info.stage.module = res.shader;
+	info.stage.pName = "main";
+
+	vk::Pipeline pipeline;
+	VPP_CALL(vk::createComputePipelines(dev, {}, 1, info, nullptr, pipeline));
+	res.pipeline = {dev, pipeline};
+
+	const vk::DescriptorPoolSize sizes[] = {
+		{vk::DescriptorType::combinedImageSampler, count},
+		{vk::DescriptorType::storageImage, count}
+	};
+
+	res.pool = {dev, {{}, count, 2, sizes}};
+
+	// texelFetch ignores the filter, nearest is always supported
+	vk::SamplerCreateInfo samplerInfo;
+	samplerInfo.magFilter = vk::Filter::nearest;
+	samplerInfo.minFilter = vk::Filter::nearest;
+	samplerInfo.mipmapMode = vk::SamplerMipmapMode::nearest;
+	res.sampler = {dev, samplerInfo};
+
+	// one 2D view per level and layer
+	res.views.reserve(levels * layers);
+	for(auto i = 0u; i < levels; ++i) {
+		for(auto l = 0u; l < layers; ++l) {
+			vk::ImageViewCreateInfo viewInfo;
+			viewInfo.image = image;
+			viewInfo.viewType = vk::ImageViewType::e2d;
+			viewInfo.format = format;
+			viewInfo.subresourceRange = {vk::ImageAspectBits::color, i, 1, l, 1};
+			res.views.emplace_back(dev, viewInfo);
+		}
+	}
+
+	auto view = [&](unsigned int level, unsigned int layer) -> vk::ImageView {
+		return res.views[level * layers + layer];
+	};
+
+	res.sets.reserve(count);
+	for(auto i = 1u; i < levels; ++i) {
+		for(auto l = 0u; l < layers; ++l) {
+			res.sets.emplace_back(res.dsLayout, res.pool);
+
+			DescriptorSetUpdate update(res.sets.back());
+			update.imageSampler({{res.sampler, view(i - 1, l),
+				vk::ImageLayout::shaderReadOnlyOptimal}});
+			update.storage({{{}, view(i, l), vk::ImageLayout::general}});
+		}
+	}
+
+	// the first level may have been written by anything before,
+	// the contents of the other levels are discarded
+	BarrierBatch batch(cmdBuffer);
+	batch.barrier(vk::PipelineStageBits::allCommands, vk::PipelineStageBits::computeShader,
+		levelBarrier(image, 0, layers, layout, vk::ImageLayout::shaderReadOnlyOptimal,
+			vk::AccessBits::memoryWrite, vk::AccessBits::shaderRead));
+
+	for(auto i = 1u; i < levels; ++i) {
+		batch.barrier(vk::PipelineStageBits::topOfPipe, vk::PipelineStageBits::computeShader,
+			levelBarrier(image, i, layers, vk::ImageLayout::undefined,
+				vk::ImageLayout::general, {}, vk::AccessBits::shaderWrite));
+	}
+
+	vk::cmdBindPipeline(batch.record(), vk::PipelineBindPoint::compute, res.pipeline);
+	for(auto i = 1u; i < levels; ++i) {
+		auto src = levelExtent(extent, i - 1);
+		auto dst = levelExtent(extent, i);
+		const std::int32_t sizes[] = {
+			std::int32_t(src.width), std::int32_t(src.height),
+			std::int32_t(dst.width), std::int32_t(dst.height)
+		};
+
+		vk::cmdPushConstants(batch.record(), res.pipelineLayout, vk::ShaderStageBits::compute,
+			0, sizeof(sizes), sizes);
+
+		for(auto l = 0u; l < layers; ++l) {
+			vk::cmdBindDescriptorSets(cmdBuffer, vk::PipelineBindPoint::compute,
+				res.pipelineLayout, 0, {res.sets[(i - 1) * layers + l]}, {});
+			vk::cmdDispatch(cmdBuffer,
+				(dst.width + computeGroupSize - 1) / computeGroupSize,
+				(dst.height + computeGroupSize - 1) / computeGroupSize, 1);
+		}
+
+		// the level is read by the next dispatch
+		if(i + 1 < levels) {
+			batch.barrier(vk::PipelineStageBits::computeShader,
+				vk::PipelineStageBits::computeShader,
+				levelBarrier(image, i, layers, vk::ImageLayout::general,
+					vk::ImageLayout::shaderReadOnlyOptimal, vk::AccessBits::shaderWrite,
+					vk::AccessBits::shaderRead));
+		}
+	}
+
+	// the last level is still in general layout, all others in
+	// shaderReadOnlyOptimal. Transitioned with one pipeline barrier
+	auto barrier = levelBarrier(image, 0, layers, vk::ImageLayout::shaderReadOnlyOptimal,
+		finalLayout, vk::AccessBits::shaderWrite, vk::AccessBits::memoryRead);
+	barrier.subresourceRange.levelCount = std::max(levels - 1, 1u);
+	batch.barrier(vk::PipelineStageBits::computeShader, vk::PipelineStageBits::allCommands,
+		barrier);
+
+	if(levels > 1) {
+		batch.barrier(vk::PipelineStageBits::computeShader,
+			vk::PipelineStageBits::allCommands,
+			levelBarrier(image, levels - 1, layers, vk::ImageLayout::general,
+				finalLayout, vk::AccessBits::shaderWrite, vk::AccessBits::memoryRead));
+	}
+
+	batch.flush();
+
+	return res;
+}
+
+} // anonymous util namespace
+
+MipmapMethod mipmapMethod(const Device& dev, vk::Format format)
+{
+	auto props = vk::getPhysicalDeviceFormatProperties(dev.vkPhysicalDevice(), format);
+	auto features = props.optimalTilingFeatures;
+
+	constexpr auto blit = vk::FormatFeatureBits::blitSrc | vk::FormatFeatureBits::blitDst;
+	if((features & blit) == blit) {
+		if(features & vk::FormatFeatureBits::sampledImageFilterLinear)
+			return MipmapMethod::blitLinear;
+		return MipmapMethod::blitNearest;
+	}
+
+	constexpr auto storage = vk::FormatFeatureBits::storageImage |
+		vk::FormatFeatureBits::sampledImage;
+	if((features & storage) == storage) {
+		vk::PhysicalDeviceFeatures supported;
+		vk::getPhysicalDeviceFeatures(dev.vkPhysicalDevice(), supported);
+		if(supported.shaderStorageImageWriteWithoutFormat) return MipmapMethod::compute;
+	}
+
+	return MipmapMethod::none;
+}
+
+MipmapResources generateMipmapsCommand(vk::CommandBuffer cmdBuffer, const Image& image,
+	vk::Format format, const vk::Extent3D& extent, vk::ImageLayout& layout,
+	unsigned int levels, unsigned int layers, vk::ImageLayout finalLayout,
+	vk::QueueFlags queueFlags)
+{
+	dlg_check("generateMipmapsCommand", {
+		if(!levels || !layers) vpp_error("levels and layers must not be 0");
+		if(!image.memoryEntry().allocated()) vpp_error("Image has no memory");
+	});
+
+	MipmapResources res;
+	if(levels == 1) {
+		// nothing to generate, only the layout transition
+		if(layout != finalLayout) {
+			changeLayoutCommand(cmdBuffer, image, layout, finalLayout,
+				{vk::ImageAspectBits::color, 0, 1, 0, layers}, queueFlags);
+			layout = finalLayout;
+		}
+
+		return res;
+	}
+
+	switch(mipmapMethod(image.device(), format)) {
+		case MipmapMethod::blitLinear:
+			blitMipmaps(cmdBuffer, image, extent, layout, levels, layers, finalLayout,
+				vk::Filter::linear);
+			break;
+		case MipmapMethod::blitNearest:
+			blitMipmaps(cmdBuffer, image, extent, layout, levels, layers, finalLayout,
+				vk::Filter::nearest);
+			break;
+		case MipmapMethod::compute:
+			res = computeMipmaps(cmdBuffer, image, format, extent, layout, levels, layers,
+				finalLayout);
+			break;
+		default:
+			throw std::runtime_error("vpp::generateMipmaps: format supports "
+				"neither blitting nor compute storage");
+	}
+
+	layout = finalLayout;
+	return res;
+}
+
+WorkPtr generateMipmaps(const Image& image, vk::Format format, const vk::Extent3D& extent,
+	vk::ImageLayout& layout, unsigned int levels, unsigned int layers,
+	vk::ImageLayout finalLayout)
+{
+	auto& dev = image.device();
+	auto compute = (mipmapMethod(dev, format) == MipmapMethod::compute);
+
+	// blitting needs a graphics queue, the compute fallback a compute queue
+	auto queue = dev.queue(compute ? vk::QueueBits::compute : vk::QueueBits::graphics);
+	if(!queue) throw std::logic_error("vpp::generateMipmaps: device has no valid queue");
+
+	auto cmdBuffer = dev.commandProvider().get(queue->family());
+	vk::beginCommandBuffer(cmdBuffer, {});
+	auto res = generateMipmapsCommand(cmdBuffer, image, format, extent, layout, levels,
+		layers, finalLayout, queue->properties().queueFlags);
+	vk::endCommandBuffer(cmdBuffer);
+
+	return std::make_unique<MipmapWork>(std::move(cmdBuffer), *queue, std::move(res));
+}
+
+} // namespace vpp
@@ -0,0 +1,290 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <vpp/packed.hpp>
+#include <vpp/util/log.hpp>
+
+#include <algorithm> // std::clamp
+#include <cmath> // std::floor
+#include <cstring> // std::memcpy
+#include <limits> // std::numeric_limits
+
+// the F16C paths are compiled for x86 independent of the target flags
+// and only used if the cpu supports them
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	#define VPP_PACKED_F16C
+	#include <immintrin.h> // _mm_cvtps_ph
+#endif
+
+namespace vpp {
+namespace {
+
+// The conversion loops are written without branches on the values so they
+// can be vectorized by the compiler.
+template<typename T>
+void packUnorm(const float* src, T* dst, std::size_t count)
+{
+	constexpr auto scale = float(std::numeric_limits<T>::max());
+	for(std::size_t i = 0u; i < count; ++i)
+		dst[i] = T(std::clamp(src[i], 0.f, 1.f) * scale + 0.5f);
+}
+
+template<typename T>
+void packSnorm(const float* src, T* dst, std::size_t count)
+{
+	constexpr auto scale = float(std::numeric_limits<T>::max());
+	for(std::size_t i = 0u; i < count; ++i)
+		dst[i] = T(std::floor(std::clamp(src[i], -1.f, 1.f) * scale + 0.5f));
+}
+
+template<typename T>
+void unpackUnorm(const T* src, float* dst, std::size_t count)
+{
+	constexpr auto scale = 1.f / float(std::numeric_limits<T>::max());
+	for(std::size_t i = 0u; i < count; ++i)
+		dst[i] = src[i] * scale;
+}
+
+template<typename T>
+void unpackSnorm(const T* src, float* dst, std::size_t count)
+{
+	// the minimum value is clamped to -1 as well
+	constexpr auto scale = 1.f / float(std::numeric_limits<T>::max());
+	for(std::size_t i = 0u; i < count; ++i)
+		dst[i] = std::max(src[i] * scale, -1.f);
+}
+
+#ifdef VPP_PACKED_F16C
+bool f16c()
+{
+	static const bool supported = [] {
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+	}();
+	return supported;
+}
+
+__attribute__((target("avx,f16c")))
+void packHalfF16C(const float* src, std::uint16_t* dst, std::size_t count)
+{
+	std::size_t i = 0u;
+	for(; i + 8 <= count; i += 8) {
+		auto values = _mm256_loadu_ps(src + i);
+		auto halfs = _mm256_cvtps_ph(values, _MM_FROUND_TO_NEAREST_INT);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), halfs);
+	}
+
+	alignas(16) float values[4] {};
+	alignas(16) std::uint16_t halfs[8];
+	for(; i < count; i += 4) {
+		auto n = std::min<std::size_t>(count - i, 4u);
+		std::memcpy(values, src + i, n * sizeof(float));
+		auto converted = _mm_cvtps_ph(_mm_load_ps(values), _MM_FROUND_TO_NEAREST_INT);
+		_mm_store_si128(reinterpret_cast<__m128i*>(halfs), converted);
+		std::memcpy(dst + i, halfs, n * sizeof(std::uint16_t));
+	}
+}
+
+__attribute__((target("avx,f16c")))
+void unpackHalfF16C(const std::uint16_t* src, float* dst, std::size_t count)
+{
+	std::size_t i = 0u;
+	for(; i + 8 <= count; i += 8) {
+		auto halfs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		_mm256_storeu_ps(dst + i, _mm256_cvtph_ps(halfs));
+	}
+
+	alignas(16) std::uint16_t halfs[8] {};
+	alignas(16) float values[4];
+	for(; i < count; i += 4) {
+		auto n = std::min<std::size_t>(count - i, 4u);
+		std::memcpy(halfs, src + i, n * sizeof(std::uint16_t));
+		auto converted = _mm_cvtph_ps(_mm_load_si128(reinterpret_cast<__m128i*>(halfs)));
+		_mm_store_ps(values, converted);
+		std::memcpy(dst + i, values, n * sizeof(float));
+	}
+}
+#endif // VPP_PACKED_F16C
+
+void packHalf(const float* src, std::uint16_t* dst, std::size_t count)
+{
+#ifdef VPP_PACKED_F16C
+	if(f16c()) {
+		packHalfF16C(src, dst, count);
+		return;
+	}
+#endif
+
+	for(std::size_t i = 0u; i < count; ++i)
+		dst[i] = floatToHalf(src[i]);
+}
+
+void unpackHalf(const std::uint16_t* src, float* dst, std::size_t count)
+{
+#ifdef VPP_PACKED_F16C
+	if(f16c()) {
+		unpackHalfF16C(src, dst, count);
+		return;
+	}
+#endif
+
+	for(std::size_t i = 0u; i < count; ++i)
+		dst[i] = halfToFloat(src[i]);
+}
+
+void packA2B10G10R10(const float* src, std::uint32_t* dst, std::size_t count)
+{
+	auto unorm = [](float val, float max) {
+		return std::uint32_t(std::clamp(val, 0.f, 1.f) * max + 0.5f);
+	};
+
+	for(std::size_t i = 0u; i < count / 4; ++i) {
+		auto* rgba = src + i * 4;
+		dst[i] = unorm(rgba[0], 1023.f) |
+			(unorm(rgba[1], 1023.f) << 10) |
+			(unorm(rgba[2], 1023.f) << 20) |
+			(unorm(rgba[3], 3.f) << 30);
+	}
+}
+
+void unpackA2B10G10R10(const std::uint32_t* src, float* dst, std::size_t count)
+{
+	for(std::size_t i = 0u; i < count / 4; ++i) {
+		auto* rgba = dst + i * 4;
+		rgba[0] = (src[i] & 0x3FFu) / 1023.f;
+		rgba[1] = ((src[i] >> 10) & 0x3FFu) / 1023.f;
+		rgba[2] = ((src[i] >> 20) & 0x3FFu) / 1023.f;
+		rgba[3] = (src[i] >> 30) / 3.f;
+	}
+}
+
+} // anonymous util namespace
+
+std::uint16_t floatToHalf(float value)
+{
+	std::uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	std::uint16_t sign = (bits >> 16) & 0x8000u;
+	auto abs = bits & 0x7FFFFFFFu;
+
+	// inf/nan (nan keeps some payload but always stays nan)
+	if(abs >= 0x7F800000u) {
+		auto nan = abs > 0x7F800000u ? 0x200u | ((abs >> 13) & 0x3FFu) : 0u;
+		return sign | 0x7C00u | nan;
+	}
+
+	// too large for half; values between max half and this round up to inf below
+	if(abs >= 0x47800000u) return sign | 0x7C00u;
+
+	// zero or half subnormal, the implicit bit must be shifted in
+	if(abs < 0x38800000u) {
+		if(abs < 0x33000000u) return sign;
+
+		auto exp = abs >> 23;
+		auto mantissa = (abs & 0x7FFFFFu) | 0x800000u;
+		auto shift = 126 - exp;
+		std::uint32_t half = mantissa >> shift;
+		auto rest = mantissa & ((1u << shift) - 1);
+		auto mid = 1u << (shift - 1);
+		if(rest > mid || (rest == mid && (half & 1u))) ++half;
+		return sign | half;
+	}
+
+	// normal, rebias exponent and round to nearest even.
+	// A carry correctly overflows into the exponent.
+	std::uint32_t half = (abs - 0x38000000u) >> 13;
+	auto rest = abs & 0x1FFFu;
+	if(rest > 0x1000u || (rest == 0x1000u && (half & 1u))) ++half;
+	return sign | half;
+}
+
+float halfToFloat(std::uint16_t half)
+{
+	std::uint32_t sign = (half & 0x8000u) << 16;
+	std::uint32_t exp = (half >> 10) & 0x1Fu;
+	std::uint32_t mantissa = half & 0x3FFu;
+
+	std::uint32_t bits;
+	if(exp == 0x1Fu) { // inf/nan, nan is quieted like F16C does
+		bits = sign | 0x7F800000u | (mantissa << 13);
+		if(mantissa) bits |= 0x400000u;
+	} else if(exp) { // normal
+		bits = sign | ((exp + 112) << 23) | (mantissa << 13);
+	} else if(!mantissa) { // zero
+		bits = sign;
+	} else { // subnormal, normalize it
+		exp = 113;
+		while(!(mantissa & 0x400u)) {
+			mantissa <<= 1;
+			--exp;
+		}
+
+		bits = sign | (exp << 23) | ((mantissa & 0x3FFu) << 13);
+	}
+
+	float ret;
+	std::memcpy(&ret, &bits, sizeof(ret));
+	return ret;
+}
+
+void pack(PackedFormat format, const float* src, void* dst, std::size_t count)
+{
+	dlg_check("pack", {
+		if(format == PackedFormat::a2b10g10r10Unorm && count % 4)
+			vpp_error("invalid count {} for a2b10g10r10Unorm", count);
+	});
+
+	switch(format) {
+		case PackedFormat::sfloat16:
+			packHalf(src, static_cast<std::uint16_t*>(dst), count);
+			break;
+		case PackedFormat::unorm8:
+			packUnorm(src, static_cast<std::uint8_t*>(dst), count);
+			break;
+		case PackedFormat::snorm8:
+			packSnorm(src, static_cast<std::int8_t*>(dst), count);
+			break;
+		case PackedFormat::unorm16:
+			packUnorm(src, static_cast<std::uint16_t*>(dst), count);
+			break;
+		case PackedFormat::snorm16:
+			packSnorm(src, static_cast<std::int16_t*>(dst), count);
+			break;
+		case PackedFormat::a2b10g10r10Unorm:
+			packA2B10G10R10(src, static_cast<std::uint32_t*>(dst), count);
+			break;
+	}
+}
+
+void unpack(PackedFormat format, const void* src, float* dst, std::size_t count)
+{
+	dlg_check("unpack", {
+		if(format == PackedFormat::a2b10g10r10Unorm && count % 4)
+			vpp_error("invalid count {} for a2b10g10r10Unorm", count);
+	});
+
+	switch(format) {
+		case PackedFormat::sfloat16:
+			unpackHalf(static_cast<const std::uint16_t*>(src), dst, count);
+			break;
+		case PackedFormat::unorm8:
+			unpackUnorm(static_cast<const std::uint8_t*>(src), dst, count);
+			break;
+		case PackedFormat::snorm8:
+			unpackSnorm(static_cast<const std::int8_t*>(src), dst, count);
+			break;
+		case PackedFormat::unorm16:
+			unpackUnorm(static_cast<const std::uint16_t*>(src), dst, count);
+			break;
+		case PackedFormat::snorm16:
+			unpackSnorm(static_cast<const std::int16_t*>(src), dst, count);
+			break;
+		case PackedFormat::a2b10g10r10Unorm:
+			unpackA2B10G10R10(static_cast<const std::uint32_t*>(src), dst, count);
+			break;
+	}
+}
+
+} // namespace vpp
@@ -0,0 +1,339 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <vpp/pixelConvert.hpp>
+#include <vpp/packed.hpp> // vpp::pack, vpp::unpack
+#include <vpp/image.hpp> // vpp::formatSize
+#include <vpp/util/log.hpp> // dlg_check
+
+#include <algorithm> // std::clamp, std::upper_bound
+#include <array> // std::array
+#include <cmath> // std::pow
+#include <cstdint> // std::uint8_t
+#include <cstring> // std::memcpy
+
+// the SSSE3 path is compiled for x86 independent of the target flags
+// and only used if the cpu supports it
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	#define VPP_PIXEL_SSSE3
+	#include <tmmintrin.h> // _mm_shuffle_epi8
+#endif
+
+namespace vpp {
+namespace {
+
+enum class Encoding {
+	unorm8,
+	srgb8,
+	unorm16,
+	sfloat16,
+	sfloat32
+};
+
+/// Describes the memory layout of a pixel of a format.
+struct PixelFormat {
+	Encoding encoding;
+	unsigned int channels;
+	std::array<int, 4> rgba; // memory index of the r, g, b and a channel, -1 if missing
+};
+
+constexpr auto none = -1;
+constexpr std::array<int, 4> rOrder {0, none, none, none};
+constexpr std::array<int, 4> rgOrder {0, 1, none, none};
+constexpr std::array<int, 4> rgbOrder {0, 1, 2, none};
+constexpr std::array<int, 4> bgrOrder {2, 1, 0, none};
+constexpr std::array<int, 4> rgbaOrder {0, 1, 2, 3};
+constexpr std::array<int, 4> bgraOrder {2, 1, 0, 3};
+
+/// Returns the pixel format for the given vulkan format.
+/// Returns a format with 0 channels if it is not supported.
+PixelFormat pixelFormat(vk::Format format)
+{
+	using vk::Format;
+	switch(format) {
+		case Format::r8Unorm: return {Encoding::unorm8, 1, rOrder};
+		case Format::r8g8Unorm: return {Encoding::unorm8, 2, rgOrder};
+		case Format::r8g8b8Unorm: return {Encoding::unorm8, 3, rgbOrder};
+		case Format::b8g8r8Unorm: return {Encoding::unorm8, 3, bgrOrder};
+		case Format::r8g8b8a8Unorm: return {Encoding::unorm8, 4, rgbaOrder};
+		case Format::b8g8r8a8Unorm: return {Encoding::unorm8, 4, bgraOrder};
+		case Format::r8Srgb: return {Encoding::srgb8, 1, rOrder};
+		case Format::r8g8Srgb: return {Encoding::srgb8, 2, rgOrder};
+		case Format::r8g8b8Srgb: return {Encoding::srgb8, 3, rgbOrder};
+		case Format::b8g8r8Srgb: return {Encoding::srgb8, 3, bgrOrder};
+		case Format::r8g8b8a8Srgb: return {Encoding::srgb8, 4, rgbaOrder};
+		case Format::b8g8r8a8Srgb: return {Encoding::srgb8, 4, bgraOrder};
+		case Format::r16Unorm: return {Encoding::unorm16, 1, rOrder};
+		case Format::r16g16Unorm: return {Encoding::unorm16, 2, rgOrder};
+		case Format::r16g16b16Unorm: return {Encoding::unorm16, 3, rgbOrder};
+		case Format::r16g16b16a16Unorm: return {Encoding::unorm16, 4, rgbaOrder};
+		case Format::r16Sfloat: return {Encoding::sfloat16, 1, rOrder};
+		case Format::r16g16Sfloat: return {Encoding::sfloat16, 2, rgOrder};
+		case Format::r16g16b16Sfloat: return {Encoding::sfloat16, 3, rgbOrder};
+		case Format::r16g16b16a16Sfloat: return {Encoding::sfloat16, 4, rgbaOrder};
+		case Format::r32Sfloat: return {Encoding::sfloat32, 1, rOrder};
+		case Format::r32g32Sfloat: return {Encoding::sfloat32, 2, rgOrder};
+		case Format::r32g32b32Sfloat: return {Encoding::sfloat32, 3, rgbOrder};
+		case Format::r32g32b32a32Sfloat: return {Encoding::sfloat32, 4, rgbaOrder};
+		default: return {Encoding::unorm8, 0, {}};
+	}
+}
+
+bool byteEncoding(Encoding encoding)
+{
+	return encoding == Encoding::unorm8 || encoding == Encoding::srgb8;
+}
+
+/// Lookup tables for 8 bit values.
+struct Tables {
+	std::array<float, 256> unorm; // unorm8 -> float
+	std::array<float, 256> srgb; // srgb8 -> linear float
+	std::array<float, 255> srgbBounds; // linear values at which the srgb8 value increases
+	std::array<std::uint8_t, 256> toSrgb; // unorm8 -> srgb8
+	std::array<std::uint8_t, 256> fromSrgb; // srgb8 -> unorm8
+};
+
+std::uint8_t encodeSrgb(const Tables& tables, float linear)
+{
+	auto& b = tables.srgbBounds;
+	return std::uint8_t(std::upper_bound(b.begin(), b.end(), linear) - b.begin());
+}
+
+const Tables& tables()
+{
+	static const Tables tables = [] {
+		Tables ret;
+		for(auto i = 0u; i < 256; ++i) {
+			ret.unorm[i] = i / 255.f;
+			ret.srgb[i] = srgbToLinear(i / 255.f);
+			ret.fromSrgb[i] = std::uint8_t(ret.srgb[i] * 255.f + 0.5f);
+		}
+
+		for(auto i = 0u; i < 255; ++i)
+			ret.srgbBounds[i] = srgbToLinear((i + 0.5f) / 255.f);
+		for(auto i = 0u; i < 256; ++i)
+			ret.toSrgb[i] = encodeSrgb(ret, ret.unorm[i]);
+
+		return ret;
+	}();
+
+	return tables;
+}
+
+#ifdef VPP_PIXEL_SSSE3
+bool ssse3()
+{
+	static const bool supported = [] {
+		__builtin_cpu_init();
+		return bool(__builtin_cpu_supports("ssse3"));
+	}();
+	return supported;
+}
+
+/// Converts 4 pixels per shuffle, only while 16 source bytes can be loaded.
+/// Returns the number of converted pixels.
+__attribute__((target("ssse3")))
+std::size_t shuffleBytes(const std::array<int, 4>& map,
+	const std::array<std::uint8_t, 4>& constants, unsigned int sc, unsigned int dc,
+	const std::uint8_t* src, std::uint8_t* dst, std::size_t count)
+{
+	alignas(16) std::uint8_t shuffle[16];
+	alignas(16) std::uint8_t fill[16] {};
+	for(auto p = 0u; p < 4; ++p) {
+		for(auto d = 0u; d < dc; ++d) {
+			auto s = map[d];
+			shuffle[p * dc + d] = (s == none) ? 0x80 : std::uint8_t(p * sc + s);
+			fill[p * dc + d] = (s == none) ? constants[d] : 0;
+		}
+	}
+
+	for(auto j = 4 * dc; j < 16; ++j) shuffle[j] = 0x80;
+
+	auto mask = _mm_load_si128(reinterpret_cast<const __m128i*>(shuffle));
+	auto constant = _mm_load_si128(reinterpret_cast<const __m128i*>(fill));
+	std::size_t i = 0u;
+	for(; i * sc + 16 <= count * sc && i + 4 <= count; i += 4) {
+		auto in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * sc));
+		auto out = _mm_or_si128(_mm_shuffle_epi8(in, mask), constant);
+		if(dc == 4) {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * dc), out);
+		} else {
+			alignas(16) std::uint8_t tmp[16];
+			_mm_store_si128(reinterpret_cast<__m128i*>(tmp), out);
+			std::memcpy(dst + i * dc, tmp, 4 * dc);
+		}
+	}
+
+	return i;
+}
+#endif // VPP_PIXEL_SSSE3
+
+/// Converts between 8 bit formats by shuffling bytes.
+/// Optionally maps the color channels through the given table (unorm <-> srgb).
+void convertBytes(const PixelFormat& srcFmt, const std::uint8_t* src,
+	const PixelFormat& dstFmt, std::uint8_t* dst, std::size_t count,
+	const std::uint8_t* table)
+{
+	// for every destination byte the source byte or a constant
+	std::array<int, 4> map {};
+	std::array<std::uint8_t, 4> constants {};
+	for(auto c = 0u; c < 4; ++c) {
+		auto d = dstFmt.rgba[c];
+		if(d == none) continue;
+		map[d] = srcFmt.rgba[c];
+		constants[d] = (c == 3) ? 255 : 0;
+	}
+
+	auto sc = srcFmt.channels;
+	auto dc = dstFmt.channels;
+	std::size_t i = 0u;
+
+#ifdef VPP_PIXEL_SSSE3
+	if(!table && ssse3()) {
+		i = shuffleBytes(map, constants, sc, dc, src, dst, count);
+	}
+#endif
+
+	for(; i < count; ++i) {
+		for(auto d = 0u; d < dc; ++d) {
+			auto s = map[d];
+			auto value = (s == none) ? constants[d] : src[i * sc + s];
+			auto alpha = (dstFmt.rgba[3] == int(d));
+			dst[i * dc + d] = (table && !alpha) ? table[value] : value;
+		}
+	}
+}
+
+constexpr auto chunkSize = 64u;
+
+/// Decodes count (at most chunkSize) pixels into rgba float values.
+void decode(const PixelFormat& fmt, const std::uint8_t* src, float* rgba, std::size_t count)
+{
+	float values[chunkSize * 4];
+	auto n = count * fmt.channels;
+
+	switch(fmt.encoding) {
+		case Encoding::unorm8:
+			for(auto i = 0u; i < n; ++i) values[i] = tables().unorm[src[i]];
+			break;
+		case Encoding::srgb8:
+			for(auto i = 0u; i < n; ++i) {
+				auto alpha = (fmt.rgba[3] == int(i % fmt.channels));
+				values[i] = (alpha ? tables().unorm : tables().srgb)[src[i]];
+			}
+			break;
+		case Encoding::unorm16: unpack(PackedFormat::unorm16, src, values, n); break;
+		case Encoding::sfloat16: unpack(PackedFormat::sfloat16, src, values, n); break;
+		case Encoding::sfloat32: std::memcpy(values, src, n * sizeof(float)); break;
+	}
+
+	for(auto i = 0u; i < count; ++i) {
+		for(auto c = 0u; c < 4; ++c) {
+			auto s = fmt.rgba[c];
+			rgba[i * 4 + c] = (s == none) ? (c == 3 ? 1.f : 0.f) : values[i * fmt.channels + s];
+		}
+	}
+}
+
+/// Encodes count (at most chunkSize) rgba float pixels into the given format.
+void encode(const PixelFormat& fmt, const float* rgba, std::uint8_t* dst, std::size_t count)
+{
+	float values[chunkSize * 4];
+	for(auto c = 0u; c < 4; ++c) {
+		auto d = fmt.rgba[c];
+		if(d == none) continue;
+		for(auto i = 0u; i < count; ++i) values[i * fmt.channels + d] = rgba[i * 4 + c];
+	}
+
+	auto n = count * fmt.channels;
+	switch(fmt.encoding) {
+		case Encoding::unorm8: pack(PackedFormat::unorm8, values, dst, n); break;
+		case Encoding::srgb8:
+			for(auto i = 0u; i < n; ++i) {
+				auto alpha = (fmt.rgba[3] == int(i % fmt.channels));
+				dst[i] = alpha ?
+					std::uint8_t(std::clamp(values[i], 0.f, 1.f) * 255.f + 0.5f) :
+					encodeSrgb(tables(), values[i]);
+			}
+			break;
+		case Encoding::unorm16: pack(PackedFormat::unorm16, values, dst, n); break;
+		case Encoding::sfloat16: pack(PackedFormat::sfloat16, values, dst, n); break;
+		case Encoding::sfloat32: std::memcpy(dst, values, n * sizeof(float)); break;
+	}
+}
+
+unsigned int pixelSize(const PixelFormat& fmt)
+{
+	switch(fmt.encoding) {
+		case Encoding::unorm8:
+		case Encoding::srgb8:
+			return fmt.channels;
+		case Encoding::unorm16:
+		case Encoding::sfloat16:
+			return fmt.channels * 2;
+		default:
+			return fmt.channels * 4;
+	}
+}
+
+} // anonymous util namespace
+
+float srgbToLinear(float value)
+{
+	if(value <= 0.04045f) return value / 12.92f;
+	return std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+float linearToSrgb(float value)
+{
+	if(value <= 0.0031308f) return value * 12.92f;
+	return 1.055f * std::pow(value, 1 / 2.4f) - 0.055f;
+}
+
+bool pixelConvertible(vk::Format src, vk::Format dst)
+{
+	return src == dst || (pixelFormat(src).channels && pixelFormat(dst).channels);
+}
+
+void convertPixels(vk::Format srcFormat, const void* src, vk::Format dstFormat, void* dst,
+	std::size_t count)
+{
+	dlg_check("convertPixels", {
+		if(!pixelConvertible(srcFormat, dstFormat)) vpp_error("formats not convertible");
+	});
+
+	auto srcData = static_cast<const std::uint8_t*>(src);
+	auto dstData = static_cast<std::uint8_t*>(dst);
+
+	auto srcFmt = pixelFormat(srcFormat);
+	auto dstFmt = pixelFormat(dstFormat);
+	if(srcFormat == dstFormat) {
+		std::memcpy(dst, src, count * formatSize(srcFormat));
+		return;
+	}
+
+	// 8 bit formats are directly shuffled, maybe through a table
+	if(byteEncoding(srcFmt.encoding) && byteEncoding(dstFmt.encoding)) {
+		const std::uint8_t* table = nullptr;
+		if(srcFmt.encoding != dstFmt.encoding) {
+			table = (dstFmt.encoding == Encoding::srgb8) ?
+				tables().toSrgb.data() : tables().fromSrgb.data();
+		}
+
+		convertBytes(srcFmt, srcData, dstFmt, dstData, count, table);
+		return;
+	}
+
+	// otherwise through rgba float values, in chunks that stay in the cache
+	auto srcSize = pixelSize(srcFmt);
+	auto dstSize = pixelSize(dstFmt);
+	float rgba[chunkSize * 4];
+	for(std::size_t i = 0u; i < count; i += chunkSize) {
+		auto n = std::min<std::size_t>(chunkSize, count - i);
+		decode(srcFmt, srcData + i * srcSize, rgba, n);
+		encode(dstFmt, rgba, dstData + i * dstSize, n);
+	}
+}
+
+} // namespace vpp
@@ -0,0 +1,163 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <vpp/readbackRing.hpp>
+#include <vpp/transfer.hpp>
+#include <vpp/queue.hpp>
+#include <vpp/vk.hpp>
+#include <vpp/util/log.hpp>
+
+#include <stdexcept> // std::logic_error
+#include <utility> // std::move
+
+namespace vpp {
+
+ReadbackRing::ReadbackRing(const Device& dev, vk::DeviceSize frameSize,
+	unsigned int frameCount) : Resource(dev), frameSize_(frameSize)
+{
+	// with a single frame, submit would have to wait for the frame it just
+	// submitted and poll would never have anything to complete
+	if(!frameSize) throw std::logic_error("vpp::ReadbackRing: frameSize must not be 0");
+	if(frameCount < 2) throw std::logic_error("vpp::ReadbackRing: frameCount must be at least 2");
+
+	queueFamily_ = transferQueueFamily(dev, &queue_);
+	if(queueFamily_ == -1)
+		throw std::logic_error("vpp::ReadbackRing: device has no valid queue");
+
+	vk::BufferCreateInfo info;
+	info.size = frameSize * frameCount;
+	info.usage = vk::BufferUsageBits::transferDst;
+	buffer_ = {dev, info, MemoryUsage::hostRead};
+
+	map_ = buffer_.memoryMap();
+	frames_.resize(frameCount);
+}
+
+ReadbackRing::~ReadbackRing()
+{
+	// only make sure that the device is no longer writing the ring memory
+	for(auto& frame : frames_) {
+		if(!frame.work) continue;
+
+		try {
+			frame.work->finish();
+		} catch(const std::exception& error) {
+			vpp_warn("~ReadbackRing"_scope, "finish(): {}", error.what());
+		}
+	}
+}
+
+bool ReadbackRing::read(vk::Buffer src, vk::DeviceSize offset, vk::DeviceSize size,
+	Callback callback)
+{
+	dlg_check("ReadbackRing::read", {
+		if(!size) vpp_error("size must not be 0");
+	});
+
+	// align the data in the ring so the spans can be reinterpreted
+	auto& frame = frames_[current_];
+	auto dstOffset = ((frame.used + 15) / 16) * 16;
+	if(dstOffset + size > frameSize_) return false;
+
+	auto region = vk::BufferCopy {offset, current_ * frameSize_ + dstOffset, size};
+	frame.copies.push_back({src, region, std::move(callback)});
+	frame.used = dstOffset + size;
+	return true;
+}
+
+void ReadbackRing::submit()
+{
+	auto& frame = frames_[current_];
+	if(frame.copies.empty()) return;
+
+	auto cmdBuffer = device().commandProvider().get(queueFamily_);
+	vk::beginCommandBuffer(cmdBuffer, {});
+
+	// copies from the same buffer share one command
+	std::vector<vk::BufferCopy> regions;
+	for(auto i = 0u; i < frame.copies.size();) {
+		auto src = frame.copies[i].src;
+		regions.clear();
+		for(; i < frame.copies.size() && frame.copies[i].src == src; ++i)
+			regions.push_back(frame.copies[i].region);
+
+		vk::cmdCopyBuffer(cmdBuffer, src, buffer_, regions);
+	}
+
+	// make the written data visible to the host
+	vk::MemoryBarrier barrier(vk::AccessBits::transferWrite, vk::AccessBits::hostRead);
+	vk::cmdPipelineBarrier(cmdBuffer, vk::PipelineStageBits::transfer,
+		vk::PipelineStageBits::host, {}, {barrier}, {}, {});
+
+	vk::endCommandBuffer(cmdBuffer);
+
+	frame.work = std::make_unique<CommandWork<void>>(std::move(cmdBuffer), *queue_);
+	frame.work->submit();
+
+	// the next frame can only be reused once its data was handed out
+	current_ = (current_ + 1) % frames_.size();
+	auto& next = frames_[current_];
+	if(next.work) complete(next);
+}
+
+unsigned int ReadbackRing::poll()
+{
+	// frames are completed in submission order, starting with the oldest one
+	auto count = 0u;
+	for(auto i = 1u; i < frames_.size(); ++i) {
+		auto& frame = frames_[(current_ + i) % frames_.size()];
+		if(!frame.work) continue;
+		if(!frame.work->executed()) break;
+
+		complete(frame);
+		++count;
+	}
+
+	return count;
+}
+
+void ReadbackRing::wait()
+{
+	for(auto i = 1u; i < frames_.size(); ++i) {
+		auto& frame = frames_[(current_ + i) % frames_.size()];
+		if(frame.work) complete(frame);
+	}
+}
+
+void ReadbackRing::complete(Frame& frame)
+{
+	frame.work->finish();
+	frame.work.reset();
+
+	auto copies = std::move(frame.copies);
+	frame.copies.clear();
+	frame.used = 0u;
+
+	if(!map_.coherent()) {
+		auto frameOffset = copies.front().region.dstOffset;
+		auto& last = copies.back().region;
+		map_.reload({frameOffset, last.dstOffset + last.size - frameOffset});
+	}
+
+	for(auto& copy : copies) {
+		auto ptr = map_.ptr() + copy.region.dstOffset;
+		if(copy.callback) copy.callback({ptr, copy.region.size});
+	}
+}
+
+void swap(ReadbackRing& a, ReadbackRing& b) noexcept
+{
+	using std::swap;
+
+	swap(static_cast<Resource&>(a), static_cast<Resource&>(b));
+	swap(a.buffer_, b.buffer_);
+	swap(a.map_, b.map_);
+	swap(a.frameSize_, b.frameSize_);
+	swap(a.frames_, b.frames_);
+	swap(a.current_, b.current_);
+	swap(a.queue_, b.queue_);
+	swap(a.queueFamily_, b.queueFamily_);
+}
+
+} // namespace vpp
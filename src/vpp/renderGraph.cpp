@@ -0,0 +1,658 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <vpp/renderGraph.hpp>
+#include <vpp/memory.hpp> // vpp::DeviceMemory
+#include <vpp/vk.hpp>
+#include <vpp/util/log.hpp>
+
+#include <algorithm> // std::sort, std::min, std::max
+#include <stdexcept> // std::logic_error
+#include <utility> // std::move, std::swap
+
+namespace vpp {
+namespace {
+
+vk::ImageAspectFlags formatAspect(vk::Format format)
+{
+	switch(format) {
+		case vk::Format::d16Unorm:
+		case vk::Format::x8D24UnormPack32:
+		case vk::Format::d32Sfloat:
+			return vk::ImageAspectBits::depth;
+		case vk::Format::s8Uint:
+			return vk::ImageAspectBits::stencil;
+		case vk::Format::d16UnormS8Uint:
+		case vk::Format::d24UnormS8Uint:
+		case vk::Format::d32SfloatS8Uint:
+			return vk::ImageAspectBits::depth | vk::ImageAspectBits::stencil;
+		default:
+			return vk::ImageAspectBits::color;
+	}
+}
+
+// the usage an image needs to be accessed as described
+vk::ImageUsageFlags accessUsage(const Access& access)
+{
+	vk::ImageUsageFlags usage {};
+	auto shader = vk::AccessBits::shaderRead | vk::AccessBits::shaderWrite;
+
+	switch(access.layout) {
+		case vk::ImageLayout::colorAttachmentOptimal:
+			usage |= vk::ImageUsageBits::colorAttachment;
+			break;
+		case vk::ImageLayout::depthStencilAttachmentOptimal:
+			usage |= vk::ImageUsageBits::depthStencilAttachment;
+			break;
+		case vk::ImageLayout::depthStencilReadOnlyOptimal:
+			usage |= vk::ImageUsageBits::depthStencilAttachment;
+			if(access.access & shader) usage |= vk::ImageUsageBits::sampled;
+			break;
+		case vk::ImageLayout::shaderReadOnlyOptimal:
+			usage |= vk::ImageUsageBits::sampled;
+			break;
+		case vk::ImageLayout::transferSrcOptimal:
+			usage |= vk::ImageUsageBits::transferSrc;
+			break;
+		case vk::ImageLayout::transferDstOptimal:
+			usage |= vk::ImageUsageBits::transferDst;
+			break;
+		default:
+			if(access.access & shader) usage |= vk::ImageUsageBits::storage;
+			if(access.access & vk::AccessBits::transferRead)
+				usage |= vk::ImageUsageBits::transferSrc;
+			if(access.access & vk::AccessBits::transferWrite)
+				usage |= vk::ImageUsageBits::transferDst;
+			break;
+	}
+
+	if(access.access & vk::AccessBits::inputAttachmentRead) {
+		usage |= vk::ImageUsageBits::inputAttachment;
+	}
+
+	return usage;
+}
+
+vk::DeviceSize alignUp(vk::DeviceSize offset, vk::DeviceSize alignment)
+{
+	return ((offset + alignment - 1) / alignment) * alignment;
+}
+
+} // anonymous util namespace
+
+RenderGraph::RenderGraph(const Device& dev) : Resource(dev)
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+	destroy();
+}
+
+void swap(RenderGraph& a, RenderGraph& b) noexcept
+{
+	using std::swap;
+	swap(static_cast<Resource&>(a), static_cast<Resource&>(b));
+	swap(a.images_, b.images_);
+	swap(a.passes_, b.passes_);
+	swap(a.order_, b.order_);
+	swap(a.finalBarriers_, b.finalBarriers_);
+	swap(a.memories_, b.memories_);
+}
+
+unsigned int RenderGraph::addImage(const GraphImageInfo& info)
+{
+	ImageEntry entry;
+	entry.info = info;
+	entry.aspect = formatAspect(info.format);
+	entry.range = {entry.aspect, 0, 1, 0, 1};
+	images_.push_back(std::move(entry));
+	return images_.size() - 1;
+}
+
+unsigned int RenderGraph::addExternal(vk::Format format, const vk::Extent2D& extent,
+	const Access& initial, const Access& final,
+	std::optional<vk::ImageSubresourceRange> range)
+{
+	ImageEntry entry;
+	entry.external = true;
+	entry.info.format = format;
+	entry.info.extent = extent;
+	entry.initial = initial;
+	entry.final = final;
+	entry.aspect = formatAspect(format);
+	entry.range = range.value_or(vk::ImageSubresourceRange {entry.aspect,
+		0, vk::remainingMipLevels, 0, vk::remainingArrayLayers});
+	images_.push_back(std::move(entry));
+	return images_.size() - 1;
+}
+
+unsigned int RenderGraph::addPass(std::string name, vk::QueueFlags queue, RecordFunc record)
+{
+	Pass pass;
+	pass.name = std::move(name);
+	pass.queue = queue;
+	pass.record = std::move(record);
+	passes_.push_back(std::move(pass));
+	return passes_.size() - 1;
+}
+
+RenderGraph::Use& RenderGraph::use(unsigned int pass, unsigned int image, const Access& access)
+{
+	dlg_check("RenderGraph::use", {
+		if(pass >= passes_.size()) vpp_error("invalid pass {}", pass);
+		if(image >= images_.size()) vpp_error("invalid image {}", image);
+	});
+
+	auto& uses = passes_[pass].uses;
+	auto it = std::find_if(uses.begin(), uses.end(),
+		[&](auto& use) { return use.image == image; });
+	if(it == uses.end()) {
+		uses.push_back({image, access, Attachment::none, {}});
+		return uses.back();
+	}
+
+	if(it->access.layout != access.layout) {
+		throw std::logic_error("vpp::RenderGraph: pass " + passes_[pass].name +
+			" uses an image in different layouts");
+	}
+
+	it->access.stages |= access.stages;
+	it->access.access |= access.access;
+	return *it;
+}
+
+void RenderGraph::color(unsigned int pass, unsigned int image,
+	std::optional<vk::ClearValue> clear)
+{
+	auto& u = use(pass, image, {vk::PipelineStageBits::colorAttachmentOutput,
+		vk::AccessBits::colorAttachmentRead | vk::AccessBits::colorAttachmentWrite,
+		vk::ImageLayout::colorAttachmentOptimal});
+	u.attachment = Attachment::color;
+	u.clear = clear;
+}
+
+void RenderGraph::depth(unsigned int pass, unsigned int image,
+	std::optional<vk::ClearValue> clear)
+{
+	auto& u = use(pass, image, {
+		vk::PipelineStageBits::earlyFragmentTests | vk::PipelineStageBits::lateFragmentTests,
+		vk::AccessBits::depthStencilAttachmentRead | vk::AccessBits::depthStencilAttachmentWrite,
+		vk::ImageLayout::depthStencilAttachmentOptimal});
+	u.attachment = Attachment::depth;
+	u.clear = clear;
+}
+
+void RenderGraph::sampled(unsigned int pass, unsigned int image, vk::PipelineStageFlags stages)
+{
+	use(pass, image, {stages, vk::AccessBits::shaderRead,
+		vk::ImageLayout::shaderReadOnlyOptimal});
+}
+
+void RenderGraph::access(unsigned int pass, unsigned int image, const Access& access)
+{
+	use(pass, image, access);
+}
+
+void RenderGraph::compile(vk::QueueFlags queueFlags)
+{
+	destroy();
+	order_.clear();
+	finalBarriers_.clear();
+
+	for(auto& pass : passes_) {
+		auto needed = pass.queue;
+		for(auto& use : pass.uses) {
+			if(use.attachment != Attachment::none) needed |= vk::QueueBits::graphics;
+		}
+
+		if((needed & queueFlags) != needed) {
+			throw std::logic_error("vpp::RenderGraph::compile: queue does not support pass " +
+				pass.name);
+		}
+	}
+
+	// cull the passes whose writes are never read, going backwards.
+	// An image is live if its current contents will be read later
+	std::vector<bool> live(images_.size());
+	for(auto i = passes_.size(); i-- > 0;) {
+		auto& pass = passes_[i];
+		auto write = false;
+		auto needed = false;
+		for(auto& use : pass.uses) {
+			if(writes(use.access.access)) {
+				write = true;
+				needed |= images_[use.image].external || live[use.image];
+			}
+		}
+
+		// passes without writes may have other side effects
+		pass.culled = write && !needed;
+		if(pass.culled) {
+			continue;
+		}
+
+		for(auto& use : pass.uses) {
+			live[use.image] = !use.clear;
+		}
+	}
+
+	for(auto i = 0u; i < passes_.size(); ++i) {
+		if(!passes_[i].culled) order_.push_back(i);
+	}
+
+	// lifetimes
+	for(auto& image : images_) {
+		image.first = ~0u;
+		image.last = 0u;
+	}
+
+	for(auto o = 0u; o < order_.size(); ++o) {
+		for(auto& use : passes_[order_[o]].uses) {
+			auto& image = images_[use.image];
+			image.first = std::min(image.first, o);
+			image.last = std::max(image.last, o);
+		}
+	}
+
+	createImages();
+
+	// the accesses of the last uses of all images in one execution
+	std::vector<AccessState> states(images_.size());
+	for(auto id : order_) {
+		for(auto& use : passes_[id].uses) {
+			accessBarrier(states[use.image], use.access);
+		}
+	}
+
+	// The first use of a transient image has to wait for the last uses (in the
+	// previous execution) of all images sharing its memory, including itself
+	auto finals = std::move(states);
+	states.clear();
+	states.resize(images_.size());
+	for(auto i = 0u; i < images_.size(); ++i) {
+		auto& image = images_[i];
+		if(image.external) {
+			states[i] = accessState(image.initial);
+			continue;
+		}
+
+		if(!image.owned) {
+			continue;
+		}
+
+		for(auto j = 0u; j < images_.size(); ++j) {
+			auto& other = images_[j];
+			if(!other.owned || other.memory != image.memory ||
+					other.offset >= image.offset + image.size ||
+					image.offset >= other.offset + other.size) {
+				continue;
+			}
+
+			states[i].access.stages |= finals[j].access.stages;
+			states[i].access.access |= finals[j].access.access & writeAccessBits;
+		}
+	}
+
+	for(auto o = 0u; o < order_.size(); ++o) {
+		auto& pass = passes_[order_[o]];
+		createRenderPass(pass, o, states);
+
+		for(auto& use : pass.uses) {
+			// the previous contents of cleared attachments are discarded
+			auto& state = states[use.image];
+			if(use.clear) state.access.layout = vk::ImageLayout::undefined;
+			if(auto barrier = accessBarrier(state, use.access)) {
+				pass.barriers.push_back({use.image, *barrier});
+			}
+		}
+	}
+
+	for(auto i = 0u; i < images_.size(); ++i) {
+		auto& image = images_[i];
+		if(!image.external || image.first == ~0u) {
+			continue;
+		}
+
+		auto final = image.final;
+		if(!final.stages) final.stages = vk::PipelineStageBits::bottomOfPipe;
+		if(auto barrier = accessBarrier(states[i], final)) {
+			finalBarriers_.push_back({i, *barrier});
+		}
+	}
+}
+
+void RenderGraph::bind(unsigned int image, vk::Image img, vk::ImageView view)
+{
+	dlg_check("RenderGraph::bind", {
+		if(image >= images_.size() || !images_[image].external)
+			vpp_error("invalid external image {}", image);
+	});
+
+	// the framebuffers of the previous view are no longer valid
+	if(images_[image].view != view) {
+		for(auto& pass : passes_) {
+			auto& atts = pass.attachments;
+			if(std::find(atts.begin(), atts.end(), image) != atts.end()) {
+				pass.framebuffer = {};
+			}
+		}
+	}
+
+	images_[image].image = img;
+	images_[image].view = view;
+}
+
+void RenderGraph::record(vk::CommandBuffer cmdBuffer)
+{
+	dlg_check("RenderGraph::record", {
+		for(auto& image : images_) {
+			if(image.external && image.first != ~0u && !image.image)
+				vpp_error("external image not bound");
+		}
+	});
+
+	BarrierBatch batch(cmdBuffer);
+	auto add = [&](const Barrier& barrier) {
+		auto& image = images_[barrier.image];
+		batch.barrier(barrier.barrier, image.image, image.range);
+	};
+
+	for(auto id : order_) {
+		auto& pass = passes_[id];
+		for(auto& barrier : pass.barriers) {
+			add(barrier);
+		}
+
+		if(pass.renderPass) {
+			vk::RenderPassBeginInfo info;
+			info.renderPass = pass.renderPass;
+			info.framebuffer = framebuffer(pass);
+			info.renderArea = {{0, 0}, pass.extent};
+			info.clearValueCount = pass.clearValues.size();
+			info.pClearValues = pass.clearValues.data();
+
+			vk::cmdBeginRenderPass(batch.record(), info, vk::SubpassContents::eInline);
+			if(pass.record) pass.record(cmdBuffer);
+			vk::cmdEndRenderPass(cmdBuffer);
+		} else if(pass.record) {
+			pass.record(batch.record());
+		}
+	}
+
+	for(auto& barrier : finalBarriers_) {
+		add(barrier);
+	}
+
+	batch.flush();
+}
+
+vk::RenderPass RenderGraph::renderPass(unsigned int pass) const
+{
+	return passes_[pass].renderPass.vkHandle();
+}
+
+vk::Extent2D RenderGraph::extent(unsigned int pass) const
+{
+	return passes_[pass].extent;
+}
+
+bool RenderGraph::culled(unsigned int pass) const
+{
+	return passes_[pass].culled;
+}
+
+vk::Image RenderGraph::image(unsigned int image) const
+{
+	return images_[image].image;
+}
+
+vk::ImageView RenderGraph::imageView(unsigned int image) const
+{
+	return images_[image].view;
+}
+
+vk::DeviceSize RenderGraph::memorySize() const
+{
+	vk::DeviceSize size = 0u;
+	for(auto& memory : memories_) size += memory->size();
+	return size;
+}
+
+void RenderGraph::destroy()
+{
+	for(auto& pass : passes_) {
+		pass.barriers.clear();
+		pass.framebuffer = {};
+		pass.renderPass = {};
+		pass.attachments.clear();
+		pass.clearValues.clear();
+	}
+
+	for(auto& image : images_) {
+		if(!image.owned) {
+			continue;
+		}
+
+		image.ownedView = {};
+		vk::destroyImage(device(), image.image);
+		image.image = {};
+		image.view = {};
+		image.owned = false;
+	}
+
+	memories_.clear();
+}
+
+void RenderGraph::createImages()
+{
+	// the memory types and indices of images in them
+	std::vector<std::pair<unsigned int, std::vector<unsigned int>>> types;
+	std::vector<vk::DeviceSize> alignments(images_.size());
+
+	for(auto i = 0u; i < images_.size(); ++i) {
+		auto& image = images_[i];
+		if(image.external || image.first == ~0u) {
+			continue;
+		}
+
+		auto usage = image.info.usage;
+		for(auto id : order_) {
+			for(auto& use : passes_[id].uses) {
+				if(use.image == i) usage |= accessUsage(use.access);
+			}
+		}
+
+		vk::ImageCreateInfo info;
+		info.imageType = vk::ImageType::e2d;
+		info.format = image.info.format;
+		info.extent = {image.info.extent.width, image.info.extent.height, 1};
+		info.mipLevels = 1;
+		info.arrayLayers = 1;
+		info.samples = image.info.samples;
+		info.tiling = vk::ImageTiling::optimal;
+		info.usage = usage;
+		info.sharingMode = vk::SharingMode::exclusive;
+		info.initialLayout = vk::ImageLayout::undefined;
+
+		image.image = vk::createImage(device(), info);
+		image.owned = true;
+
+		auto reqs = vk::getImageMemoryRequirements(device(), image.image);
+		auto type = device().memoryType(vk::MemoryPropertyBits::deviceLocal,
+			reqs.memoryTypeBits);
+		if(type == -1) type = device().memoryType({}, reqs.memoryTypeBits);
+
+		image.size = reqs.size;
+		alignments[i] = reqs.alignment;
+
+		auto it = std::find_if(types.begin(), types.end(),
+			[&](auto& t) { return t.first == unsigned(type); });
+		if(it == types.end()) {
+			types.push_back({unsigned(type), {}});
+			it = types.end() - 1;
+		}
+
+		it->second.push_back(i);
+	}
+
+	// Place the images of each memory type, largest first. Images whose
+	// lifetimes overlap must not overlap in memory, all others may alias.
+	for(auto& type : types) {
+		auto& ids = type.second;
+		std::sort(ids.begin(), ids.end(),
+			[&](auto a, auto b) { return images_[a].size > images_[b].size; });
+
+		vk::DeviceSize size = 0u;
+		std::vector<unsigned int> placed;
+		for(auto id : ids) {
+			auto& image = images_[id];
+			auto alive = [&](const ImageEntry& other) {
+				return other.first <= image.last && image.first <= other.last;
+			};
+
+			std::vector<vk::DeviceSize> candidates {0u};
+			for(auto p : placed) {
+				if(alive(images_[p])) {
+					candidates.push_back(alignUp(images_[p].offset + images_[p].size,
+						alignments[id]));
+				}
+			}
+
+			std::sort(candidates.begin(), candidates.end());
+			for(auto offset : candidates) {
+				auto free = std::none_of(placed.begin(), placed.end(), [&](auto p) {
+					auto& other = images_[p];
+					return alive(other) && offset < other.offset + other.size &&
+						other.offset < offset + image.size;
+				});
+
+				if(free) {
+					image.offset = offset;
+					break;
+				}
+			}
+
+			image.memory = memories_.size();
+			size = std::max(size, image.offset + image.size);
+			placed.push_back(id);
+		}
+
+		memories_.push_back(std::make_unique<DeviceMemory>(device(), size, type.first));
+		for(auto id : ids) {
+			auto& image = images_[id];
+			vk::bindImageMemory(device(), image.image, *memories_.back(), image.offset);
+
+			vk::ImageViewCreateInfo info;
+			info.image = image.image;
+			info.viewType = vk::ImageViewType::e2d;
+			info.format = image.info.format;
+			info.subresourceRange = image.range;
+			image.ownedView = {device(), info};
+			image.view = image.ownedView;
+		}
+	}
+}
+
+void RenderGraph::createRenderPass(Pass& pass, unsigned int index,
+	const std::vector<AccessState>& states)
+{
+	std::vector<vk::AttachmentDescription> descriptions;
+	std::vector<vk::AttachmentReference> colorRefs;
+	vk::AttachmentReference depthRef {};
+	auto depth = false;
+
+	for(auto& use : pass.uses) {
+		if(use.attachment == Attachment::none) {
+			continue;
+		}
+
+		auto& image = images_[use.image];
+		if(descriptions.empty()) {
+			pass.extent = image.info.extent;
+		} else if(pass.extent.width != image.info.extent.width ||
+				pass.extent.height != image.info.extent.height) {
+			throw std::logic_error("vpp::RenderGraph::compile: attachments of pass " +
+				pass.name + " have different sizes");
+		}
+
+		// load the previous contents only if they are defined, store
+		// them only if they are used afterwards
+		auto load = vk::AttachmentLoadOp::dontCare;
+		if(use.clear) load = vk::AttachmentLoadOp::clear;
+		else if(states[use.image].access.layout != vk::ImageLayout::undefined)
+			load = vk::AttachmentLoadOp::load;
+
+		auto store = vk::AttachmentStoreOp::dontCare;
+		if(image.external || image.last > index) store = vk::AttachmentStoreOp::store;
+
+		auto stencil = (image.aspect & vk::ImageAspectBits::stencil);
+
+		vk::AttachmentDescription desc;
+		desc.format = image.info.format;
+		desc.samples = image.info.samples;
+		desc.loadOp = load;
+		desc.storeOp = store;
+		desc.stencilLoadOp = stencil ? load : vk::AttachmentLoadOp::dontCare;
+		desc.stencilStoreOp = stencil ? store : vk::AttachmentStoreOp::dontCare;
+		desc.initialLayout = use.access.layout;
+		desc.finalLayout = use.access.layout;
+
+		vk::AttachmentReference ref {unsigned(descriptions.size()), use.access.layout};
+		if(use.attachment == Attachment::depth) {
+			depthRef = ref;
+			depth = true;
+		} else {
+			colorRefs.push_back(ref);
+		}
+
+		descriptions.push_back(desc);
+		pass.attachments.push_back(use.image);
+		pass.clearValues.push_back(use.clear.value_or(vk::ClearValue {}));
+	}
+
+	if(descriptions.empty()) {
+		return;
+	}
+
+	vk::SubpassDescription subpass;
+	subpass.pipelineBindPoint = vk::PipelineBindPoint::graphics;
+	subpass.colorAttachmentCount = colorRefs.size();
+	subpass.pColorAttachments = colorRefs.data();
+	subpass.pDepthStencilAttachment = depth ? &depthRef : nullptr;
+
+	vk::RenderPassCreateInfo info;
+	info.attachmentCount = descriptions.size();
+	info.pAttachments = descriptions.data();
+	info.subpassCount = 1;
+	info.pSubpasses = &subpass;
+	pass.renderPass = {device(), info};
+}
+
+vk::Framebuffer RenderGraph::framebuffer(Pass& pass)
+{
+	if(pass.framebuffer.vkHandle()) {
+		return pass.framebuffer;
+	}
+
+	std::vector<vk::ImageView> views;
+	views.reserve(pass.attachments.size());
+	for(auto id : pass.attachments) {
+		views.push_back(images_[id].view);
+	}
+
+	vk::FramebufferCreateInfo info;
+	info.renderPass = pass.renderPass;
+	info.attachmentCount = views.size();
+	info.pAttachments = views.data();
+	info.width = pass.extent.width;
+	info.height = pass.extent.height;
+	info.layers = 1;
+
+	auto fb = vk::createFramebuffer(device(), info);
+	pass.framebuffer = {device(), pass.extent, fb};
+	return pass.framebuffer;
+}
+
+} // namespace vpp
@@ -8,6 +8,7 @@
 #include <vpp/queue.hpp>
 #include <vpp/submit.hpp>
 #include <vpp/sync.hpp>
+#include <vpp/barrier.hpp>
 #include <vpp/vk.hpp>
 
 #include <stdexcept>
@@ -23,6 +24,11 @@ SwapchainRenderer::SwapchainRenderer(const Swapchain& sc, const CreateInfo& inf,
 
 SwapchainRenderer::~SwapchainRenderer()
 {
+	try {
+		wait();
+	} catch(const std::exception& err) {
+		vpp_warn("::SwapchainRenderer::~SwapchainRenderer"_src, "wait: {}", err.what());
+	}
 }
 
 void swap(SwapchainRenderer& a, SwapchainRenderer& b) noexcept
@@ -37,6 +43,8 @@ void swap(SwapchainRenderer& a, SwapchainRenderer& b) noexcept
 	swap(a.staticAttachments_, b.staticAttachments_);
 	swap(a.renderImpl_, b.renderImpl_);
 	swap(a.info_, b.info_);
+	swap(a.frames_, b.frames_);
+	swap(a.frame_, b.frame_);
 }
 
 void SwapchainRenderer::create(const Swapchain& swapChain, const CreateInfo& info)
@@ -44,9 +52,25 @@ void SwapchainRenderer::create(const Swapchain& swapChain, const CreateInfo& inf
 	if(!info.renderPass)
 		throw std::runtime_error("vpp::SwapchainRenderer: invalid renderPass");
 
+	if(!info.framesInFlight)
+		throw std::runtime_error("vpp::SwapchainRenderer: framesInFlight must not be 0");
+
 	swapChain_ = &swapChain;
 	info_ = info;
 
+	// sync objects are only created once, they are kept on recreation
+	if(frames_.size() != info.framesInFlight) {
+		wait();
+		frames_.clear();
+		frames_.resize(info.framesInFlight);
+		frame_ = 0u;
+		for(auto& frame : frames_) {
+			frame.acquire = {device()};
+			frame.render = {device()};
+			frame.fence = {device()};
+		}
+	}
+
 	// attachments
 	std::vector<ViewableImage::CreateInfo> dynamic;
 	Framebuffer::ExtAttachments ext;
@@ -138,6 +162,7 @@ void SwapchainRenderer::init(RenderImpl builder)
 void SwapchainRenderer::recreate()
 {
 	// TODO: reuse command buffers?
+	wait();
 	renderBuffers_.clear();
 	staticAttachments_.clear();
 
@@ -169,7 +194,10 @@ void SwapchainRenderer::record(int id)
 
 	vk::beginCommandBuffer(vkbuf, cmdBufInfo);
 	renderImpl_->beforeRender(vkbuf);
-	vk::cmdBeginRenderPass(vkbuf, beginInfo, vk::SubpassContents::eInline);
+
+	BarrierBatch barriers(vkbuf);
+	renderImpl_->barriers(id, barriers);
+	vk::cmdBeginRenderPass(barriers.record(), beginInfo, vk::SubpassContents::eInline);
 
 	// Update dynamic viewport state
 	vk::Viewport viewport;
@@ -193,24 +221,36 @@ void SwapchainRenderer::record(int id)
 	vk::endCommandBuffer(vkbuf);
 }
 
-std::unique_ptr<Work<void>> SwapchainRenderer::render(const Queue& present, const Queue* gfx)
+vk::Result SwapchainRenderer::render(const Queue& present, const Queue* gfx,
+	std::uint64_t timeout)
 {
 	if(gfx == nullptr) gfx = device().queue(vk::QueueBits::graphics);
 	if(!gfx) throw std::runtime_error("vpp::SwapchainRenderer::render: no graphics queue");
 
-	vk::SemaphoreCreateInfo semaphoreCI;
-	auto acquireComplete = Semaphore(device());
-	auto renderComplete = Semaphore(device());
+	// only blocks if the device has not finished the frame that used
+	// the sync objects framesInFlight frames ago
+	auto& frame = frames_[frame_];
+	if(frame.submitted) {
+		vk::waitForFences(device(), {frame.fence.vkHandle()}, true, UINT64_MAX);
+	}
 
 	unsigned int currentBuffer;
-	swapChain().acquire(currentBuffer, acquireComplete);
+	auto res = swapChain().acquire(currentBuffer, frame.acquire, {}, timeout);
+	if(res != vk::Result::success && res != vk::Result::suboptimalKHR) {
+		return res;
+	}
 
-	renderImpl_->frame(currentBuffer);
+	// the command buffer may still be used by another frame if the swapchain
+	// returns its images out of order or has less images than framesInFlight
+	auto& buffer = renderBuffers_[currentBuffer];
+	if(buffer.fence && buffer.fence != frame.fence.vkHandle()) {
+		vk::waitForFences(device(), {buffer.fence}, true, UINT64_MAX);
+	}
 
-	auto& cmdBuf = renderBuffers_[currentBuffer].commandBuffer;
+	renderImpl_->frame(currentBuffer);
 	auto additionals = renderImpl_->submit(currentBuffer);
 
-	std::vector<vk::Semaphore> semaphores {acquireComplete};
+	std::vector<vk::Semaphore> semaphores {frame.acquire};
 	std::vector<vk::PipelineStageFlags> flags {vk::PipelineStageBits::colorAttachmentOutput};
 	semaphores.reserve(additionals.size() + 1);
 	flags.reserve(additionals.size() + 1);
@@ -224,97 +264,56 @@ std::unique_ptr<Work<void>> SwapchainRenderer::render(const Queue& present, cons
 	submitInfo.waitSemaphoreCount = semaphores.size();
 	submitInfo.pWaitSemaphores = semaphores.data();
 	submitInfo.pWaitDstStageMask = flags.data();
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &buffer.commandBuffer.vkHandle();
 	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = &renderComplete.vkHandle();
-
-	CommandExecutionState execState;
-	device().submitManager().add(*gfx, {cmdBuf}, submitInfo, &execState);
-	device().submitManager().submit(*gfx);
-
-	swapChain().present(present, currentBuffer, renderComplete);
-
-	class WorkImpl : public Work<void> {
-	public:
-		Semaphore acquire_;
-		Semaphore render_;
-		CommandExecutionState executionState_;
-		WorkBase::State state_ = WorkBase::State::submitted;
-
-		~WorkImpl()
-		{
-			try {
-				finish();
-			} catch(const std::exception& err) {
-				vpp_warn("::SwapchainRenderer::render"_src, "Work::finish: {}", err.what());
-			}
-		}
-
-		virtual void finish() override
-		{
-			wait();
-			acquire_ = {};
-			render_ = {};
-			state_ = WorkBase::State::finished;
-		}
-
-		virtual WorkBase::State state() override { return state_; }
-		virtual void submit() override {}
-
-		virtual void wait() override
-		{
-			executionState_.wait();
-			state_ = WorkBase::State::executed;
-		}
-	};
+	submitInfo.pSignalSemaphores = &frame.render.vkHandle();
+
+	// submit directly with the frames own fence instead of going through
+	// the SubmitManager which would create a new one
+	vk::resetFences(device(), {frame.fence.vkHandle()});
+	frame.submitted = false;
+
+	// this marks the end of a frame for the SubmitManager. Work still pending
+	// for the gfx queue (e.g. uploads the frame depends on) must be submitted
+	// before the frame, independent of its flush policy
+	auto& submitManager = device().submitManager();
+	submitManager.endFrame();
+	submitManager.submit(*gfx);
+
+	{
+		QueueLock queueLock(device(), *gfx);
+		vk::queueSubmit(*gfx, {submitInfo}, frame.fence);
+	}
 
-	auto work = std::make_unique<WorkImpl>();
-	work->acquire_ = std::move(acquireComplete);
-	work->render_ = std::move(renderComplete);
-	work->executionState_ = std::move(execState);
+	frame.submitted = true;
+	buffer.fence = frame.fence;
+	frame_ = (frame_ + 1) % frames_.size();
 
-	return std::move(work);
+	return swapChain().present(present, currentBuffer, frame.render);
 }
 
-void SwapchainRenderer::renderBlock(const Queue& present, const Queue* gfx)
+vk::Result SwapchainRenderer::renderBlock(const Queue& present, const Queue* gfx)
 {
-	if(gfx == nullptr) gfx = device().queue(vk::QueueBits::graphics);
-	if(!gfx) throw std::runtime_error("vpp::SwapchainRenderer::renderBlock: no graphics queue");
-
-	auto acquireComplete = Semaphore(device());
-	auto renderComplete = Semaphore(device());
-
-	unsigned int currentBuffer;
-	swapChain().acquire(currentBuffer, acquireComplete);
-
-	renderImpl_->frame(currentBuffer);
-
-	auto& cmdBuf = renderBuffers_[currentBuffer].commandBuffer;
-	auto additionals = renderImpl_->submit(currentBuffer);
-
-	std::vector<vk::Semaphore> semaphores {acquireComplete};
-	std::vector<vk::PipelineStageFlags> flags {vk::PipelineStageBits::colorAttachmentOutput};
-	semaphores.reserve(additionals.size() + 1);
-	flags.reserve(additionals.size() + 1);
-
-	for(auto& sem : additionals) {
-		semaphores.push_back(sem.first);
-		flags.push_back(sem.second);
+	auto& frame = frames_[frame_];
+	auto res = render(present, gfx);
+	if(frame.submitted) {
+		vk::waitForFences(device(), {frame.fence.vkHandle()}, true, UINT64_MAX);
 	}
 
-	vk::SubmitInfo submitInfo;
-	submitInfo.waitSemaphoreCount = semaphores.size();
-	submitInfo.pWaitSemaphores = semaphores.data();
-	submitInfo.pWaitDstStageMask = flags.data();
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = &renderComplete.vkHandle();
-
-	CommandExecutionState execState;
-	device().submitManager().add(*gfx, {cmdBuf}, submitInfo, &execState);
-	device().submitManager().submit(*gfx);
+	return res;
+}
 
-	swapChain().present(present, currentBuffer, renderComplete);
+void SwapchainRenderer::wait()
+{
+	std::vector<vk::Fence> fences;
+	for(auto& frame : frames_) {
+		if(frame.submitted) fences.push_back(frame.fence);
+	}
 
-	execState.wait();
+	if(!fences.empty()) {
+		vk::waitForFences(device(), fences, true, UINT64_MAX);
+	}
 }
 
 } // namespace vpp
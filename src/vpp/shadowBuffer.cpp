@@ -0,0 +1,173 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <vpp/shadowBuffer.hpp>
+#include <vpp/buffer.hpp>
+#include <vpp/transfer.hpp>
+#include <vpp/transferWork.hpp>
+#include <vpp/queue.hpp>
+#include <vpp/vk.hpp>
+#include <vpp/util/log.hpp>
+
+#include <cstring> // std::memcpy
+#include <algorithm> // std::min
+#include <stdexcept> // std::logic_error
+#include <utility> // std::move
+
+#ifdef __SSE2__
+	#include <emmintrin.h> // _mm_cmpeq_epi8
+#endif
+
+namespace vpp {
+namespace {
+
+/// Returns whether the given memory ranges of size bytes differ.
+/// Compares 64 bytes per iteration using SSE2 if available, which allows an early
+/// exit for changed pages while unchanged pages are compared at memory bandwidth.
+bool differs(const uint8_t* a, const uint8_t* b, std::size_t size)
+{
+	std::size_t i = 0u;
+
+#ifdef __SSE2__
+	auto load = [](const uint8_t* ptr) {
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+	};
+
+	for(; i + 64 <= size; i += 64) {
+		auto eq0 = _mm_cmpeq_epi8(load(a + i), load(b + i));
+		auto eq1 = _mm_cmpeq_epi8(load(a + i + 16), load(b + i + 16));
+		auto eq2 = _mm_cmpeq_epi8(load(a + i + 32), load(b + i + 32));
+		auto eq3 = _mm_cmpeq_epi8(load(a + i + 48), load(b + i + 48));
+		auto eq = _mm_and_si128(_mm_and_si128(eq0, eq1), _mm_and_si128(eq2, eq3));
+		if(_mm_movemask_epi8(eq) != 0xFFFF) return true;
+	}
+#endif
+
+	return std::memcmp(a + i, b + i, size - i) != 0;
+}
+
+} // anonymous util namespace
+
+ShadowBuffer::ShadowBuffer(const Buffer& buffer, std::size_t size, std::size_t pageSize,
+	bool compare) : buffer_(&buffer), pageSize_(pageSize)
+{
+	if(!pageSize) throw std::logic_error("vpp::ShadowBuffer: pageSize must not be 0");
+
+	buffer.assureMemory();
+	shadow_.resize(size);
+	dirty_.resize((size + pageSize - 1) / pageSize);
+	if(compare) uploaded_.resize(size);
+}
+
+void ShadowBuffer::write(std::size_t offset, nytl::Span<const uint8_t> data)
+{
+	if(offset + data.size() > size())
+		throw std::out_of_range("vpp::ShadowBuffer::write: out of range");
+
+	std::memcpy(shadow_.data() + offset, data.data(), data.size());
+	markDirty(offset, data.size());
+}
+
+void ShadowBuffer::markDirty(std::size_t offset, std::size_t size)
+{
+	// an empty (or default constructed) shadow buffer has no pages
+	if(!size || dirty_.empty()) return;
+
+	dlg_check("ShadowBuffer::markDirty", {
+		if(offset + size > this->size()) vpp_error("range out of bounds");
+	});
+
+	auto last = std::min((offset + size - 1) / pageSize_, dirty_.size() - 1);
+	for(auto i = offset / pageSize_; i <= last; ++i) dirty_[i] = true;
+}
+
+std::size_t ShadowBuffer::dirtyPages() const
+{
+	return std::count(dirty_.begin(), dirty_.end(), true);
+}
+
+WorkPtr ShadowBuffer::upload()
+{
+	// collect the changed pages, merging adjacent ones into one region
+	std::vector<vk::BufferCopy> regions;
+	std::size_t total = 0u;
+	for(auto i = 0u; i < dirty_.size(); ++i) {
+		auto offset = i * pageSize_;
+		auto size = std::min(pageSize_, shadow_.size() - offset);
+
+		auto changed = dirty_[i];
+		if(!changed && !uploaded_.empty())
+			changed = differs(&shadow_[offset], &uploaded_[offset], size);
+		if(!changed) continue;
+
+		if(!regions.empty() && regions.back().dstOffset + regions.back().size == offset) {
+			regions.back().size += size;
+		} else {
+			regions.push_back({total, offset, size});
+		}
+
+		total += size;
+	}
+
+	std::fill(dirty_.begin(), dirty_.end(), false);
+	if(regions.empty()) return std::make_unique<FinishedWork<void>>();
+
+	for(auto& region : regions) {
+		if(!uploaded_.empty()) {
+			std::memcpy(&uploaded_[region.dstOffset], &shadow_[region.dstOffset],
+				region.size);
+		}
+	}
+
+	// write directly into the buffer if possible
+	if(buffer().mappable()) {
+		auto map = buffer().memoryMap();
+		for(auto& region : regions)
+			std::memcpy(map.ptr() + region.dstOffset, &shadow_[region.dstOffset], region.size);
+
+		if(!map.coherent()) map.flush();
+		return std::make_unique<FinishedWork<void>>();
+	}
+
+	// otherwise pack all regions into one staging range and copy them
+	// with a single command
+	const Queue* queue;
+	auto qFam = transferQueueFamily(device(), &queue);
+	if(qFam == -1) throw std::logic_error("vpp::ShadowBuffer::upload: device has no valid queue");
+
+	auto cmdBuffer = device().commandProvider().get(qFam);
+	auto stage = device().transferManager().buffer(total);
+
+	{
+		auto map = stage.buffer().memoryMap();
+		for(auto& region : regions) {
+			std::memcpy(map.ptr() + stage.offset() + region.srcOffset,
+				&shadow_[region.dstOffset], region.size);
+			region.srcOffset += stage.offset();
+		}
+
+		if(!map.coherent()) map.flush();
+	}
+
+	vk::beginCommandBuffer(cmdBuffer, {});
+	vk::cmdCopyBuffer(cmdBuffer, stage.buffer(), buffer(), regions);
+	vk::endCommandBuffer(cmdBuffer);
+
+	return std::make_unique<UploadWork>(std::move(cmdBuffer), *queue, std::move(stage));
+}
+
+void swap(ShadowBuffer& a, ShadowBuffer& b) noexcept
+{
+	using std::swap;
+	using RR = ResourceReference<ShadowBuffer>;
+
+	swap(static_cast<RR&>(a), static_cast<RR&>(b));
+	swap(a.buffer_, b.buffer_);
+	swap(a.pageSize_, b.pageSize_);
+	swap(a.shadow_, b.shadow_);
+	swap(a.uploaded_, b.uploaded_);
+	swap(a.dirty_, b.dirty_);
+}
+
+} // namespace vpp
@@ -0,0 +1,137 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <vpp/streamDownload.hpp>
+#include <vpp/buffer.hpp>
+#include <vpp/work.hpp>
+#include <vpp/transfer.hpp>
+#include <vpp/queue.hpp>
+#include <vpp/vk.hpp>
+
+#include <fstream> // std::ofstream
+#include <future> // std::shared_future
+#include <stdexcept> // std::runtime_error, std::logic_error
+#include <algorithm> // std::min
+#include <memory> // std::unique_ptr
+#include <string> // std::string
+#include <vector> // std::vector
+
+namespace vpp {
+namespace {
+
+/// Writes the given data to the given stream.
+void writeChunk(std::ofstream& ofs, const uint8_t* data, std::size_t size)
+{
+	ofs.write(reinterpret_cast<const char*>(data), size);
+	if(!ofs) throw std::runtime_error("vpp::retrieveToFile: failed to write file");
+}
+
+/// Staging buffer for one chunk that is in flight.
+struct Staging {
+	Buffer buffer;
+	MemoryMapView map;
+	std::unique_ptr<CommandWork<void>> work; // the copy into the buffer
+	std::shared_future<void> write; // writing the buffer to the file
+	vk::DeviceSize size {};
+};
+
+} // anonymous util namespace
+
+void retrieveToFile(const Buffer& buf, nytl::StringParam path, vk::DeviceSize offset,
+	vk::DeviceSize size, vk::DeviceSize chunkSize, unsigned int stagingCount)
+{
+	dlg_check("retrieveToFile", {
+		if(!buf.memoryEntry().allocated()) vpp_error("buffer has no memory");
+	});
+
+	// would never make progress
+	if(!chunkSize || !stagingCount) {
+		throw std::logic_error("vpp::retrieveToFile: chunkSize and stagingCount must not be 0");
+	}
+
+	if(size == vk::wholeSize) size = buf.memoryEntry().size() - offset;
+
+	std::ofstream ofs(path, std::ios::binary);
+	if(!ofs.is_open()) {
+		throw std::runtime_error(std::string("vpp::retrieveToFile: couldnt open file ") +
+			path.data());
+	}
+
+	if(!size) return;
+
+	// write directly from the mapped memory if possible
+	if(buf.mappable()) {
+		auto map = buf.memoryMap();
+		if(!map.coherent()) map.reload();
+		for(auto done = vk::DeviceSize {}; done < size; done += chunkSize)
+			writeChunk(ofs, map.ptr() + offset + done, std::min(chunkSize, size - done));
+
+		return;
+	}
+
+	const Queue* queue;
+	auto qFam = transferQueueFamily(buf.device(), &queue);
+	if(qFam == -1) throw std::logic_error("vpp::retrieveToFile: device has no valid queue");
+
+	auto& dev = buf.device();
+	auto chunkCount = (size + chunkSize - 1) / chunkSize;
+	stagingCount = std::min<vk::DeviceSize>(stagingCount, chunkCount);
+
+	vk::BufferCreateInfo info;
+	info.size = std::min(chunkSize, size);
+	info.usage = vk::BufferUsageBits::transferDst;
+
+	std::vector<Staging> stagings(stagingCount);
+	for(auto& staging : stagings) {
+		staging.buffer = {dev, info, MemoryUsage::hostRead};
+		staging.map = staging.buffer.memoryMap();
+	}
+
+	// hands the chunk of the given staging buffer to the writer once its copy
+	// has finished. Every write first waits for the previous one so the
+	// chunks are written in order
+	std::shared_future<void> lastWrite;
+	auto write = [&](Staging& staging) {
+		if(!staging.work) return;
+
+		staging.work->finish();
+		staging.work.reset();
+		if(!staging.map.coherent()) staging.map.reload();
+
+		auto ptr = staging.map.ptr();
+		auto chunk = staging.size;
+		staging.write = std::async(std::launch::async, [&ofs, ptr, chunk, prev = lastWrite]{
+			if(prev.valid()) prev.get();
+			writeChunk(ofs, ptr, chunk);
+		}).share();
+		lastWrite = staging.write;
+	};
+
+	for(auto i = vk::DeviceSize {}; i < chunkCount; ++i) {
+		auto& staging = stagings[i % stagingCount];
+
+		// the staging buffer can only be reused once its last chunk was written
+		write(staging);
+		if(staging.write.valid()) staging.write.get();
+
+		staging.size = std::min(chunkSize, size - i * chunkSize);
+		vk::BufferCopy region {offset + i * chunkSize, 0, staging.size};
+
+		auto cmdBuffer = dev.commandProvider().get(qFam);
+		vk::beginCommandBuffer(cmdBuffer, {});
+		vk::cmdCopyBuffer(cmdBuffer, buf, staging.buffer, {region});
+		vk::endCommandBuffer(cmdBuffer);
+
+		staging.work = std::make_unique<CommandWork<void>>(std::move(cmdBuffer), *queue);
+		staging.work->submit();
+
+		// write the previous chunk while the device copies this one
+		if(i > 0) write(stagings[(i - 1) % stagingCount]);
+	}
+
+	write(stagings[(chunkCount - 1) % stagingCount]);
+	lastWrite.get();
+}
+
+} // namespace vpp
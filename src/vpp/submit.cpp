@@ -3,39 +3,146 @@
 // See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
 
 #include <vpp/submit.hpp>
+#include <vpp/procAddr.hpp>
 #include <vpp/queue.hpp>
+#include <vpp/device.hpp>
 #include <vpp/sync.hpp>
 #include <vpp/vk.hpp>
 #include <vpp/util/log.hpp>
+#include <vpp/timelineSemaphore.hpp>
 
-#include <algorithm> // std::remove_if
+#include <algorithm> // std::remove_if, std::rotate, std::reverse
+#include <chrono> // std::chrono::steady_clock
+#include <exception> // std::exception
+#include <stdexcept> // std::logic_error
 
 namespace vpp {
+namespace {
+
+std::int64_t now()
+{
+	auto time = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+}
+
+// value of a submission that was removed before it was submitted
+constexpr auto removedValue = ~std::uint64_t(0);
+
+} // anonymous util namespace
+
+// pending submission on another queue
+struct SubmitManager::Dependency {
+	SubmissionValue value; // of the dependency
+	Lane* lane; // of the dependency
+	vk::PipelineStageFlags stages;
+	vk::Semaphore semaphore; // binary semaphore, if timeline semaphores are not used
+};
+
+// semaphore wait for an already submitted dependency
+struct SubmitManager::Wait {
+	vk::Semaphore semaphore;
+	vk::PipelineStageFlags stages;
+	std::uint64_t value; // for timeline semaphores
+};
 
 struct SubmitManager::Submission {
 	const vpp::Queue* queue {};
 	vk::SubmitInfo info {};
 	std::vector<vk::CommandBuffer> buffers {};
 	CommandExecutionState* state {};
+	SubmissionValue value {}; // only if other submissions depend on it
+	std::int64_t added {}; // see now()
+
+	std::vector<Dependency> dependencies {};
+	std::vector<Wait> waits {};
+	std::vector<vk::Semaphore> signals {}; // semaphores for dependent submissions
+	std::vector<Semaphore> semaphores {}; // owned semaphores of dependencies
+	std::vector<SubmissionValue> after {}; // dependencies on the same queue
+};
+
+// The submissions and submission tracking of one queue.
+// Added submissions are pushed onto a lock-free stack and moved to
+// the pending submissions by the thread that next locks the lane.
+struct SubmitManager::Lane {
+	struct Node {
+		Submission submission;
+		Node* next;
+	};
+
+	const vpp::Queue* queue {};
+	std::atomic<Node*> intake {};
+	std::atomic<std::size_t> count {}; // number of added, not yet submitted submissions
+	std::atomic<std::size_t> buffers {}; // number of their command buffers
+	std::atomic<std::int64_t> since {}; // when the oldest of them was added, see now()
+
+	// flush policy, see SubmitManager::FlushPolicy
+	std::atomic<unsigned int> flushBuffers {};
+	std::atomic<std::int64_t> flushAge {}; // in nanoseconds
+	std::atomic<bool> flushFrame {true};
+
+	Semaphore semaphore; // timeline semaphore, if supported
+
+	// everything below is guarded by the mutex
+	std::mutex mutex;
+	std::vector<Submission> submissions; // pending submissions, in order
+
+	std::uint64_t submitted {}; // value of the last submission
+	std::uint64_t completed {}; // value of the last known completed submission
+
+	// without timeline semaphores, the fences of pending submissions and
+	// signaled fences that can be reused
+	std::vector<std::pair<std::uint64_t, Fence>> pending;
+	std::vector<Fence> fences;
+
+	// binary semaphores waited for by pending submissions
+	std::vector<std::pair<std::uint64_t, Semaphore>> semaphores;
 };
 
 // SubmitManager
 SubmitManager::SubmitManager(const Device& dev) : Resource(dev)
 {
+	// only use timeline semaphores if the extension and feature were enabled
+	if(dev.timelineSemaphores()) {
+		getCounterValue_ = vulkanProc(vkDevice(), "vkGetSemaphoreCounterValueKHR");
+		waitSemaphores_ = vulkanProc(vkDevice(), "vkWaitSemaphoresKHR");
+	}
+
+	// the queues of a device never change, so the lanes can be
+	// accessed without synchronization
+	for(auto queue : dev.queues()) {
+		lanes_.emplace_back();
+		auto& lane = lanes_.back();
+		lane.queue = queue;
+
+		if(timelineSemaphores()) {
+			ext::SemaphoreTypeCreateInfo typeInfo;
+			vk::SemaphoreCreateInfo info;
+			info.pNext = &typeInfo;
+			lane.semaphore = {device(), info};
+		}
+	}
 }
 
 SubmitManager::~SubmitManager()
 {
-	dlg_check("~SubmitManager", {
-		if(!pending_.empty())
-			vpp_warn("There are ", pending_.size(), " pending submission left");
-	});
+	stopThread();
+
+	for(auto& lane : lanes_) {
+		std::lock_guard<std::mutex> lock(lane.mutex);
+		drain(lane);
+
+		dlg_check("~SubmitManager", {
+			if(!lane.submissions.empty())
+				vpp_warn("There are ", lane.submissions.size(), " pending submission left");
+		});
+	}
 }
 
 void SubmitManager::submit()
 {
-	while(!pending_.empty())
-		submit(*pending_.begin()->queue);
+	for(auto& lane : lanes_) {
+		if(lane.count.load()) submit(lane);
+	}
 }
 
 void SubmitManager::submit(const vpp::Queue& queue)
@@ -45,20 +152,68 @@ void SubmitManager::submit(const vpp::Queue& queue)
 			vpp_error("invalid queue given");
 	});
 
-	// lock own mutex and mutex of all queues
-	std::lock_guard<std::mutex> internalLock(mutex_);
+	submit(lane(queue));
+}
+
+void SubmitManager::submit(Lane& lane, const std::atomic<std::uint64_t>* until)
+{
+	// First submit the pending submissions on other queues that the
+	// submissions to submit depend on. Only the submissions up to the dependency
+	// are submitted from the other lane, so the lanes can depend on each other
+	// as long as the submissions don't. Done without holding the lock
+	// of this lane since it might be needed for that.
+	while(true) {
+		SubmissionValue other {};
+		Lane* otherLane {};
+
+		{
+			std::lock_guard<std::mutex> lock(lane.mutex);
+			drain(lane);
 
-	// find pending submissions for the given queue
-	// also check if a fence must be created
+			auto end = lane.submissions.end();
+			if(until) {
+				if(until->load()) return; // submitted or removed in the meantime
+
+				auto pred = [&](const Submission& sub) { return sub.value.get() == until; };
+				end = std::find_if(lane.submissions.begin(), end, pred);
+				if(end == lane.submissions.end()) return;
+				++end;
+			}
+
+			for(auto it = lane.submissions.begin(); it != end && !other; ++it) {
+				for(auto& dep : it->dependencies) {
+					if(!dep.value->load()) {
+						other = dep.value;
+						otherLane = dep.lane;
+						break;
+					}
+				}
+			}
+
+			if(!other) {
+				submitLocked(lane, end - lane.submissions.begin());
+				return;
+			}
+		}
+
+		submit(*otherLane, other.get());
+	}
+}
+
+void SubmitManager::submitLocked(Lane& lane, std::size_t count)
+{
+	// check if a fence must be used
 	// also make sure command buffer pointers are valid
+	auto& subs = lane.submissions;
+	auto end = subs.begin() + count;
 	std::vector<vk::SubmitInfo> submitInfos;
-	submitInfos.reserve(pending_.size());
-	auto createFence = false;
+	submitInfos.reserve(count);
+	auto useFence = false;
 
-	for(const auto& sub : pending_) {
-		if(sub.queue != &queue) continue;
+	for(auto it = subs.begin(); it != end; ++it) {
+		auto& sub = *it;
 		submitInfos.push_back(sub.info);
-		createFence = (sub.state != nullptr);
+		useFence |= (sub.state || sub.value || !sub.semaphores.empty());
 
 		submitInfos.back().pCommandBuffers = sub.buffers.data();
 		submitInfos.back().commandBufferCount = sub.buffers.size();
@@ -67,27 +222,286 @@ void SubmitManager::submit(const vpp::Queue& queue)
 	if(submitInfos.empty())
 		return;
 
-	// create fence if needed
-	std::shared_ptr<Fence> shfence;
-	if(createFence) {
-		shfence = std::make_shared<Fence>(device());
+	// The semaphores of dependencies are added to the given ones.
+	// With timeline semaphores, every batch additionally signals the queues
+	// semaphore with its own value. Since signal operations are executed in
+	// submission order, a value being reached means that all previous
+	// submissions to the queue completed as well.
+	// Otherwise all batches share one (reused) fence and value.
+	struct Batch {
+		std::vector<vk::Semaphore> waits;
+		std::vector<vk::PipelineStageFlags> waitStages;
+		std::vector<std::uint64_t> waitValues; // ignored for binary semaphores
+		std::vector<vk::Semaphore> signals;
+		std::vector<std::uint64_t> signalValues;
+		ext::TimelineSemaphoreSubmitInfo timelineInfo;
+	};
+
+	std::vector<Batch> batches(submitInfos.size());
+	for(auto i = 0u; i < submitInfos.size(); ++i) {
+		auto& info = submitInfos[i];
+		auto& sub = subs[i];
+		auto& batch = batches[i];
+		if(!timelineSemaphores() && sub.dependencies.empty() && sub.signals.empty()) {
+			continue;
+		}
+
+		batch.waits = {info.pWaitSemaphores, info.pWaitSemaphores + info.waitSemaphoreCount};
+		batch.waitStages = {info.pWaitDstStageMask,
+			info.pWaitDstStageMask + info.waitSemaphoreCount};
+		batch.waitValues.resize(batch.waits.size());
+		for(auto& dep : sub.dependencies) {
+			auto value = dep.value->load();
+			if(value == removedValue) {
+				continue;
+			}
+
+			if(timelineSemaphores()) {
+				batch.waits.push_back(dep.lane->semaphore);
+				batch.waitValues.push_back(value);
+			} else {
+				batch.waits.push_back(dep.semaphore);
+				batch.waitValues.push_back(0u);
+			}
+
+			batch.waitStages.push_back(dep.stages);
+		}
+
+		for(auto& wait : sub.waits) {
+			batch.waits.push_back(wait.semaphore);
+			batch.waitStages.push_back(wait.stages);
+			batch.waitValues.push_back(wait.value);
+		}
+
+		batch.signals = {info.pSignalSemaphores,
+			info.pSignalSemaphores + info.signalSemaphoreCount};
+		batch.signals.insert(batch.signals.end(), sub.signals.begin(), sub.signals.end());
+		batch.signalValues.resize(batch.signals.size());
+
+		if(timelineSemaphores()) {
+			batch.signals.push_back(lane.semaphore);
+			batch.signalValues.push_back(lane.submitted + i + 1);
+
+			auto& tinfo = batch.timelineInfo;
+			tinfo.pNext = info.pNext;
+			tinfo.waitSemaphoreValueCount = batch.waitValues.size();
+			tinfo.pWaitSemaphoreValues = batch.waitValues.data();
+			tinfo.signalSemaphoreValueCount = batch.signalValues.size();
+			tinfo.pSignalSemaphoreValues = batch.signalValues.data();
+			info.pNext = &tinfo;
+		}
 
-		for(const auto& sub : pending_)
-			if(sub.queue == &queue && sub.state)
-				sub.state->fence_ = shfence;
+		info.waitSemaphoreCount = batch.waits.size();
+		info.pWaitSemaphores = batch.waits.data();
+		info.pWaitDstStageMask = batch.waitStages.data();
+		info.signalSemaphoreCount = batch.signals.size();
+		info.pSignalSemaphores = batch.signals.data();
 	}
 
-	// Lock all queues for submission
-	// submit the queue
+	vk::Fence fence {};
+	if(!timelineSemaphores() && useFence) {
+		if(lane.fences.empty()) {
+			lane.fences.emplace_back(device());
+		} else {
+			vk::resetFences(device(), {lane.fences.back().vkHandle()});
+		}
+
+		fence = lane.fences.back();
+	}
+
+	// only this queue has to be locked for submission
 	{
-		QueueLock queueLock(device());
-		if(shfence) vk::queueSubmit(queue, submitInfos, shfence->vkHandle());
-		else vk::queueSubmit(queue, submitInfos);
+		QueueLock queueLock(device(), *lane.queue);
+		vk::queueSubmit(*lane.queue, submitInfos, fence);
+	}
+
+	if(timelineSemaphores()) {
+		for(auto i = 0u; i < count; ++i) {
+			auto value = lane.submitted + i + 1;
+			if(subs[i].state) subs[i].state->value_ = value;
+			if(subs[i].value) *subs[i].value = value;
+		}
+
+		lane.submitted += submitInfos.size();
+	} else if(fence) {
+		++lane.submitted;
+		for(auto it = subs.begin(); it != end; ++it) {
+			auto& sub = *it;
+			if(sub.state) sub.state->value_ = lane.submitted;
+			if(sub.value) *sub.value = lane.submitted;
+			for(auto& sem : sub.semaphores) {
+				lane.semaphores.emplace_back(lane.submitted, std::move(sem));
+			}
+		}
+
+		lane.pending.emplace_back(lane.submitted, std::move(lane.fences.back()));
+		lane.fences.pop_back();
+	}
+
+	auto buffers = 0u;
+	for(auto it = subs.begin(); it != end; ++it) {
+		buffers += it->buffers.size();
 	}
 
-	// erase all submitted submissions
-	auto pred = [&](const Submission& sub) { return sub.queue == &queue; };
-	pending_.erase(std::remove_if(pending_.begin(), pending_.end(), pred), pending_.end());
+	lane.buffers -= buffers;
+	lane.count -= count;
+	subs.erase(subs.begin(), end);
+
+	// the age is that of the oldest submission still pending
+	if(lane.count) {
+		drain(lane);
+		lane.since = subs.empty() ? now() : subs.front().added;
+	}
+}
+
+void SubmitManager::drain(Lane& lane)
+{
+	auto node = lane.intake.exchange(nullptr, std::memory_order_acquire);
+	if(!node) {
+		return;
+	}
+
+	// the intake is a stack, reverse it to keep the order of submissions
+	auto begin = lane.submissions.size();
+	while(node) {
+		lane.submissions.push_back(std::move(node->submission));
+		auto next = node->next;
+		delete node;
+		node = next;
+	}
+
+	std::reverse(lane.submissions.begin() + begin, lane.submissions.end());
+}
+
+void SubmitManager::moveBefore(Lane& lane, std::size_t pos, std::size_t dep)
+{
+	// Since dependencies are always before the submissions depending on
+	// them, one backwards pass finds everything the dependency (transitively)
+	// depends on between it and pos
+	auto& subs = lane.submissions;
+	std::vector<bool> moved(dep - pos + 1);
+	moved.back() = true;
+	for(auto i = moved.size(); i-- > 0;) {
+		if(!moved[i]) {
+			continue;
+		}
+
+		for(auto& value : subs[pos + i].after) {
+			for(auto j = 0u; j < i; ++j) {
+				moved[j] = moved[j] || (subs[pos + j].value == value);
+			}
+		}
+	}
+
+	if(moved.front()) {
+		throw std::logic_error("vpp::SubmitManager::addDependency: circular dependency");
+	}
+
+	std::vector<Submission> reordered;
+	reordered.reserve(moved.size());
+	for(auto order : {true, false}) {
+		for(auto i = 0u; i < moved.size(); ++i) {
+			if(moved[i] == order) {
+				reordered.push_back(std::move(subs[pos + i]));
+			}
+		}
+	}
+
+	std::move(reordered.begin(), reordered.end(), subs.begin() + pos);
+}
+
+void SubmitManager::addDependency(const CommandExecutionState& state,
+	const CommandExecutionState& dep, vk::PipelineStageFlags stages)
+{
+	if(state.submitManager_ != this || state.value_ || state.completed_) {
+		throw std::logic_error("vpp::SubmitManager::addDependency: state is not pending");
+	}
+
+	if(!dep.valid() || dep.completed_ || dep.submitManager_ != this) {
+		return;
+	}
+
+	// lock both lanes, in any order
+	auto& slane = lane(*state.queue_);
+	auto& dlane = lane(*dep.queue_);
+	std::unique_lock<std::mutex> slock(slane.mutex, std::defer_lock);
+	std::unique_lock<std::mutex> dlock(dlane.mutex, std::defer_lock);
+	if(&slane == &dlane) {
+		slock.lock();
+	} else {
+		std::lock(slock, dlock);
+		drain(dlane);
+	}
+
+	drain(slane);
+
+	auto find = [&](Lane& lane, const CommandExecutionState& s) {
+		auto pred = [&](const Submission& sub) { return (sub.state == &s); };
+		return std::find_if(lane.submissions.begin(), lane.submissions.end(), pred);
+	};
+
+	auto it = find(slane, state);
+	if(it == slane.submissions.end()) {
+		throw std::logic_error("vpp::SubmitManager::addDependency: state is not pending");
+	}
+
+	// already submitted (the value is only set with the lane locked)
+	if(dep.value_) {
+		if(&dlane == &slane) {
+			return;
+		}
+
+		if(timelineSemaphores()) {
+			it->waits.push_back({dlane.semaphore, stages, dep.value_});
+			return;
+		}
+
+		auto value = dep.value_.load();
+		slock.unlock();
+		dlock.unlock();
+		wait(*dep.queue_, value);
+		return;
+	}
+
+	// same queue: make sure the dependency is submitted before
+	auto dit = find(dlane, dep);
+	if(dit == dlane.submissions.end()) {
+		return;
+	}
+
+	if(dit == it) {
+		return;
+	}
+
+	// the value is shared so that it stays valid independent from the state
+	if(!dit->value) {
+		dit->value = std::make_shared<std::atomic<std::uint64_t>>(0u);
+	}
+
+	if(&dlane == &slane) {
+		auto value = dit->value;
+		if(dit > it) {
+			moveBefore(slane, it - slane.submissions.begin(),
+				dit - slane.submissions.begin());
+			it = find(slane, state);
+		}
+
+		// remembered for later reorderings
+		it->after.push_back(std::move(value));
+		return;
+	}
+
+	Dependency dependency {dit->value, &dlane, stages, {}};
+	if(!timelineSemaphores()) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		if(semaphores_.empty()) semaphores_.emplace_back(device());
+		dependency.semaphore = semaphores_.back();
+		dit->signals.push_back(semaphores_.back());
+		it->semaphores.push_back(std::move(semaphores_.back()));
+		semaphores_.pop_back();
+	}
+
+	it->dependencies.push_back(dependency);
 }
 
 void SubmitManager::add(const vpp::Queue& queue, nytl::Span<const vk::CommandBuffer> buffers,
@@ -108,104 +522,470 @@ void SubmitManager::add(const vpp::Queue& queue, nytl::Span<const vk::CommandBuf
 	submission.queue = &queue;
 	submission.info = info;
 	submission.buffers = {buffers.begin(), buffers.end()};
+	submission.added = now();
 
 	if(state) {
 		submission.state = state;
-		state->init(*this);
+		state->init(*this, queue);
 	}
 
-	std::lock_guard<std::mutex> internalLock(mutex_);
-	pending_.push_back(std::move(submission));
-}
+	// the counts are increased first, so they are never decreased below zero
+	// by a thread draining the intake
+	auto& lane = this->lane(queue);
+	lane.buffers += buffers.size();
+	if(lane.count++ == 0) {
+		lane.since = submission.added;
+	}
 
-void SubmitManager::submit(const CommandExecutionState& state)
-{
-	const vpp::Queue* queue {};
+	auto node = new Lane::Node {std::move(submission), nullptr};
+	node->next = lane.intake.load(std::memory_order_relaxed);
+	while(!lane.intake.compare_exchange_weak(node->next, node,
+		std::memory_order_release, std::memory_order_relaxed));
 
-	{
-		std::lock_guard<std::mutex> internalLock(mutex_);
-		auto pred = [&](const Submission& sub) { return (sub.state == &state); };
-		auto it = std::find_if(pending_.begin(), pending_.end(), pred);
-		if(it != pending_.end()) queue = it->queue;
+	if(threaded_) {
+		threadCv_.notify_one();
+	} else if(due(lane, false)) {
+		submit(lane);
 	}
+}
 
+void SubmitManager::submit(const CommandExecutionState& state)
+{
 	dlg_check("SubmitManager::submit(state)", {
-		if(!queue)
-			vpp_error("::SubmitManager::submit(state)"_src, "could not find given state");
+		if(!state.queue_ || state.submitManager_ != this)
+			vpp_error("::SubmitManager::submit(state)"_src, "invalid state given");
 	});
 
-	submit(*queue);
+	submit(lane(*state.queue_));
 }
 
 void SubmitManager::moveStateObserver(const CommandExecutionState& oldOne,
 	CommandExecutionState& newOne)
 {
-	std::lock_guard<std::mutex> internalLock(mutex_);
-	auto pred = [&](const Submission& sub) { return (sub.state == &oldOne); };
-	auto it = std::find_if(pending_.begin(), pending_.end(), pred);
+	{
+		// the submission might have been submitted by another thread since
+		// the value was read, it only changes with the lane locked
+		auto& lane = this->lane(*oldOne.queue_);
+		std::lock_guard<std::mutex> lock(lane.mutex);
+		drain(lane);
 
-	dlg_check("SubmitManager::moveStateObserver", {
-		if(it == pending_.end())
-			vpp_warn("Could not find old state. Probably crashing now");
-	});
+		newOne.value_ = oldOne.value_.load();
+		if(!newOne.value_) {
+			auto pred = [&](const Submission& sub) { return (sub.state == &oldOne); };
+			auto it = std::find_if(lane.submissions.begin(), lane.submissions.end(), pred);
 
-	it->state = &newOne;
+			dlg_check("SubmitManager::moveStateObserver", {
+				if(it == lane.submissions.end())
+					vpp_warn("Could not find old state");
+			});
+
+			if(it != lane.submissions.end()) {
+				it->state = &newOne;
+			}
+		}
+	}
 }
 
 void SubmitManager::removeStateObserver(const CommandExecutionState& state)
 {
-	std::lock_guard<std::mutex> internalLock(mutex_);
-	auto pred = [&](const Submission& sub) { return (sub.state == &state); };
-	auto it = std::find_if(pending_.begin(), pending_.end(), pred);
+	Submission removed;
 
-	dlg_check("SubmitManager::removeStateObserver", {
-		if(it == pending_.end())
-			vpp_warn("Could not find command execution state");
-	});
+	{
+		auto& lane = this->lane(*state.queue_);
+		std::lock_guard<std::mutex> lock(lane.mutex);
+		drain(lane);
 
-	pending_.erase(it);
+		// submitted by another thread in the meantime
+		if(state.value_) {
+			return;
+		}
+
+		auto pred = [&](const Submission& sub) { return (sub.state == &state); };
+		auto it = std::find_if(lane.submissions.begin(), lane.submissions.end(), pred);
+
+		dlg_check("SubmitManager::removeStateObserver", {
+			if(it == lane.submissions.end())
+				vpp_warn("Could not find command execution state");
+		});
+
+		if(it == lane.submissions.end()) {
+			return;
+		}
+
+		removed = std::move(*it);
+		lane.submissions.erase(it);
+		lane.buffers -= removed.buffers.size();
+		--lane.count;
+
+		// dependent submissions no longer wait for it
+		if(removed.value) {
+			*removed.value = removedValue;
+		}
+	}
+
+	// the semaphores of its dependencies are destroyed, so the
+	// dependencies must not signal them
+	for(auto& dep : removed.dependencies) {
+		if(!dep.semaphore) continue;
+
+		std::lock_guard<std::mutex> lock(dep.lane->mutex);
+		drain(*dep.lane);
+		for(auto& sub : dep.lane->submissions) {
+			auto& sigs = sub.signals;
+			sigs.erase(std::remove(sigs.begin(), sigs.end(), dep.semaphore), sigs.end());
+		}
+	}
+}
+
+std::uint64_t SubmitManager::completed(const vpp::Queue& queue, bool update)
+{
+	auto& lane = this->lane(queue);
+	std::lock_guard<std::mutex> lock(lane.mutex);
+	if(update) this->update(lane);
+	return lane.completed;
+}
+
+bool SubmitManager::wait(const vpp::Queue& queue, std::uint64_t value, std::uint64_t timeout)
+{
+	auto& lane = this->lane(queue);
+	vk::Semaphore semaphore {};
+	vk::Fence fence {};
+
+	{
+		std::lock_guard<std::mutex> lock(lane.mutex);
+		if(value <= lane.completed) return true;
+
+		dlg_check("SubmitManager::wait", {
+			if(value > lane.submitted)
+				vpp_error("value {} was not submitted", value);
+		});
+
+		semaphore = lane.semaphore;
+		for(auto& pending : lane.pending) {
+			if(pending.first >= value) {
+				fence = pending.second;
+				break;
+			}
+		}
+	}
+
+	// Wait without holding the lock. A fence is only reused (and reset) while
+	// submitting with the lock held, so if it completed in the meantime, this
+	// just waits until the new submission using it completed.
+	vk::Result result;
+	if(semaphore) {
+		ext::SemaphoreWaitInfo info;
+		info.semaphoreCount = 1;
+		info.pSemaphores = &semaphore;
+		info.pValues = &value;
+
+		auto pfWaitSemaphores = reinterpret_cast<ext::PfnWaitSemaphores>(waitSemaphores_);
+		result = pfWaitSemaphores(device(), &info, timeout);
+	} else if(fence) {
+		result = vk::waitForFences(device(), {fence}, true, timeout);
+	} else {
+		result = vk::Result::success;
+	}
+
+	if(result != vk::Result::success) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(lane.mutex);
+	update(lane);
+	return value <= lane.completed;
+}
+
+bool SubmitManager::wait(nytl::Span<CommandExecutionState* const> states, bool all,
+	std::uint64_t timeout)
+{
+	for(auto state : states) {
+		if(state && state->valid() && !state->submitted()) state->submit();
+	}
+
+	// the value that has to be reached per lane
+	std::vector<std::pair<Lane*, std::uint64_t>> targets;
+	for(auto state : states) {
+		if(!state || !state->submitted() || state->completed_) {
+			if(state && state->completed_ && !all) return true;
+			continue;
+		}
+
+		auto& lane = this->lane(*state->queue_);
+		std::uint64_t value = state->value_;
+		auto it = std::find_if(targets.begin(), targets.end(),
+			[&](auto& t) { return t.first == &lane; });
+		if(it == targets.end()) {
+			targets.push_back({&lane, value});
+		} else if(all) {
+			it->second = std::max(it->second, value);
+		} else {
+			it->second = std::min(it->second, value);
+		}
+	}
+
+	std::vector<vk::Semaphore> semaphores;
+	std::vector<std::uint64_t> values;
+	std::vector<vk::Fence> fences;
+
+	for(auto& target : targets) {
+		auto& lane = *target.first;
+		std::lock_guard<std::mutex> lock(lane.mutex);
+		if(target.second <= lane.completed) {
+			if(!all) return true;
+			continue;
+		}
+
+		if(lane.semaphore) {
+			semaphores.push_back(lane.semaphore);
+			values.push_back(target.second);
+			continue;
+		}
+
+		for(auto& pending : lane.pending) {
+			if(pending.first >= target.second) {
+				fences.push_back(pending.second);
+				break;
+			}
+		}
+	}
+
+	// see wait(queue, value, timeout) for waiting without the lock
+	vk::Result result = vk::Result::success;
+	if(!semaphores.empty()) {
+		ext::SemaphoreWaitInfo info;
+		info.flags = all ? 0u : ext::semaphoreWaitAny;
+		info.semaphoreCount = semaphores.size();
+		info.pSemaphores = semaphores.data();
+		info.pValues = values.data();
+
+		auto pfWaitSemaphores = reinterpret_cast<ext::PfnWaitSemaphores>(waitSemaphores_);
+		result = pfWaitSemaphores(device(), &info, timeout);
+	} else if(!fences.empty()) {
+		result = vk::waitForFences(device(), fences, all, timeout);
+	}
+
+	for(auto& target : targets) {
+		std::lock_guard<std::mutex> lock(target.first->mutex);
+		update(*target.first);
+	}
+
+	return result == vk::Result::success;
+}
+
+vk::Semaphore SubmitManager::semaphore(const vpp::Queue& queue)
+{
+	return lane(queue).semaphore;
+}
+
+void SubmitManager::startThread(std::chrono::nanoseconds latency)
+{
+	if(thread_.joinable()) {
+		return;
+	}
+
+	latency_ = latency;
+	stop_ = false;
+	thread_ = std::thread([this]{ run(); });
+	threaded_ = true;
+}
+
+void SubmitManager::stopThread()
+{
+	if(!thread_.joinable()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(threadMutex_);
+		stop_ = true;
+	}
+
+	// add and flushPolicy must submit themselves from now on
+	threaded_ = false;
+	threadCv_.notify_all();
+	thread_.join();
+}
+
+void SubmitManager::run()
+{
+	auto due = [&]{
+		return std::any_of(lanes_.begin(), lanes_.end(),
+			[&](const Lane& lane) { return this->due(lane, true); });
+	};
+
+	while(true) {
+		// sleep at most until the next age limit is reached
+		auto timeout = latency_;
+		auto time = now();
+		for(auto& lane : lanes_) {
+			auto age = lane.flushAge.load();
+			if(!age || !lane.count.load()) continue;
+
+			auto left = std::chrono::nanoseconds(lane.since.load() + age - time);
+			timeout = std::max(std::min(timeout, left), std::chrono::nanoseconds(0));
+		}
+
+		{
+			// add notifies without holding the lock, a missed notification
+			// only delays the submission by the latency
+			std::unique_lock<std::mutex> lock(threadMutex_);
+			threadCv_.wait_for(lock, timeout, [&]{ return stop_ || due(); });
+			if(stop_) {
+				break;
+			}
+		}
+
+		try {
+			for(auto& lane : lanes_) {
+				if(this->due(lane, true)) submit(lane);
+			}
+		} catch(const std::exception& err) {
+			vpp_warn("::SubmitManager"_src, "submission thread: {}", err.what());
+		}
+	}
+}
+
+void SubmitManager::flushPolicy(const vpp::Queue& queue, const FlushPolicy& policy)
+{
+	auto& lane = this->lane(queue);
+	lane.flushBuffers = policy.commandBuffers;
+	lane.flushAge = std::chrono::nanoseconds(policy.age).count();
+	lane.flushFrame = policy.frame;
+
+	// the new policy might already be met
+	if(threaded_) {
+		threadCv_.notify_one();
+	} else if(due(lane, false)) {
+		submit(lane);
+	}
+}
+
+SubmitManager::FlushPolicy SubmitManager::flushPolicy(const vpp::Queue& queue)
+{
+	auto& lane = this->lane(queue);
+	FlushPolicy policy;
+	policy.commandBuffers = lane.flushBuffers;
+	policy.age = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::nanoseconds(lane.flushAge.load()));
+	policy.frame = lane.flushFrame;
+	return policy;
+}
+
+void SubmitManager::endFrame()
+{
+	for(auto& lane : lanes_) {
+		if(lane.flushFrame && lane.count.load()) submit(lane);
+	}
+}
+
+bool SubmitManager::due(const Lane& lane, bool threaded) const
+{
+	if(!lane.count.load()) {
+		return false;
+	}
+
+	auto buffers = lane.flushBuffers.load();
+	auto age = lane.flushAge.load();
+	if(!buffers && !age) {
+		return threaded;
+	}
+
+	return (buffers && lane.buffers.load() >= buffers) ||
+		(age && now() - lane.since.load() >= age);
+}
+
+SubmitManager::Lane& SubmitManager::lane(const vpp::Queue& queue)
+{
+	for(auto& lane : lanes_) {
+		if(lane.queue == &queue) return lane;
+	}
+
+	throw std::logic_error("vpp::SubmitManager: queue does not belong to the device");
+}
+
+void SubmitManager::update(Lane& lane)
+{
+	if(lane.semaphore) {
+		auto pfGetSemaphoreCounterValue =
+			reinterpret_cast<ext::PfnGetSemaphoreCounterValue>(getCounterValue_);
+
+		std::uint64_t value;
+		VPP_CALL(pfGetSemaphoreCounterValue(device(), lane.semaphore, &value));
+		lane.completed = std::max(lane.completed, value);
+		return;
+	}
+
+	// fences complete in submission order, signaled fences are kept
+	// signaled until they are reused
+	auto it = lane.pending.begin();
+	for(; it != lane.pending.end(); ++it) {
+		if(vk::getFenceStatus(device(), it->second) != vk::Result::success) break;
+		lane.completed = it->first;
+		lane.fences.push_back(std::move(it->second));
+	}
+
+	lane.pending.erase(lane.pending.begin(), it);
+
+	// semaphores waited upon by completed submissions are unsignaled again
+	auto sit = lane.semaphores.begin();
+	if(sit != lane.semaphores.end() && sit->first <= lane.completed) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		for(; sit != lane.semaphores.end() && sit->first <= lane.completed; ++sit) {
+			semaphores_.push_back(std::move(sit->second));
+		}
+	}
+
+	lane.semaphores.erase(lane.semaphores.begin(), sit);
 }
 
 // CommandExecutionState
 CommandExecutionState::CommandExecutionState() = default;
 CommandExecutionState::~CommandExecutionState()
 {
-	if(submitManager_ && !fence_ && !completed_)
+	if(submitManager_ && !value_ && !completed_)
 		submitManager_->removeStateObserver(*this);
 }
 
 CommandExecutionState::CommandExecutionState(CommandExecutionState&& other) noexcept
-	: submitManager_(other.submitManager_), fence_(std::move(other.fence_)),
+	: submitManager_(other.submitManager_), queue_(other.queue_), value_(other.value_.load()),
 		completed_(other.completed_)
 {
+	// must be called before other is reset, the submission might
+	// be submitted by another thread in the meantime
+	if(submitManager_ && !value_ && !completed_)
+		submitManager_->moveStateObserver(other, *this);
+
 	other.completed_ = {};
 	other.submitManager_ = {};
-
-	if(submitManager_)
-		submitManager_->moveStateObserver(other, *this);
+	other.queue_ = {};
+	other.value_ = 0u;
 }
 
 CommandExecutionState& CommandExecutionState::operator=(CommandExecutionState&& other) noexcept
 {
-	if(submitManager_)
+	if(submitManager_ && !value_ && !completed_)
 		submitManager_->removeStateObserver(*this);
 
 	submitManager_ = other.submitManager_;
-	fence_ = std::move(other.fence_);
+	queue_ = other.queue_;
+	value_ = other.value_.load();
 	completed_ = other.completed_;
 
+	if(submitManager_ && !value_ && !completed_)
+		submitManager_->moveStateObserver(other, *this);
+
 	other.completed_ = {};
 	other.submitManager_ = {};
-
-	if(submitManager_)
-		submitManager_->moveStateObserver(other, *this);
+	other.queue_ = {};
+	other.value_ = 0u;
 
 	return *this;
 }
 
 void CommandExecutionState::submit()
 {
-	if(fence_ || completed_) return;
+	if(value_ || completed_) return;
 
 	dlg_check("CommandExecutionState::submit", {
 		if(!submitManager_)
@@ -215,23 +995,24 @@ void CommandExecutionState::submit()
 	submitManager_->submit(*this);
 }
 
-bool CommandExecutionState::wait(std::uint64_t timeout)
+void CommandExecutionState::dependsOn(const CommandExecutionState& other,
+	vk::PipelineStageFlags stages)
 {
-	if(completed_) return true;
-	if(!fence_) submit();
-
-	auto result = vk::waitForFences(submitManager_->device(), 1, *fence_, 0, timeout);
-	if(result == vk::Result::success) {
-		completed_ = true;
-		fence_ = {};
-	}
+	dlg_check("CommandExecutionState::dependsOn", {
+		if(!submitManager_ || value_ || completed_)
+			vpp_error("::CommandExecutionState::dependsOn"_src, "state is not pending");
+	});
 
-	return completed_;
+	submitManager_->addDependency(*this, other, stages);
 }
 
-bool CommandExecutionState::submitted() const
+bool CommandExecutionState::wait(std::uint64_t timeout)
 {
-	return fence_.get() != nullptr;
+	if(completed_) return true;
+	if(!value_) submit();
+
+	completed_ = submitManager_->wait(*queue_, value_, timeout);
+	return completed_;
 }
 
 bool CommandExecutionState::completed() const
@@ -239,29 +1020,21 @@ bool CommandExecutionState::completed() const
 	if(!submitted()) return false;
 	if(completed_) return true;
 
-	auto result = vk::getFenceStatus(submitManager_->device(), *fence_);
-	if(result == vk::Result::success) {
-		completed_ = true;
-		fence_ = {};
-	}
-
+	// first check the cached value, only query the device if needed
+	completed_ = value_ <= submitManager_->completed(*queue_, false) ||
+		value_ <= submitManager_->completed(*queue_, true);
 	return completed_;
 }
 
-void CommandExecutionState::init(SubmitManager& submitManager)
+void CommandExecutionState::init(SubmitManager& submitManager, const vpp::Queue& queue)
 {
-	if(submitManager_ && !fence_ && !completed_)
+	if(submitManager_ && !value_ && !completed_)
 		submitManager_->removeStateObserver(*this);
 
-	fence_ = {};
+	value_ = 0u;
 	completed_ = {};
 	submitManager_ = &submitManager;
-}
-
-vk::Fence CommandExecutionState::fence() const
-{
-	if(fence_) return *fence_;
-	return {};
+	queue_ = &queue;
 }
 
 } // namespace vpp
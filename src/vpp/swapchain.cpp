@@ -346,14 +346,15 @@ void Swapchain::resize(const vk::Extent2D& size, const SwapchainSettings& settin
 	createBuffers();
 }
 
-vk::Result Swapchain::acquire(unsigned int& id, vk::Semaphore sem, vk::Fence fence) const
+vk::Result Swapchain::acquire(unsigned int& id, vk::Semaphore sem, vk::Fence fence,
+	std::uint64_t timeout) const
 {
-	// TODO: handle out of date, correct sync, timeout... (?)
+	// TODO: handle out of date, correct sync... (?)
 	VPP_LOAD_PROC(vkDevice(), AcquireNextImageKHR);
 
 	std::uint32_t id32;
-	auto ret = pfAcquireNextImageKHR(device(), vkHandle(), UINT64_MAX, sem, fence, &id32);
-	id = id32;
+	auto ret = pfAcquireNextImageKHR(device(), vkHandle(), timeout, sem, fence, &id32);
+	if(ret == vk::Result::success || ret == vk::Result::suboptimalKHR) id = id32;
 
 	return ret;
 }
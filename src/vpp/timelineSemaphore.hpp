@@ -0,0 +1,111 @@
+// Copyright (c) 2017 nyorain
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <vpp/fwd.hpp>
+#include <vpp/vulkan/enums.hpp>
+#include <vpp/vulkan/structs.hpp>
+#include <vpp/util/span.hpp>
+
+#include <cstring> // std::strcmp
+
+// VK_KHR_timeline_semaphore is newer than the generated vulkan api, therefore
+// the used parts of it are declared here manually.
+// Used internally for tracking submissions (SubmitManager).
+
+namespace vpp {
+namespace ext {
+
+constexpr auto timelineSemaphoreExtensionName = "VK_KHR_timeline_semaphore";
+
+constexpr auto physicalDeviceTimelineSemaphoreFeaturesKHR =
+	static_cast<vk::StructureType>(1000207000);
+constexpr auto semaphoreTypeCreateInfoKHR = static_cast<vk::StructureType>(1000207002);
+constexpr auto timelineSemaphoreSubmitInfoKHR = static_cast<vk::StructureType>(1000207003);
+constexpr auto semaphoreWaitInfoKHR = static_cast<vk::StructureType>(1000207004);
+
+/// VK_SEMAPHORE_TYPE_TIMELINE_KHR
+constexpr auto semaphoreTypeTimeline = 1u;
+
+/// VK_SEMAPHORE_WAIT_ANY_BIT_KHR
+constexpr auto semaphoreWaitAny = 0x00000001u;
+
+struct PhysicalDeviceTimelineSemaphoreFeatures {
+	vk::StructureType sType {physicalDeviceTimelineSemaphoreFeaturesKHR};
+	void* pNext {};
+	vk::Bool32 timelineSemaphore {};
+};
+
+struct SemaphoreTypeCreateInfo {
+	vk::StructureType sType {semaphoreTypeCreateInfoKHR};
+	const void* pNext {};
+	uint32_t semaphoreType {semaphoreTypeTimeline};
+	uint64_t initialValue {};
+};
+
+struct TimelineSemaphoreSubmitInfo {
+	vk::StructureType sType {timelineSemaphoreSubmitInfoKHR};
+	const void* pNext {};
+	uint32_t waitSemaphoreValueCount {};
+	const uint64_t* pWaitSemaphoreValues {};
+	uint32_t signalSemaphoreValueCount {};
+	const uint64_t* pSignalSemaphoreValues {};
+};
+
+struct SemaphoreWaitInfo {
+	vk::StructureType sType {semaphoreWaitInfoKHR};
+	const void* pNext {};
+	uint32_t flags {};
+	uint32_t semaphoreCount {};
+	const vk::Semaphore* pSemaphores {};
+	const uint64_t* pValues {};
+};
+
+using PfnGetSemaphoreCounterValue = vk::Result(*VKAPI_PTR)(vk::Device device,
+	vk::Semaphore semaphore, uint64_t* pValue);
+using PfnWaitSemaphores = vk::Result(*VKAPI_PTR)(vk::Device device,
+	const SemaphoreWaitInfo* pWaitInfo, uint64_t timeout);
+
+/// Returns whether the timeline semaphore extension is in the given list.
+inline bool hasTimelineExtension(nytl::Span<const char* const> extensions)
+{
+	for(auto extension : extensions) {
+		if(!std::strcmp(extension, timelineSemaphoreExtensionName)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/// Returns whether the given device create info enables the extension
+/// and the timelineSemaphore feature.
+inline bool timelineSemaphoresEnabled(const vk::DeviceCreateInfo& info)
+{
+	if(!hasTimelineExtension({info.ppEnabledExtensionNames, info.enabledExtensionCount})) {
+		return false;
+	}
+
+	// every structure in the chain starts with sType and pNext
+	struct Header {
+		vk::StructureType sType;
+		const void* pNext;
+	};
+
+	for(auto next = info.pNext; next;) {
+		auto header = static_cast<const Header*>(next);
+		if(header->sType == physicalDeviceTimelineSemaphoreFeaturesKHR) {
+			auto features = static_cast<const PhysicalDeviceTimelineSemaphoreFeatures*>(next);
+			return features->timelineSemaphore;
+		}
+
+		next = header->pNext;
+	}
+
+	return false;
+}
+
+} // namespace ext
+} // namespace vpp
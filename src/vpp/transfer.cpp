@@ -12,7 +12,7 @@ namespace vpp {
 
 //TransferBuffer
 TransferManager::TransferBuffer::TransferBuffer(const Device& dev, std::size_t size, std::mutex& mtx)
-	: mutex_(mtx)
+	: size_(size), mutex_(mtx)
 {
 	vk::BufferCreateInfo info;
 	info.size = size;
@@ -31,21 +31,31 @@ TransferManager::TransferBuffer::~TransferBuffer()
 	})
 }
 
-Allocation TransferManager::TransferBuffer::use(std::size_t size)
+Allocation TransferManager::TransferBuffer::use(std::size_t size, std::size_t alignment)
 {
-	static const Allocation start = {0, 0};
-	auto old = start;
+	auto align = [&](std::size_t offset) {
+		return ((offset + alignment - 1) / alignment) * alignment;
+	};
 
+	std::size_t end = 0u;
 	for(auto it = ranges_.begin(); it != ranges_.end(); ++it) {
-		if(it->offset - old.end() > size) {
-			Allocation range = {old.end(), size};
+		auto offset = align(end);
+		if(offset + size <= it->offset) {
+			Allocation range = {offset, size};
 
 			//inserts the tested range before the higher range, if there is any
 			ranges_.insert(it, range);
 			return range;
 		}
 
-		old = *it;
+		end = it->end();
+	}
+
+	// the space after the last range
+	auto offset = align(end);
+	if(offset + size <= size_) {
+		ranges_.push_back({offset, size});
+		return ranges_.back();
 	}
 
 	return {};
@@ -94,17 +104,17 @@ TransferManager::TransferManager(const Device& dev) : Resource(dev)
 {
 }
 
-TransferRange TransferManager::buffer(std::size_t size)
+TransferRange TransferManager::buffer(std::size_t size, std::size_t alignment)
 {
 	std::lock_guard<std::mutex> guard(mutex_);
 	for(auto& buffp : buffers_) {
-		auto alloc = buffp->use(size);
+		auto alloc = buffp->use(size, alignment);
 		if(alloc.size > 0) return BufferRange(*buffp, alloc);
 	}
 
 	// allocate a new buffer
 	buffers_.emplace_back(new TransferBuffer(device(), size, mutex_));
-	return BufferRange(*buffers_.back(), buffers_.back()->use(size));
+	return BufferRange(*buffers_.back(), buffers_.back()->use(size, alignment));
 }
 
 std::size_t TransferManager::totalSize() const
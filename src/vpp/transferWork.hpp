@@ -38,7 +38,8 @@ public:
 	virtual nytl::Span<const uint8_t> data() override
 	{
 		finish();
-		downloadWork_ = retrieve(transferRange_.buffer());
+		downloadWork_ = retrieve(transferRange_.buffer(), transferRange_.offset(),
+			transferRange_.size());
 		return downloadWork_->data();
 	}
 
@@ -48,15 +49,23 @@ protected:
 
 /// Download work implementation for mappable memory resources.
 /// Returns the data span directly from the mapped memory range.
+/// Optionally only returns the given range (relative to the view).
 class MappableDownloadWork : public FinishedWork<nytl::Span<const uint8_t>> {
 public:
-	MappableDownloadWork(MemoryMapView&& view) : map_(std::move(view)) {}
+	MappableDownloadWork(MemoryMapView&& view) : map_(std::move(view)), range_{0, map_.size()} {}
+	MappableDownloadWork(MemoryMapView&& view, const Allocation& range)
+		: map_(std::move(view)), range_(range)
+	{
+		if(!map_.coherent()) map_.reload(range_);
+	}
 
-	virtual nytl::Span<const uint8_t> data() override { return {map_.ptr(), map_.size()}; }
+	virtual nytl::Span<const uint8_t> data() override
+		{ return {map_.ptr() + range_.offset, range_.size}; }
 	MemoryMapView& memoryMapView() { return map_; }
 
 protected:
 	MemoryMapView map_;
+	Allocation range_;
 };
 
 /// Download work implementation for already stored data.
@@ -3,11 +3,25 @@
 // See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
 
 #include <vpp/work.hpp>
+#include <vpp/queue.hpp>
+#include <vpp/device.hpp>
 #include <iterator>
 #include <algorithm>
 
 namespace vpp {
 
+void WorkBase::dependsOn(WorkBase& other, vk::PipelineStageFlags waitStages)
+{
+	auto state = commandState();
+	auto otherState = other.commandState();
+	if(state && otherState && state->valid() && !state->submitted()) {
+		state->dependsOn(*otherState, waitStages);
+		return;
+	}
+
+	other.wait();
+}
+
 WorkManager::~WorkManager()
 {
 	finish();
@@ -23,7 +37,7 @@ void WorkManager::add(std::vector<std::unique_ptr<WorkBase>>&& work)
 {
 	using std::make_move_iterator;
 
-	std::remove(work.begin(), work.end(), nullptr);
+	work.erase(std::remove(work.begin(), work.end(), nullptr), work.end());
 	todo_.insert(todo_.end(), make_move_iterator(work.begin()), make_move_iterator(work.end()));
 }
 
@@ -41,6 +55,7 @@ void WorkManager::submit()
 
 void WorkManager::finish()
 {
+	wait();
 	for(auto& work : todo_)
 		if(work && !work->finished())
 			work->finish();
@@ -48,4 +63,87 @@ void WorkManager::finish()
 	todo_.clear();
 }
 
+bool WorkManager::wait(bool all, std::uint64_t timeout)
+{
+	submit();
+
+	// the command submissions per submit manager
+	std::vector<std::pair<SubmitManager*, std::vector<CommandExecutionState*>>> states;
+	std::vector<WorkBase*> others;
+	for(auto& work : todo_) {
+		if(!work || work->executed()) {
+			if(!all) return true;
+			continue;
+		}
+
+		auto state = work->commandState();
+		if(!state || !state->queue()) {
+			others.push_back(work.get());
+			continue;
+		}
+
+		auto& manager = state->queue()->device().submitManager();
+		auto it = std::find_if(states.begin(), states.end(),
+			[&](auto& s) { return s.first == &manager; });
+		if(it == states.end()) {
+			states.push_back({&manager, {}});
+			it = states.end() - 1;
+		}
+
+		it->second.push_back(state);
+	}
+
+	// other work can not be waited for with a timeout
+	if(all || states.empty()) {
+		for(auto work : others) {
+			work->wait();
+			if(!all) return true;
+		}
+	}
+
+	if(all) {
+		for(auto& s : states) {
+			if(!s.first->wait(s.second, true, timeout)) return false;
+		}
+
+		return true;
+	}
+
+	if(states.empty()) {
+		return false;
+	}
+
+	// with multiple devices, waiting for any only blocks for the first one,
+	// the others are only checked before and after that
+	for(auto& s : states) {
+		if(s.first->wait(s.second, false, 0)) return true;
+	}
+
+	if(states.front().first->wait(states.front().second, false, timeout)) {
+		return true;
+	}
+
+	for(auto it = states.begin() + 1; it != states.end(); ++it) {
+		if(it->first->wait(it->second, false, 0)) return true;
+	}
+
+	return false;
+}
+
+std::size_t WorkManager::poll()
+{
+	auto count = std::size_t(0);
+	for(auto& work : todo_) {
+		if(work && work->executed()) {
+			work->finish();
+			work.reset();
+			++count;
+		}
+	}
+
+	// finished and empty entries
+	todo_.erase(std::remove(todo_.begin(), todo_.end(), nullptr), todo_.end());
+	return count;
+}
+
 } // namespace vpp